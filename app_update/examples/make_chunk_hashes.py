@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""
+Create the chunk hashes AppUpdate verifies a download with while it is still
+arriving (see inc/au_chunk_verifier.h).
+
+  make_chunk_hashes.py DEWETRON_Oxygen_Setup_R7.2.0_x64.zip oxygen-7.2.0.leaves
+
+writes the raw SHA256 leaf hashes and prints the "chunk_hashes" entry for
+update.json. Publish the leaves file next to the installer:
+
+  "chunk_hashes": { "url": "https://.../oxygen-7.2.0.leaves",
+                    "chunk_size": 1048576, "root": "..." }
+
+Leaves are SHA256(0x00 + chunk), inner nodes SHA256(0x01 + left + right),
+an odd node is promoted to the next level unchanged.
+"""
+import argparse
+import hashlib
+import json
+
+LEAF_PREFIX = b'\x00'
+NODE_PREFIX = b'\x01'
+
+
+def leaf_hashes(path, chunk_size):
+    leaves = []
+    with open(path, 'rb') as installer:
+        while True:
+            chunk = installer.read(chunk_size)
+            if not chunk:
+                break
+            leaves.append(hashlib.sha256(LEAF_PREFIX + chunk).digest())
+    return leaves
+
+
+def root_hash(nodes):
+    while len(nodes) > 1:
+        parents = [hashlib.sha256(NODE_PREFIX + nodes[i] + nodes[i + 1]).digest()
+                   for i in range(0, len(nodes) - 1, 2)]
+        if len(nodes) % 2:
+            parents.append(nodes[-1])
+        nodes = parents
+    return nodes[0] if nodes else b''
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Create the chunk hash tree of an installer')
+    parser.add_argument('installer')
+    parser.add_argument('leaves')
+    parser.add_argument('--chunk-size', type=int, default=1024 * 1024)
+    parser.add_argument('--url', default='', help='url the leaves file is published at')
+    args = parser.parse_args()
+
+    if args.chunk_size <= 0:
+        parser.error('chunk-size has to be positive')
+
+    leaves = leaf_hashes(args.installer, args.chunk_size)
+    with open(args.leaves, 'wb') as leaves_file:
+        leaves_file.write(b''.join(leaves))
+
+    entry = {
+        'url': args.url,
+        'chunk_size': args.chunk_size,
+        'root': root_hash(leaves).hex(),
+    }
+    print('"chunk_hashes": %s' % json.dumps(entry))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""
+Create the chunk index AppUpdate uses to assemble an installer from the
+chunks of installers it already has (see inc/au_chunk_index.h).
+
+  make_chunk_index.py DEWETRON_Oxygen_Setup_R7.2.0_x64.zip > oxygen-7.2.0.chunks.json
+
+Publish the index next to the installer and reference it in update.json:
+
+  "chunk_index": "https://.../oxygen-7.2.0.chunks.json"
+
+The chunking has to match the client bit by bit: FastCDC with a gear table
+from splitmix64, normalized chunking level 2, SHA256 chunk hashes.
+"""
+import argparse
+import hashlib
+import json
+import os
+import sys
+
+MASK64 = (1 << 64) - 1
+NORMALIZATION_LEVEL = 2
+
+
+def gear_table():
+    table = []
+    state = 0
+    for _ in range(256):
+        state = (state + 0x9e3779b97f4a7c15) & MASK64
+        z = state
+        z = ((z ^ (z >> 30)) * 0xbf58476d1ce4e5b9) & MASK64
+        z = ((z ^ (z >> 27)) * 0x94d049bb133111eb) & MASK64
+        table.append(z ^ (z >> 31))
+    return table
+
+
+GEAR = gear_table()
+
+
+def top_bits_mask(bits):
+    return ((1 << bits) - 1) << (64 - bits)
+
+
+def cut(data, start, length, min_size, avg_size, max_size, mask_small, mask_large):
+    if length <= min_size:
+        return length
+    normal_size = min(avg_size, length)
+    end = min(max_size, length)
+    fingerprint = 0
+    i = min_size
+    while i < normal_size:
+        fingerprint = ((fingerprint << 1) + GEAR[data[start + i]]) & MASK64
+        if not fingerprint & mask_small:
+            return i + 1
+        i += 1
+    while i < end:
+        fingerprint = ((fingerprint << 1) + GEAR[data[start + i]]) & MASK64
+        if not fingerprint & mask_large:
+            return i + 1
+        i += 1
+    return end
+
+
+def chunk_file(path, min_size, avg_size, max_size):
+    bits = avg_size.bit_length() - 1
+    mask_small = top_bits_mask(bits + NORMALIZATION_LEVEL)
+    mask_large = top_bits_mask(bits - NORMALIZATION_LEVEL)
+
+    with open(path, 'rb') as installer:
+        data = installer.read()
+
+    chunks = []
+    pos = 0
+    while pos < len(data):
+        size = cut(data, pos, len(data) - pos, min_size, avg_size, max_size, mask_small, mask_large)
+        chunks.append([hashlib.sha256(data[pos:pos + size]).hexdigest(), size])
+        pos += size
+    return chunks, len(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Create a content defined chunk index of an installer')
+    parser.add_argument('installer')
+    parser.add_argument('--min-size', type=int, default=16 * 1024)
+    parser.add_argument('--avg-size', type=int, default=64 * 1024)
+    parser.add_argument('--max-size', type=int, default=256 * 1024)
+    args = parser.parse_args()
+
+    if args.avg_size & (args.avg_size - 1) or not args.min_size <= args.avg_size <= args.max_size:
+        parser.error('avg-size has to be a power of two between min-size and max-size')
+
+    chunks, size = chunk_file(args.installer, args.min_size, args.avg_size, args.max_size)
+    index = {
+        'version': 1,
+        'chunker': 'fastcdc',
+        'hash': 'sha256',
+        'min_size': args.min_size,
+        'avg_size': args.avg_size,
+        'max_size': args.max_size,
+        'name': os.path.basename(args.installer),
+        'size': size,
+        'chunks': chunks,
+    }
+    json.dump(index, sys.stdout, separators=(',', ':'))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""
+Local stand-in for the update server, for testing the update channel.
+
+Serves a manifest together with the two kinds of change notifications
+AppUpdate understands:
+
+  /update.json   the manifest with an ETag, answers If-None-Match with 304
+  /events        Server-Sent Events, a "manifest" event with the ETag on
+                 connect and whenever the file changes
+  /poll          long-poll, held until the ETag differs from If-None-Match
+
+Point AppUpdate to it with these settings (DEWETRON/AppUpdate):
+
+  mirrors    = http://localhost:8000/
+  notify_url = http://localhost:8000/events   (or /poll)
+
+Editing the manifest file then triggers a check on all subscribed clients.
+"""
+import argparse
+import hashlib
+import os
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+KEEPALIVE_INTERVAL = 15
+LONG_POLL_TIMEOUT = 60
+WATCH_INTERVAL = 1
+
+
+def read_manifest(path):
+    with open(path, 'rb') as manifest_file:
+        data = manifest_file.read()
+    return data, '"%s"' % hashlib.sha1(data).hexdigest()
+
+
+class NotifyHandler(BaseHTTPRequestHandler):
+    manifest_path = None
+
+    def do_GET(self):
+        path = self.path.split('?')[0]
+        if path.endswith('/update.json'):
+            self.send_manifest()
+        elif path == '/events':
+            self.send_events()
+        elif path == '/poll':
+            self.long_poll()
+        else:
+            self.send_error(404)
+
+    def send_manifest(self):
+        data, etag = read_manifest(self.manifest_path)
+        if self.headers.get('If-None-Match') == etag:
+            self.send_response(304)
+            self.send_header('ETag', etag)
+            self.end_headers()
+            return
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('Content-Length', str(len(data)))
+        self.send_header('ETag', etag)
+        self.end_headers()
+        self.wfile.write(data)
+
+    def send_events(self):
+        self.send_response(200)
+        self.send_header('Content-Type', 'text/event-stream')
+        self.send_header('Cache-Control', 'no-cache')
+        self.end_headers()
+
+        sent_etag = None
+        last_write = 0
+        try:
+            self.wfile.write(b'retry: 3000\n\n')
+            while True:
+                _, etag = read_manifest(self.manifest_path)
+                if etag != sent_etag:
+                    self.wfile.write(('event: manifest\ndata: %s\n\n' % etag).encode())
+                    sent_etag = etag
+                    last_write = time.time()
+                elif time.time() - last_write > KEEPALIVE_INTERVAL:
+                    self.wfile.write(b': keepalive\n\n')
+                    last_write = time.time()
+                self.wfile.flush()
+                time.sleep(WATCH_INTERVAL)
+        except (BrokenPipeError, ConnectionResetError):
+            pass
+
+    def long_poll(self):
+        known_etag = self.headers.get('If-None-Match')
+        deadline = time.time() + LONG_POLL_TIMEOUT
+        while True:
+            _, etag = read_manifest(self.manifest_path)
+            if etag != known_etag:
+                body = etag.encode()
+                self.send_response(200)
+                self.send_header('Content-Type', 'text/plain')
+                self.send_header('Content-Length', str(len(body)))
+                self.send_header('ETag', etag)
+                self.end_headers()
+                self.wfile.write(body)
+                return
+            if time.time() > deadline:
+                self.send_response(304)
+                self.send_header('ETag', etag)
+                self.end_headers()
+                return
+            time.sleep(WATCH_INTERVAL)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Local update server with change notifications')
+    parser.add_argument('--port', type=int, default=8000)
+    parser.add_argument('--manifest', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), 'update.json'))
+    args = parser.parse_args()
+
+    NotifyHandler.manifest_path = args.manifest
+    server = ThreadingHTTPServer(('', args.port), NotifyHandler)
+    server.daemon_threads = True
+    print('Serving %s on port %d' % (args.manifest, args.port))
+    server.serve_forever()
+
+
+if __name__ == '__main__':
+    main()
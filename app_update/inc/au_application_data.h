@@ -17,13 +17,28 @@
 
 #pragma once
 
+#include "au_chunk_assembler.h"
+#include "au_delta_patcher.h"
+#include "au_download_scheduler.h"
+#include "au_download_status.h"
 #include "au_downloader.h"
+#include "au_installer_store.h"
+#include "au_local_copier.h"
+#include "au_manifest_cache.h"
+#include "au_mirror_list.h"
+#include "au_network_session.h"
+#include "au_peer_share.h"
 #include "au_software_enumerator.h"
+#include "au_update_channel.h"
 #include "au_update_json.h"
+#include "au_update_pipeline.h"
+#include "au_zip_extractor.h"
 
 #include <map>
 #include <QObject>
+#include <QSet>
 #include <QStringList>
+#include <QThread>
 #include <QTimer>
 #include <QVariant>
 
@@ -76,6 +91,46 @@ class AuApplicationData : public QObject
                 WRITE setShowOlderVersion
                 NOTIFY showOlderVersionsChanged)
 
+    Q_PROPERTY(int maxConcurrentDownloads
+                READ getMaxConcurrentDownloads
+                WRITE setMaxConcurrentDownloads
+                NOTIFY maxConcurrentDownloadsChanged)
+
+    Q_PROPERTY(int bandwidthLimit
+                READ getBandwidthLimit
+                WRITE setBandwidthLimit
+                NOTIFY bandwidthLimitChanged)
+
+    Q_PROPERTY(bool prefetchUpdates
+                READ getPrefetchUpdates
+                WRITE setPrefetchUpdates
+                NOTIFY prefetchUpdatesChanged)
+
+    Q_PROPERTY(int prefetchQuota
+                READ getPrefetchQuota
+                WRITE setPrefetchQuota
+                NOTIFY prefetchQuotaChanged)
+
+    Q_PROPERTY(bool shareInstallers
+                READ getShareInstallers
+                WRITE setShareInstallers
+                NOTIFY shareInstallersChanged)
+
+    Q_PROPERTY(bool extractArchives
+                READ getExtractArchives
+                WRITE setExtractArchives
+                NOTIFY extractArchivesChanged)
+
+    Q_PROPERTY(int installerCacheSize
+                READ getInstallerCacheSize
+                WRITE setInstallerCacheSize
+                NOTIFY installerCacheSizeChanged)
+
+    Q_PROPERTY(QString localRepository
+                READ getLocalRepository
+                WRITE setLocalRepository
+                NOTIFY localRepositoryChanged)
+
 
 public:
     AuApplicationData();
@@ -90,7 +145,10 @@ public:
     Q_INVOKABLE void checkForUpdates();
     Q_INVOKABLE void updateAll();
     Q_INVOKABLE void download(QUrl download_url);
-    Q_INVOKABLE int getDownloadProgress(QUrl download_url);
+    Q_INVOKABLE QObject* getDownloadStatus(QUrl download_url);
+    Q_INVOKABLE void pauseDownload(QUrl download_url);
+    Q_INVOKABLE void resumeDownload(QUrl download_url);
+    Q_INVOKABLE void cancelDownload(QUrl download_url);
     Q_INVOKABLE void openDownloadFolder(QUrl download_url);
     Q_INVOKABLE void showNotification(const QString& title, const QString& body);
 
@@ -99,20 +157,52 @@ Q_SIGNALS:
     void installedAppsChanged();
     void updateableAppsChanged();
     void messageChanged();
-    void downloadProgressChanged();
     void doShowNotification(const QString& title, const QString& body);
     void resetAlertIcon();
     void autostartChanged();
     void showBetaVersionsChanged();
     void showOlderVersionsChanged();
+    void maxConcurrentDownloadsChanged();
+    void bandwidthLimitChanged();
+    void prefetchUpdatesChanged();
+    void prefetchQuotaChanged();
+    void shareInstallersChanged();
+    void extractArchivesChanged();
+    void installerCacheSizeChanged();
+    void localRepositoryChanged();
 
 private:
     Q_SLOT void downloadFinished(QUrl dl_url, QString filename);
     Q_SLOT void downloadError(QUrl dl_url);
     Q_SLOT void downloadProgress(QUrl dl_url, qint64 curr, qint64 max);
+    Q_SLOT void downloaderStateChanged(QUrl dl_url);
+    Q_SLOT void patchApplied(QUrl dl_url, QString target_file, QVariantMap digests, QString error);
+    Q_SLOT void chunksAssembled(QUrl dl_url, QString target_file, QString file_name, QList<AuByteRange> missing,
+        qint64 reused, QString error);
+    Q_SLOT void chunksVerified(QUrl dl_url, QString target_file, QVariantMap digests, QString error);
+    Q_SLOT void localCopied(QUrl dl_url, QString target_file, QVariantMap digests, QString error);
+    Q_SLOT void manifestChanged(QByteArray etag);
 
 private:
+    struct DeltaDownload
+    {
+        au_doc::AuDelta delta;
+        QString source_file;
+        QString patch_file;
+        QString filename;
+    };
+
+    struct ChunkDownload
+    {
+        QMap<QByteArray, QString> sources;
+        QString downloads_folder;
+        QString target_file;
+        QString filename;
+        bool fetching;
+    };
+
     void update();
+    void schedulePrewarm();
     std::string getBundleName(const std::string& sw_display_name) const;
     void addToSwList(const SwEntry& sw_entry, const AuVersionNumber& latest_version);
     QVariantList toVariantList(const std::vector<SwComponent>& sw_list);
@@ -120,11 +210,41 @@ private:
     QList<AuVersionNumber> getSortedVersionNumbers(const std::string& app_name) const;
     void updateBundleMap();
     bool hasUpdate(const std::string& app_name, const std::string& upd_ver) const;
-    bool doDownload(QUrl download_url, const QString nice_name);
-    void updateJson(const QByteArray& json);
+    bool doDownload(QUrl download_url, const QString nice_name, AuDownloadScheduler::Priority priority);
+    bool extractFromStore(QUrl download_url);
+    void releaseDownload(AuDownloader* au_dl);
+    AuDownloadStatus* downloadStatus(QUrl download_url);
+    const au_doc::AuAppVersion* findAppVersion(QUrl download_url) const;
+    bool findDelta(QUrl download_url, DeltaDownload& delta_download) const;
+    void deltaFinished(AuDownloader* au_dl, QString filename);
+    void deltaFailed(QUrl dl_url, const QString& error);
+    void peerFailed(QUrl dl_url, QUrl peer_url, const QString& error);
+    bool findChunkSources(QUrl download_url, ChunkDownload& chunk_download) const;
+    void chunkIndexFinished(AuDownloader* au_dl);
+    void chunksFetched(QUrl dl_url);
+    void chunkFailed(QUrl dl_url, const QString& error);
+    void stopChunkDownload(QUrl dl_url);
+    QString findLocalFile(QUrl download_url) const;
+    bool copyFromRepository(QUrl download_url);
+    bool loadLocalManifest();
+    void installerAssembled(QUrl dl_url, const QString& target_file, const QString& filename, const QByteArray& sha1);
+    void installerVerified(QUrl dl_url, const QString& file_name, const QByteArray& sha1);
+    QString publishExtracted(AuDownloader* au_dl, const QString& file_name);
+    void prefetchUpdates();
+    void prefetchVerified(QUrl dl_url, const QString& file_name, const QByteArray& sha1, bool requested);
+    void stopPrefetch(QUrl dl_url);
+    QString getPrefetchFolder() const;
+    void scheduleCompaction();
+    void compactStore();
+    QSet<QByteArray> getPinnedInstallers() const;
+    bool updateJson(const QByteArray& json);
+    void checkChangedManifest();
+    void updateInstalledSoftware();
+    QList<AuUpdatePipeline::Package> getUpdatePackages() const;
+    void updatePipelineFinished(int done, int manual, int failed);
 
-    bool compareHashMd5(QUrl download_url, const QByteArray& checksum) const;
-    bool compareHashSha1(QUrl download_url, const QByteArray& checksum) const;
+    QList<AuDigest::Algorithm> getDigestAlgorithms(QUrl download_url) const;
+    bool verifyDigests(QUrl download_url, const QVariantMap& digests, QString& failed_digest) const;
 
     QVariantList optionFilter(const QVariantList& apps);
 
@@ -137,20 +257,74 @@ private:
     bool getShowOlderVersion() const;
     void setShowOlderVersion(bool older_version);
 
+    int getMaxConcurrentDownloads() const;
+    void setMaxConcurrentDownloads(int max_downloads);
+
+    int getBandwidthLimit() const;
+    void setBandwidthLimit(int kbytes_per_second);
+
+    bool getPrefetchUpdates() const;
+    void setPrefetchUpdates(bool prefetch);
+
+    int getPrefetchQuota() const;
+    void setPrefetchQuota(int mbytes);
+
+    bool getShareInstallers() const;
+    void setShareInstallers(bool share);
+
+    bool getExtractArchives() const;
+    void setExtractArchives(bool extract);
+
+    int getInstallerCacheSize() const;
+    void setInstallerCacheSize(int mbytes);
+
+    QString getLocalRepository() const;
+    void setLocalRepository(const QString& repository_dir);
+
 private:
     QVariantList m_installed_software;
     std::vector<SwComponent> m_installed_software_internal;
     AuSoftwareEnumerator m_sw_enumerator;
     std::map<std::string, std::string> m_bundle_map;
     au_doc::AuDoc m_au_doc;
+    AuManifestCache m_manifest_cache;
+    QByteArray m_changed_etag;
+    AuInstallerStore m_installer_store;
+    AuNetworkSession* m_network_session;
+    AuMirrorList* m_mirrors;
+    AuPeerShare* m_peer_share;
+    AuDownloadScheduler* m_scheduler;
+    AuUpdatePipeline* m_update_pipeline;
+    AuUpdateChannel* m_update_channel;
+    QThread m_patch_thread;
+    AuDeltaPatcher* m_delta_patcher;
+    QMap<QUrl, DeltaDownload> m_delta_downloads;
+    QSet<QUrl> m_delta_failed;
+    AuChunkAssembler* m_chunk_assembler;
+    QMap<QUrl, ChunkDownload> m_chunk_downloads;
+    QSet<QUrl> m_chunk_failed;
+    AuLocalCopier* m_local_copier;
+    QMap<QUrl, QString> m_local_copies;
+    QMap<QUrl, QUrl> m_peer_downloads;
+    QMap<QUrl, qint64> m_prefetch_urls;
+    QSet<QUrl> m_prefetch_requested;
+    QSet<QUrl> m_prefetch_skipped;
     QMap<QUrl, AuDownloader*> m_downloads;
     QString m_message;
-    QMap<QUrl, int> m_progress;
+    QMap<QUrl, AuDownloadStatus*> m_download_status;
     QMap<QUrl, QString> m_filename_map;
     QTimer* m_daily_timer;
+    QTimer* m_prewarm_timer;
     QTimer* m_fast_timer;
+    QTimer* m_compact_timer;
     bool m_autostart;
     bool m_show_beta_versions;
     bool m_show_older_versions;
+    bool m_prefetch_updates;
+    qint64 m_prefetch_quota;
+    bool m_share_installers;
+    bool m_extract_archives;
+    qint64 m_cache_budget;
+    QString m_local_repository;
 };
 
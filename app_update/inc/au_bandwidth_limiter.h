@@ -0,0 +1,68 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+/**
+ * Token bucket shared by all downloads to cap the total transfer rate.
+ *
+ * Downloaders only read as many bytes from their replies as there are tokens
+ * available. Unread data stays in the (bounded) reply buffer, so TCP flow
+ * control slows down the server. refilled() tells waiting downloaders to
+ * continue reading.
+ */
+class AuBandwidthLimiter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AuBandwidthLimiter(QObject* parent = nullptr);
+    ~AuBandwidthLimiter();
+
+    /**
+     * Maximum bytes per second of all downloads, 0 disables the limit
+     */
+    void setRate(qint64 bytes_per_second);
+    qint64 getRate() const;
+
+    /**
+     * Number of bytes which may be read now
+     */
+    qint64 available() const;
+
+    /**
+     * Take bytes from the bucket. Data which has to be read anyway
+     * (e.g. the rest of a finished reply) may overdraw it.
+     */
+    void consume(qint64 bytes);
+
+Q_SIGNALS:
+    void refilled();
+
+private:
+    Q_SLOT void refill();
+
+private:
+    qint64 m_rate;
+    qint64 m_tokens;
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+};
@@ -0,0 +1,88 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "au_chunk_index.h"
+#include "au_digest.h"
+#include "au_range_fetcher.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <QUrl>
+#include <QVariantMap>
+
+/**
+ * Assembles an installer from the chunks of installers already on disk.
+ *
+ * The worker lives in a background thread. assemble() cuts the local
+ * installers with the parameters of the published chunk index, copies every
+ * chunk they share with the new installer to its offset in target_file and
+ * reports the byte ranges still missing. Once those are fetched, verify()
+ * checks every chunk against the index and calculates the installer digests.
+ *
+ * The chunk lists of local installers are cached by their SHA1, an installer
+ * is only cut once.
+ */
+class AuChunkAssembler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AuChunkAssembler(const QString& cache_dir);
+    ~AuChunkAssembler();
+
+    /**
+     * @param sources local installers keyed by their hex encoded SHA1
+     */
+    Q_SLOT void assemble(QUrl dl_url, const QByteArray& index_json, const QMap<QByteArray, QString>& sources,
+        const QString& target_file);
+
+    Q_SLOT void verify(QUrl dl_url, const QString& target_file, const QList<AuDigest::Algorithm>& algorithms);
+
+Q_SIGNALS:
+    /**
+     * @param file_name installer name from the index, may be empty
+     * @param missing ranges of target_file which have to be fetched
+     * @param reused bytes taken from local installers
+     * @param error empty on success
+     */
+    void chunksAssembled(QUrl dl_url, QString target_file, QString file_name, QList<AuByteRange> missing,
+        qint64 reused, QString error);
+
+    /**
+     * @param digests keyed by AuDigest::name()
+     */
+    void chunksVerified(QUrl dl_url, QString target_file, QVariantMap digests, QString error);
+
+private:
+    struct Location
+    {
+        int source;
+        qint64 offset;
+    };
+
+    bool loadSource(const QByteArray& sha1, const QString& file_name, const AuChunkIndex& index, AuChunkIndex& source_index);
+    QString getCacheFileName(const QByteArray& sha1) const;
+
+private:
+    QString m_cache_dir;
+    QMap<QUrl, AuChunkIndex> m_indexes;
+};
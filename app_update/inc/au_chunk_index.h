@@ -0,0 +1,92 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+/**
+ * Content defined chunks of an installer.
+ *
+ * The installer is cut with FastCDC (gear rolling hash, normalized chunking),
+ * so an insertion only changes the chunks around it and consecutive releases
+ * share most of their chunks. Every chunk is identified by its SHA256.
+ *
+ * Index format, published next to the installer and referenced by
+ * "chunk_index" in update.json (examples/make_chunk_index.py creates it):
+ *
+ *   { "version": 1, "chunker": "fastcdc", "hash": "sha256",
+ *     "min_size": 16384, "avg_size": 65536, "max_size": 262144,
+ *     "name": "<installer file name>", "size": <installer size>,
+ *     "chunks": [ [ "<sha256 hex>", <size> ], ... ] }
+ *
+ * Chunk offsets follow from the sizes, "name" is optional.
+ */
+class AuChunkIndex
+{
+public:
+    struct Chunk
+    {
+        QByteArray hash;
+        qint64 offset;
+        qint64 size;
+    };
+
+    AuChunkIndex();
+    ~AuChunkIndex() = default;
+
+    bool parse(const QByteArray& json);
+    QByteArray toJson() const;
+
+    /**
+     * Cut file_name with the chunking parameters of this index
+     */
+    bool build(const QString& file_name);
+
+    /**
+     * Both indexes cut with the same parameters, so equal content yields
+     * equal chunks
+     */
+    bool isCompatible(const AuChunkIndex& other) const;
+
+    const QList<Chunk>& getChunks() const;
+    QString getName() const;
+    qint64 getSize() const;
+    QString getError() const;
+
+    /**
+     * Chunk identity, the raw SHA256
+     */
+    static QByteArray hash(const char* data, qint64 length);
+
+private:
+    qint64 cut(const uchar* data, qint64 length) const;
+    bool fail(const QString& error);
+
+private:
+    qint64 m_min_size;
+    qint64 m_avg_size;
+    qint64 m_max_size;
+    quint64 m_mask_small;
+    quint64 m_mask_large;
+    QString m_name;
+    qint64 m_size;
+    QList<Chunk> m_chunks;
+    QString m_error;
+};
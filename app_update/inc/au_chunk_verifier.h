@@ -0,0 +1,112 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <vector>
+
+/**
+ * Verifies a streamed download chunk by chunk against a hash tree.
+ *
+ * The installer is split into chunks of a fixed size. The leaves of the tree
+ * are the SHA256 of every chunk (prefixed with 0x00), inner nodes hash their
+ * two children (prefixed with 0x01), an odd node is promoted unchanged.
+ * update.json carries the root, the leaves are fetched separately and have
+ * to reproduce it (examples/make_chunk_hashes.py creates both).
+ *
+ * As soon as all bytes of a chunk are on disk, it is verified on a thread
+ * pool. A corrupt chunk is reported with chunkCorrupt() and counts as not
+ * received again, the downloader fetches just that range once more.
+ */
+class AuChunkVerifier : public QObject
+{
+    Q_OBJECT
+
+public:
+    AuChunkVerifier(const QString& file_name, qint64 chunk_size, QObject* parent = nullptr);
+    ~AuChunkVerifier();
+
+    /**
+     * @param leaves concatenated raw SHA256 leaf hashes
+     * @param root raw root hash from the manifest
+     * @return false if the leaves do not reproduce the root
+     */
+    bool setHashes(const QByteArray& leaves, const QByteArray& root);
+
+    /**
+     * File size, once it is known
+     * @return false if it does not match the number of leaves
+     */
+    bool setSize(qint64 size);
+
+    /**
+     * Everything counts as missing again, running verifications are ignored
+     */
+    void reset();
+
+    /**
+     * Bytes [offset, offset + length) were written and flushed. Completed
+     * chunks are verified in the background.
+     */
+    void addReceived(qint64 offset, qint64 length);
+
+    /**
+     * Leading bytes of the file which are verified
+     */
+    qint64 getVerifiedBytes() const;
+
+    bool isComplete() const;
+
+Q_SIGNALS:
+    void chunksVerified();
+    void chunkCorrupt(qint64 offset, qint64 length);
+
+private:
+    enum class Status
+    {
+        MISSING,
+        VERIFYING,
+        VERIFIED
+    };
+
+    struct Chunk
+    {
+        QByteArray hash;
+        qint64 received;
+        Status status;
+    };
+
+    qint64 chunkLength(int index) const;
+    void verify(int index);
+    void chunkChecked(int generation, int index, bool valid);
+
+    static QByteArray rootHash(QList<QByteArray> nodes);
+
+private:
+    QString m_file_name;
+    qint64 m_chunk_size;
+    qint64 m_size;
+    std::vector<Chunk> m_chunks;
+    int m_verified_chunks;
+    int m_generation;
+    QThreadPool m_pool;
+};
@@ -0,0 +1,61 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <memory>
+
+/**
+ * Streaming decoder for HTTP Content-Encoding.
+ *
+ * gzip and deflate are available if AppUpdate is built with zlib, zstd if
+ * it is built with libzstd (AU_HAVE_ZLIB, AU_HAVE_ZSTD). Without a decoder
+ * library only the identity encoding is accepted.
+ */
+class AuContentDecoder
+{
+public:
+    AuContentDecoder();
+    ~AuContentDecoder();
+
+    /**
+     * Value for the Accept-Encoding request header, empty if nothing but
+     * identity is supported
+     */
+    static QByteArray acceptedEncodings();
+
+    /**
+     * Prepare decoding for the Content-Encoding of a response
+     * @return false if the encoding is not supported
+     */
+    bool init(const QByteArray& content_encoding);
+
+    /**
+     * Decode the next chunk of the body and append the result to output
+     */
+    bool decode(const QByteArray& input, QByteArray& output);
+
+    /**
+     * @return true if the encoded stream was complete
+     */
+    bool finish();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
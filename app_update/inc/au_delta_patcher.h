@@ -0,0 +1,58 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "au_digest.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QUrl>
+#include <QVariantMap>
+
+/**
+ * Rebuilds an installer from an older installer and a binary patch.
+ *
+ * Supported format: "zstd", a patch created with
+ *   zstd --patch-from=<old installer> <new installer> -o <patch>
+ * (requires AU_HAVE_ZSTD). bsdiff patches are not supported.
+ *
+ * The worker lives in a background thread. The result is hashed while it is
+ * written, patchApplied() delivers the digests for verification.
+ */
+class AuDeltaPatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    AuDeltaPatcher();
+    ~AuDeltaPatcher();
+
+    static bool isSupported(const QString& format);
+
+    Q_SLOT void apply(QUrl dl_url, const QString& format, const QString& source_file,
+        const QString& patch_file, const QString& target_file, const QList<AuDigest::Algorithm>& algorithms);
+
+Q_SIGNALS:
+    /**
+     * @param digests keyed by AuDigest::name()
+     * @param error empty on success
+     */
+    void patchApplied(QUrl dl_url, QString target_file, QVariantMap digests, QString error);
+};
@@ -0,0 +1,73 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <memory>
+
+/**
+ * Incremental message digest.
+ *
+ * With AU_HAVE_OPENSSL MD5, SHA1 and SHA256 use the OpenSSL implementations,
+ * which pick SHA-NI / AVX2 code paths at runtime. Without it Qt's portable
+ * QCryptographicHash is used. BLAKE3 requires AU_HAVE_BLAKE3, the reference
+ * library selects SSE4.1/AVX2/AVX-512 itself. If it was built with oneTBB
+ * (AU_HAVE_BLAKE3_TBB) large blocks are hashed in tree mode on all cores.
+ *
+ * The algorithm names match the digest fields of update.json.
+ */
+class AuDigest
+{
+public:
+    enum class Algorithm
+    {
+        MD5,
+        SHA1,
+        SHA256,
+        BLAKE3
+    };
+
+    explicit AuDigest(Algorithm algorithm);
+    ~AuDigest();
+
+    AuDigest(const AuDigest&) = delete;
+    AuDigest& operator=(const AuDigest&) = delete;
+
+    static bool isSupported(Algorithm algorithm);
+    static QList<Algorithm> supportedAlgorithms();
+    static QString name(Algorithm algorithm);
+
+    Algorithm getAlgorithm() const;
+
+    void addData(const char* data, qint64 length);
+    void addData(const QByteArray& data);
+    void reset();
+
+    /**
+     * @return the raw digest, the object has to be reset before reuse
+     */
+    QByteArray result();
+
+private:
+    struct Context;
+
+    Algorithm m_algorithm;
+    std::unique_ptr<Context> m_context;
+};
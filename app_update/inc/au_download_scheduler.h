@@ -0,0 +1,129 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "au_bandwidth_limiter.h"
+
+#include <QMap>
+#include <QObject>
+#include <QUrl>
+
+class AuDownloader;
+
+/**
+ * Decides when queued downloads are started.
+ *
+ * At most getMaxConcurrent() downloads transfer data at the same time, the
+ * others wait in the queue ordered by priority and arrival. The manifest is
+ * small and the UI waits for it, it is always started right away. A user
+ * download takes the slot of a running background download, the background
+ * download continues later from its .part file.
+ *
+ * All scheduled downloads share one AuBandwidthLimiter.
+ *
+ * The scheduler does not own the downloaders. A downloader leaves the
+ * scheduler when it finishes, fails, is cancelled or destroyed.
+ */
+class AuDownloadScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Priority
+    {
+        MANIFEST,
+        USER,
+        BACKGROUND
+    };
+
+    enum class State
+    {
+        NONE,
+        QUEUED,
+        RUNNING,
+        PAUSED
+    };
+
+    explicit AuDownloadScheduler(QObject* parent = nullptr);
+    ~AuDownloadScheduler();
+
+    void setMaxConcurrent(int max_concurrent);
+    int getMaxConcurrent() const;
+
+    /**
+     * Total transfer rate of all downloads in bytes per second, 0 = unlimited
+     */
+    void setBandwidthLimit(qint64 bytes_per_second);
+    qint64 getBandwidthLimit() const;
+
+    /**
+     * Queue a downloader, its signals have to be connected already.
+     * It is started as soon as a slot is free.
+     */
+    void enqueue(AuDownloader* downloader, Priority priority);
+
+    /**
+     * Stop a queued or running download, the partial data is kept
+     */
+    bool pause(const QUrl& dl_url);
+
+    /**
+     * Queue a paused download again
+     */
+    bool resume(const QUrl& dl_url);
+
+    /**
+     * Change the priority of a queued or running download, e.g. a
+     * background download the user asked for
+     */
+    bool setPriority(const QUrl& dl_url, Priority priority);
+
+    /**
+     * Stop the download and remove its partial data.
+     * The downloader is handed back to the caller, who deletes it.
+     */
+    AuDownloader* cancel(const QUrl& dl_url);
+
+    State getState(const QUrl& dl_url) const;
+    static QString stateName(State state);
+
+Q_SIGNALS:
+    void stateChanged(QUrl dl_url);
+
+private:
+    struct Job
+    {
+        AuDownloader* downloader;
+        Priority priority;
+        State state;
+        quint64 sequence;
+    };
+
+    void schedule();
+    void startJob(Job& job);
+    void remove(AuDownloader* downloader);
+    int runningCount() const;
+    Job* nextQueued();
+    Job* preemptionCandidate();
+
+private:
+    AuBandwidthLimiter m_limiter;
+    QMap<QUrl, Job> m_jobs;
+    int m_max_concurrent;
+    quint64 m_sequence;
+};
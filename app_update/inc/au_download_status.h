@@ -0,0 +1,141 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+/**
+ * Download state of a single url, bound by its QML delegate.
+ *
+ * Network progress arrives with every packet. It is coalesced and published
+ * at most every PUBLISH_INTERVAL_MS together with the transfer rate and the
+ * estimated remaining time, so only the affected delegate updates at a low
+ * rate.
+ */
+class AuDownloadStatus : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(int progress
+                READ getProgress
+                NOTIFY progressChanged)
+
+    Q_PROPERTY(qint64 bytesReceived
+                READ getBytesReceived
+                NOTIFY progressChanged)
+
+    Q_PROPERTY(qint64 bytesTotal
+                READ getBytesTotal
+                NOTIFY progressChanged)
+
+    Q_PROPERTY(qint64 bytesPerSecond
+                READ getBytesPerSecond
+                NOTIFY progressChanged)
+
+    Q_PROPERTY(int eta
+                READ getEta
+                NOTIFY progressChanged)
+
+    Q_PROPERTY(QString state
+                READ getState
+                NOTIFY stateChanged)
+
+    Q_PROPERTY(QString stage
+                READ getStage
+                NOTIFY stageChanged)
+
+    Q_PROPERTY(bool finished
+                READ isFinished
+                NOTIFY finishedChanged)
+
+    Q_PROPERTY(bool ready
+                READ isReady
+                NOTIFY readyChanged)
+
+public:
+    explicit AuDownloadStatus(QObject* parent = nullptr);
+    ~AuDownloadStatus();
+
+    /**
+     * Record the network progress, published with the next interval
+     */
+    void setProgress(qint64 curr, qint64 max);
+
+    /**
+     * Scheduler state: "queued", "running", "paused", "retrying" or empty
+     */
+    void setState(const QString& state);
+
+    /**
+     * Update All stage, see AuUpdatePipeline::stageName
+     */
+    void setStage(const QString& stage);
+
+    void setFinished(bool finished);
+
+    /**
+     * The verified installer is in the store, a download completes instantly
+     */
+    void setReady(bool ready);
+
+    int getProgress() const;
+    qint64 getBytesReceived() const;
+    qint64 getBytesTotal() const;
+    qint64 getBytesPerSecond() const;
+
+    /**
+     * Estimated seconds until the download is complete, -1 if unknown
+     */
+    int getEta() const;
+
+    QString getState() const;
+    QString getStage() const;
+    bool isFinished() const;
+    bool isReady() const;
+
+Q_SIGNALS:
+    void progressChanged();
+    void stateChanged();
+    void stageChanged();
+    void finishedChanged();
+    void readyChanged();
+
+private:
+    Q_SLOT void publish();
+
+private:
+    void resetRate();
+
+private:
+    qint64 m_curr;
+    qint64 m_max;
+    qint64 m_published_curr;
+    qint64 m_published_max;
+    qint64 m_rate_bytes;
+    qint64 m_bytes_per_second;
+    QElapsedTimer m_rate_clock;
+    QTimer m_publish_timer;
+    bool m_dirty;
+    QString m_state;
+    QString m_stage;
+    bool m_finished;
+    bool m_ready;
+};
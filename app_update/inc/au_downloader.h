@@ -17,39 +17,331 @@
 
 #pragma once
 
+#include "au_content_decoder.h"
+#include "au_digest.h"
+#include "au_range_fetcher.h"
+
 #include <QObject>
 #include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QList>
-#include <QNetworkAccessManager>
+#include <QMap>
 #include <QNetworkReply>
+#include <QThread>
+#include <QTimer>
 #include <QUrl>
+#include <QVariantMap>
+#include <memory>
+#include <vector>
+
+class AuBandwidthLimiter;
+class AuChunkVerifier;
+class AuHashWorker;
+class AuMirrorList;
+class AuNetworkSession;
+class AuZipExtractor;
 
+/**
+ * Downloads a single url using the shared network session.
+ *
+ * Without a destination directory the content is kept in memory (getDownload()).
+ * In-memory downloads negotiate a compressed transfer (gzip, deflate, zstd)
+ * and are decoded while the data arrives.
+ * With a destination directory the content is streamed chunk by chunk into a
+ * .part file inside that directory. The final file only appears after commit().
+ * Streamed chunks are hashed while they arrive, every digest on a background
+ * thread of its own, so the digests are available as soon as downloadFinished
+ * is emitted. With setExtractDir() a zip archive is unpacked from the same
+ * stream on another thread.
+ *
+ * With setChunkHashes() every chunk is verified against a hash tree as soon
+ * as it is on disk (AuChunkVerifier). A corrupt chunk is fetched again with
+ * a Range request, the digests only see verified data.
+ *
+ * Interrupted streamed downloads keep their .part file together with a small
+ * journal (url, validator, bytes received). The next downloader for the same
+ * url continues with a Range request, or starts over if the validator changed.
+ *
+ * With setSegmentCount() > 1 a large file is split into byte ranges which are
+ * fetched concurrently and written at their offset into the preallocated
+ * .part file. Servers without range support fall back to a single stream.
+ *
+ * With setFetchRanges() only the given byte ranges are fetched into an
+ * existing file (AuRangeFetcher), e.g. the chunks missing in an installer
+ * assembled from older ones. Scheduling, throttling and retries stay the same.
+ *
+ * An optional AuBandwidthLimiter throttles reading from the replies.
+ *
+ * With an AuMirrorList the data is fetched from the best mirror. If that
+ * mirror fails or stalls, the download continues on the next one with a
+ * Range request.
+ *
+ * Connecting, waiting for the first byte and receiving are guarded by
+ * timeouts. Transient failures are retried after a jittered exponential
+ * backoff, streamed downloads continue with the data already on disk.
+ */
 class AuDownloader: public QObject
 {
     Q_OBJECT
 
 public:
-    AuDownloader(QUrl dl_url, QObject* parent = nullptr);
+    enum class State
+    {
+        IDLE,
+        CONNECTING,
+        WAITING_FOR_DATA,
+        RECEIVING,
+        RETRY_PENDING,
+        FINISHED,
+        FAILED
+    };
+
+    AuDownloader(QUrl dl_url, AuNetworkSession* session, QObject* parent = nullptr);
+    AuDownloader(QUrl dl_url, const QString& dest_dir, AuNetworkSession* session, QObject* parent = nullptr);
     ~AuDownloader();
 
+    /**
+     * Start the download, connect to the signals first
+     */
+    void start();
+
+    /**
+     * Stop the transfer without emitting a signal. A streamed download keeps
+     * its .part file and journal, start() continues it with a Range request.
+     */
+    void abort();
+
+    /**
+     * Number of concurrent range requests for streamed downloads (default 1)
+     */
+    void setSegmentCount(int segments);
+
+    /**
+     * Additional request header, e.g. If-None-Match for conditional requests
+     */
+    void setRequestHeader(const QByteArray& name, const QByteArray& value);
+
+    /**
+     * Fetch a different url on behalf of dl_url, e.g. a delta patch.
+     * Signals and getUrl() keep reporting dl_url.
+     */
+    void setTransferUrl(const QUrl& transfer_url);
+
+    /**
+     * Share the transfer rate of all downloads, nullptr for unlimited
+     */
+    void setBandwidthLimiter(AuBandwidthLimiter* limiter);
+
+    /**
+     * Digests calculated for streamed downloads (default MD5 and SHA1),
+     * unsupported algorithms are skipped. Call before start().
+     */
+    void setDigests(const QList<AuDigest::Algorithm>& algorithms);
+
+    /**
+     * Fetch from the best mirror and fail over to others, nullptr for none
+     */
+    void setMirrorList(AuMirrorList* mirrors);
+
+    /**
+     * Retries of transient failures before downloadError (default 5)
+     */
+    void setMaxRetries(int retries);
+
+    /**
+     * Unpack a zip archive into staging_dir while it is downloaded.
+     * Call before start(), downloadFinished waits for the extraction.
+     */
+    void setExtractDir(const QString& staging_dir);
+    QString getExtractDir() const;
+
+    /**
+     * The staging directory holds the complete, CRC checked archive content
+     */
+    bool isExtracted() const;
+
+    /**
+     * Reason for a failed extraction, empty if the download is no zip archive
+     */
+    QString getExtractError() const;
+
+    /**
+     * Verify chunks of chunk_size bytes while they arrive. The leaf hashes
+     * are fetched from hashes_url first and have to reproduce root. Without
+     * usable hashes only the whole file is verified. Call before start().
+     */
+    void setChunkHashes(const QUrl& hashes_url, qint64 chunk_size, const QByteArray& root);
+
+    /**
+     * Only fetch ranges of dl_url into the existing file_name, each at its
+     * offset. downloadFinished reports no file name. Call before start().
+     */
+    void setFetchRanges(const QString& file_name, const QList<AuByteRange>& ranges);
+
     const QByteArray& getDownload() const;
     QUrl getUrl() const;
     QString getError() const;
+    State getState() const;
+
+    bool isStreaming() const;
+    QString getPartFileName() const;
+
+    /**
+     * The server answered a conditional request with "304 Not Modified"
+     */
+    bool isNotModified() const;
+    QByteArray getETag() const;
+    QByteArray getLastModified() const;
+
+    /**
+     * Bytes transferred over the network and their decoded size
+     */
+    qint64 getTransferSize() const;
+    qint64 getDecodedSize() const;
+
+    QByteArray getDigest(AuDigest::Algorithm algorithm) const;
+    QByteArray getSha1() const;
+
+    /**
+     * All digests keyed by AuDigest::name()
+     */
+    QVariantMap getDigests() const;
+
+    /**
+     * Atomically move the finished .part file to dest_dir/filename.
+     * @return the final file path or an empty string on failure
+     */
+    QString commit(const QString& filename);
+
+    /**
+     * Remove the .part file and its journal, e.g. after a checksum failure
+     */
+    void discard();
 
 Q_SIGNALS:
     void downloadFinished(QUrl, QString filename);
     void downloadError(QUrl);
     void downloadProgress(QUrl, qint64 curr, qint64 max);
+    void stateChanged(QUrl);
+
+    void hashFile(const QString& file_name, qint64 offset, qint64 length);
+    void hashData(const QByteArray& chunk);
+    void hashReset();
+    void hashFinish();
 
 private:
     Q_SLOT void fileDownloaded(QNetworkReply* reply);
+    Q_SLOT void responseHeaders();
+    Q_SLOT void dataAvailable();
+    Q_SLOT void readPending();
     Q_SLOT void dlProgress(qint64 ist, qint64 max);
     Q_SLOT void sslErrors(const QList<QSslError>& ssl_errors);
+    Q_SLOT void checkTimeout();
+
+private:
+    struct Segment
+    {
+        qint64 begin;
+        qint64 end;
+        qint64 received;
+        QNetworkReply* reply;
+    };
+
+    void startTransfer();
+    void startRangeFetch();
+    void startHashWorkers();
+    void hashReady(AuDigest::Algorithm algorithm, const QByteArray& digest);
+    void extractFinished(bool extracted, const QString& error);
+    void checkFinished();
+    void fetchChunkHashes();
+    void chunkHashesFetched();
+    void chunksVerified();
+    void repairChunk(qint64 offset, qint64 length);
+    void dropChunkVerifier();
+    void receivedChunk(qint64 offset, qint64 length);
+    void transferComplete();
+    void watchReply(QNetworkReply* reply);
+    void requestStarted();
+    void setState(State state);
+    void limitReadBuffer(QNetworkReply* reply);
+    void startSingle();
+    void startSegmented(qint64 size, const QByteArray& etag, const QByteArray& last_modified);
+    void probeFinished(QNetworkReply* reply);
+    void segmentFinished(QNetworkReply* reply);
+    void requestSegment(Segment& segment);
+    void abortSegments();
+    bool hasActiveReplies() const;
+    bool failover();
+    bool retry(int http_status);
+    void fail(int http_status);
+    Segment* findSegment(QNetworkReply* reply);
+    qint64 contiguousBytes() const;
+    void hashContiguous();
+    bool openPartFile();
+    void restartFromScratch();
+    qint64 readSize(bool throttled) const;
+    bool writeChunks(QNetworkReply* reply, bool throttled);
+    bool decodeChunks(QNetworkReply* reply, bool throttled);
+    QString getJournalFileName() const;
+    bool readJournal();
+    void writeJournal();
 
 private:
     QUrl m_dl_url;
-    QNetworkAccessManager m_net_access;
+    QUrl m_transfer_url;
+    QUrl m_request_url;
+    QString m_dest_dir;
+    AuNetworkSession* m_session;
+    AuBandwidthLimiter* m_limiter;
+    AuMirrorList* m_mirrors;
+    bool m_mirror_switched;
+    State m_state;
+    QTimer m_watchdog_timer;
+    QElapsedTimer m_activity_clock;
+    QTimer m_retry_timer;
+    int m_retry_count;
+    int m_max_retries;
+    qint64 m_retry_bytes;
+    QNetworkReply* m_reply;
+    QNetworkReply* m_probe_reply;
+    QList<QPair<QByteArray, QByteArray>> m_request_headers;
+    bool m_not_modified;
+    AuContentDecoder m_decoder;
+    qint64 m_transfer_size;
     QByteArray m_downloaded_data;
+    QFile m_part_file;
+    int m_segment_count;
+    std::vector<Segment> m_segments;
+    qint64 m_total_size;
+    qint64 m_hashed;
+    qint64 m_offset;
+    qint64 m_bytes_received;
+    qint64 m_journal_bytes;
+    QByteArray m_etag;
+    QByteArray m_last_modified;
+    QString m_filename;
+    QString m_file_error;
+    QString m_timeout_error;
+    QList<AuDigest::Algorithm> m_algorithms;
+    std::vector<std::unique_ptr<QThread>> m_hash_threads;
+    QMap<AuDigest::Algorithm, QByteArray> m_digests;
+    QString m_extract_dir;
+    std::unique_ptr<QThread> m_extract_thread;
+    bool m_extract_finished;
+    bool m_extracted;
+    QString m_extract_error;
+    QUrl m_chunk_hashes_url;
+    qint64 m_chunk_size;
+    QByteArray m_chunk_root;
+    QNetworkReply* m_hashes_reply;
+    std::unique_ptr<AuChunkVerifier> m_chunk_verifier;
+    QList<AuRangeFetcher*> m_repairs;
+    int m_repair_count;
+    QString m_ranges_file;
+    QList<AuByteRange> m_fetch_ranges;
+    AuRangeFetcher* m_range_fetcher;
+    bool m_transfer_complete;
     QNetworkReply::NetworkError m_error;
     QList<QSslError> m_ssl_errors;
 };
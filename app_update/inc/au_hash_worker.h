@@ -0,0 +1,52 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "au_digest.h"
+
+#include <QByteArray>
+#include <QObject>
+
+/**
+ * Calculates one digest of a download incrementally.
+ *
+ * The worker lives in a background thread, every algorithm gets a worker of
+ * its own so the digests are calculated in parallel. Chunks are queued with
+ * addData() while they arrive, finish() publishes the digest via hashReady().
+ * addFile() hashes data that is already on disk, e.g. the existing part of a
+ * resumed download or ranges written by a segmented download.
+ */
+class AuHashWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AuHashWorker(AuDigest::Algorithm algorithm);
+    ~AuHashWorker();
+
+    Q_SLOT void addFile(const QString& file_name, qint64 offset, qint64 length);
+    Q_SLOT void addData(const QByteArray& chunk);
+    Q_SLOT void finish();
+    Q_SLOT void reset();
+
+Q_SIGNALS:
+    void hashReady(QByteArray digest);
+
+private:
+    AuDigest m_digest;
+};
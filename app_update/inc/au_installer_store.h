@@ -0,0 +1,132 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QUrl>
+
+/**
+ * Content addressed store of verified installers, keyed by their SHA1.
+ *
+ * Every verified installer is linked (or copied) into the store under its
+ * hash. An installer the manifest lists with a known hash is produced from
+ * the store without a download, no matter which url or version refers to
+ * it. Delta updates use the stored installers as patch source.
+ *
+ * A stored file is only returned while it has the recorded size and
+ * modification time.
+ *
+ * The store is kept within a size budget by compact(): the least recently
+ * used installers are evicted first, pinned ones (e.g. the installed
+ * versions, needed for a rollback or as delta source) are never evicted.
+ * The copy the download placed next to it goes with an evicted installer
+ * as long as it is unchanged.
+ */
+class AuInstallerStore
+{
+public:
+    explicit AuInstallerStore(const QString& store_dir);
+    ~AuInstallerStore() = default;
+
+    bool load();
+
+    /**
+     * Record a verified installer
+     * @param sha1 hex encoded SHA1 of the file
+     */
+    bool add(const QByteArray& sha1, const QString& file_name, const QUrl& url);
+
+    /**
+     * @param sha1 hex encoded SHA1
+     * @return the stored installer or an empty string if it is not available
+     */
+    QString find(const QByteArray& sha1) const;
+
+    /**
+     * Mark an installer as used, it is evicted last
+     */
+    void touch(const QByteArray& sha1);
+
+    /**
+     * Hex encoded SHA1 of the installers compact() keeps in any case
+     */
+    void setPinned(const QSet<QByteArray>& hashes);
+
+    /**
+     * Name of the installer when it was stored
+     */
+    QString getFileName(const QByteArray& sha1) const;
+
+    /**
+     * Hex encoded SHA1 of all installers find() returns
+     */
+    QList<QByteArray> getHashes() const;
+
+    /**
+     * Size of all stored installers in bytes
+     */
+    qint64 getTotalSize() const;
+
+    /**
+     * Create dest_file_name from the stored installer. A hardlink is tried
+     * first, then AuLocalCopier::copyFile().
+     */
+    bool extract(const QByteArray& sha1, const QString& dest_file_name) const;
+
+    /**
+     * Forget least recently used installers until the store fits into
+     * budget bytes, as well as entries whose file is gone or modified.
+     * The index is updated right away, the files are left to the caller.
+     * @return files to remove: evicted objects, their unchanged download
+     *         copies and leftovers of interrupted copies
+     */
+    QStringList compact(qint64 budget);
+
+    /**
+     * Remove the files compact() returned, may run on any thread
+     */
+    static void removeFiles(const QStringList& file_names);
+
+private:
+    bool save() const;
+    QString getObjectFileName(const QByteArray& sha1) const;
+    QString evictObject(const QByteArray& sha1) const;
+    static bool isHash(const QByteArray& sha1);
+    static bool placeFile(const QString& source_file_name, const QString& dest_file_name);
+
+private:
+    struct Entry
+    {
+        QString file_name;
+        QUrl url;
+        qint64 size;
+        qint64 modified;
+        qint64 used;
+        QString source_path;
+        qint64 source_modified;
+    };
+
+    QString m_store_dir;
+    QMap<QByteArray, Entry> m_entries;
+    QSet<QByteArray> m_pinned;
+};
@@ -0,0 +1,66 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "au_digest.h"
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QUrl>
+#include <QVariantMap>
+#include <functional>
+
+/**
+ * Copies installers from a local repository (USB stick, NFS or SMB share)
+ * into place and verifies them.
+ *
+ * The copy is a copy-on-write clone where the file system supports it
+ * (FICLONE, clonefile), otherwise copy_file_range() lets the kernel move
+ * the data without a round trip through user space. The copy is then hashed
+ * through a memory mapping, copied() delivers the digests for verification.
+ *
+ * The worker lives in a background thread.
+ */
+class AuLocalCopier : public QObject
+{
+    Q_OBJECT
+
+public:
+    AuLocalCopier();
+    ~AuLocalCopier();
+
+    Q_SLOT void copy(QUrl dl_url, const QString& source_file, const QString& target_file,
+        const QList<AuDigest::Algorithm>& algorithms);
+
+    /**
+     * Create dest_file_name as a copy of source_file_name: a clone, a
+     * kernel copy or a plain copy, whichever works first
+     * @param progress called with the bytes copied so far
+     */
+    static bool copyFile(const QString& source_file_name, const QString& dest_file_name,
+        const std::function<void(qint64)>& progress = {});
+
+Q_SIGNALS:
+    void copyProgress(QUrl dl_url, qint64 curr, qint64 max);
+
+    /**
+     * @param digests keyed by AuDigest::name()
+     * @param error empty on success
+     */
+    void copied(QUrl dl_url, QString target_file, QVariantMap digests, QString error);
+};
@@ -0,0 +1,52 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+/**
+ * On disk copy of the last update.json together with its HTTP validators.
+ *
+ * The validators are sent as If-None-Match/If-Modified-Since, a
+ * "304 Not Modified" answer then means the cached manifest is still valid.
+ */
+class AuManifestCache
+{
+public:
+    explicit AuManifestCache(const QString& cache_dir);
+    ~AuManifestCache() = default;
+
+    /**
+     * Read the validators of the cached manifest
+     * @return false if there is no cached manifest
+     */
+    bool load();
+
+    bool store(const QByteArray& data, const QByteArray& etag, const QByteArray& last_modified);
+
+    QByteArray getData() const;
+    QByteArray getETag() const;
+    QByteArray getLastModified() const;
+
+private:
+    QString m_data_file_name;
+    QString m_meta_file_name;
+    QByteArray m_etag;
+    QByteArray m_last_modified;
+};
@@ -0,0 +1,100 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QStringList>
+#include <QUrl>
+#include <vector>
+
+class AuNetworkSession;
+class QNetworkReply;
+
+/**
+ * Ordered list of equivalent download locations.
+ *
+ * Every mirror is a base url, a url below one mirror is available below all
+ * others with the same relative path. The list is configured with the
+ * "mirrors" setting, the origin the manifest refers to is always part of it.
+ *
+ * probe() measures latency and throughput of all mirrors in the background,
+ * map() moves a url to the fastest healthy mirror. Until the first probe
+ * finished the configured order is used.
+ */
+class AuMirrorList : public QObject
+{
+    Q_OBJECT
+
+public:
+    AuMirrorList(const QUrl& origin, AuNetworkSession* session, QObject* parent = nullptr);
+    ~AuMirrorList();
+
+    /**
+     * Read the configured mirrors
+     */
+    void load();
+    QStringList getMirrors() const;
+
+    /**
+     * Fetch the beginning of probe_url from every mirror. Skipped with a
+     * single mirror, repeated once a day or after a reported failure.
+     */
+    void probe(const QUrl& probe_url);
+
+    /**
+     * @return url on the best healthy mirror, or url itself if it is not
+     *         below any mirror
+     */
+    QUrl map(const QUrl& url) const;
+
+    /**
+     * A transfer from the mirror of url failed or stalled. The mirror is
+     * avoided until it succeeds in the next probe.
+     */
+    void reportFailure(const QUrl& url);
+
+Q_SIGNALS:
+    void probeFinished();
+
+private:
+    struct Mirror
+    {
+        QUrl base;
+        bool healthy;
+        qint64 latency;
+        qint64 bytes_per_second;
+        QNetworkReply* probe_reply;
+        QElapsedTimer probe_clock;
+    };
+
+    void setMirrors(const QStringList& mirrors);
+    void probeReply(Mirror& mirror, QNetworkReply* reply);
+    Mirror* findMirror(const QUrl& url);
+    const Mirror* findMirror(const QUrl& url) const;
+    const Mirror* bestMirror() const;
+    static qint64 cost(const Mirror& mirror);
+
+private:
+    QUrl m_origin;
+    AuNetworkSession* m_session;
+    std::vector<Mirror> m_mirrors;
+    QElapsedTimer m_probe_age;
+    bool m_probe_due;
+};
@@ -0,0 +1,76 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "au_tls_session_cache.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QSslConfiguration>
+#include <QUrl>
+#include <memory>
+
+/**
+ * Process wide network session shared by all downloads.
+ *
+ * A single QNetworkAccessManager keeps connections to the update servers
+ * alive between requests, so manifest fetches and installer downloads reuse
+ * TCP and TLS sessions. HTTP/2 is allowed, concurrent requests to the same
+ * host are multiplexed over one connection where the server supports it.
+ *
+ * With a cache directory the TLS sessions are persisted, the first request
+ * after a restart resumes the last session instead of a full handshake.
+ */
+class AuNetworkSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AuNetworkSession(QObject* parent = nullptr);
+    ~AuNetworkSession();
+
+    /**
+     * Create a request with the session defaults applied
+     */
+    QNetworkRequest createRequest(const QUrl& url) const;
+
+    /**
+     * Persist TLS sessions in cache_dir
+     */
+    void setCacheDir(const QString& cache_dir);
+
+    /**
+     * Resolve the host of url and open a connection, including the TLS
+     * handshake, for the next request to it. Unused connections are closed
+     * after about two minutes.
+     */
+    void prewarm(const QUrl& url);
+
+    QNetworkReply* get(const QNetworkRequest& request);
+    QNetworkReply* head(const QNetworkRequest& request);
+
+private:
+    QSslConfiguration getSslConfiguration(const QUrl& url) const;
+    void replyFinished(QNetworkReply* reply);
+
+private:
+    QNetworkAccessManager m_net_access;
+    std::unique_ptr<AuTlsSessionCache> m_tls_sessions;
+};
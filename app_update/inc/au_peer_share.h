@@ -0,0 +1,127 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHostAddress>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QTcpServer>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QUrl>
+#include <map>
+#include <memory>
+
+class AuInstallerStore;
+class QTcpSocket;
+
+/**
+ * Shares verified installers with other AppUpdate instances on the local network.
+ *
+ * Every instance announces the hashes in its installer store by UDP multicast
+ * (broadcast if the group cannot be joined) and serves the stored files over
+ * a small HTTP endpoint with Range support: GET and HEAD /installers/<sha1>.
+ *
+ * findPeer() returns the url of an installer on a peer. Peer downloads are
+ * verified against the manifest digests like any other download, so a peer
+ * is trusted no more than a mirror.
+ *
+ * Peers are forgotten when their announcements stop, a peer which failed a
+ * transfer is avoided for a while.
+ */
+class AuPeerShare : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AuPeerShare(const AuInstallerStore& store, QObject* parent = nullptr);
+    ~AuPeerShare();
+
+    /**
+     * Join the discovery group and start serving. The discovery port is
+     * read from the "peer_port" setting.
+     */
+    bool start();
+    void stop();
+    bool isRunning() const;
+
+    /**
+     * Tell the peers about the current store content, e.g. after an
+     * installer was added
+     */
+    void announce();
+
+    /**
+     * @param sha1 hex encoded SHA1
+     * @return url of the installer on a peer or an empty url
+     */
+    QUrl findPeer(const QByteArray& sha1) const;
+
+    /**
+     * A transfer from the peer of peer_url failed or delivered wrong data
+     */
+    void reportFailure(const QUrl& peer_url);
+
+Q_SIGNALS:
+    void peersChanged();
+
+private:
+    struct Peer
+    {
+        QHostAddress address;
+        quint16 port;
+        QSet<QByteArray> installers;
+        qint64 last_seen;
+        qint64 avoid_until;
+    };
+
+    struct Upload
+    {
+        QByteArray request;
+        std::unique_ptr<QFile> file;
+        qint64 remaining;
+        bool responded;
+    };
+
+    void sendAnnouncement(bool leaving);
+    void readDatagrams();
+    void expirePeers();
+    void acceptConnections();
+    void readRequest(QTcpSocket* socket);
+    void handleRequest(QTcpSocket* socket, Upload& upload);
+    void sendResponse(QTcpSocket* socket, int status, const QByteArray& reason, const QList<QByteArray>& headers);
+    void sendBody(QTcpSocket* socket);
+    void closeUpload(QTcpSocket* socket);
+
+private:
+    const AuInstallerStore& m_store;
+    QByteArray m_id;
+    QUdpSocket m_discovery_socket;
+    QHostAddress m_discovery_address;
+    quint16 m_discovery_port;
+    QTcpServer m_server;
+    QTimer m_announce_timer;
+    QTimer m_answer_timer;
+    QElapsedTimer m_clock;
+    QMap<QByteArray, Peer> m_peers;
+    std::map<QTcpSocket*, Upload> m_uploads;
+};
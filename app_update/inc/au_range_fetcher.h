@@ -0,0 +1,117 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QMap>
+#include <QNetworkReply>
+#include <QObject>
+#include <QPair>
+#include <QTimer>
+#include <QUrl>
+
+class AuBandwidthLimiter;
+class AuMirrorList;
+class AuNetworkSession;
+
+/**
+ * Byte range of a file: offset and length
+ */
+using AuByteRange = QPair<qint64, qint64>;
+
+/**
+ * Fetches byte ranges of a url into a local file, each at its offset.
+ *
+ * Ranges closer than a few KiB are merged, up to 16 ranges go into one
+ * multi-range request. Servers answer those with multipart/byteranges or a
+ * single 206 covering all of them. A server ignoring Range (200) fails the
+ * fetch, the caller falls back to a full download.
+ */
+class AuRangeFetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    AuRangeFetcher(QUrl dl_url, const QString& file_name, AuNetworkSession* session, QObject* parent = nullptr);
+    ~AuRangeFetcher();
+
+    /**
+     * Fetch from the best mirror, nullptr for none
+     */
+    void setMirrorList(AuMirrorList* mirrors);
+
+    /**
+     * Share the transfer rate of all downloads, nullptr for unlimited
+     */
+    void setBandwidthLimiter(AuBandwidthLimiter* limiter);
+
+    /**
+     * The file has to exist, it is not truncated
+     */
+    void start(const QList<AuByteRange>& ranges);
+    void abort();
+
+    QUrl getUrl() const;
+    QString getError() const;
+
+    /**
+     * Bytes requested after merging, including the gaps in between
+     */
+    qint64 getTransferSize() const;
+
+Q_SIGNALS:
+    void fetchFinished(QUrl dl_url);
+    void fetchError(QUrl dl_url);
+    void fetchProgress(QUrl dl_url, qint64 curr, qint64 max);
+
+private:
+    Q_SLOT void replyFinished();
+    Q_SLOT void readPending();
+    Q_SLOT void checkTimeout();
+
+private:
+    using Batch = QList<AuByteRange>;
+
+    void requestNext();
+    void readReply(QNetworkReply* reply, bool throttled);
+    bool writeReply(QNetworkReply* reply, const QByteArray& body, const Batch& batch);
+    bool writeMultipart(const QByteArray& boundary, const QByteArray& body, QList<AuByteRange>& received);
+    bool writeRange(qint64 offset, const char* data, qint64 length);
+    void fail(const QString& error);
+
+    static bool parseContentRange(const QByteArray& content_range, qint64& first, qint64& last);
+
+private:
+    QUrl m_dl_url;
+    QUrl m_request_url;
+    AuNetworkSession* m_session;
+    AuMirrorList* m_mirrors;
+    AuBandwidthLimiter* m_limiter;
+    QFile m_file;
+    QList<Batch> m_pending;
+    QMap<QNetworkReply*, Batch> m_replies;
+    QMap<QNetworkReply*, QByteArray> m_bodies;
+    QTimer m_watchdog_timer;
+    int m_retry_count;
+    bool m_progressed;
+    qint64 m_total;
+    qint64 m_fetched;
+    QString m_error;
+};
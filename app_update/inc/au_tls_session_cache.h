@@ -0,0 +1,64 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+
+/**
+ * TLS sessions of the update servers, kept across checks and restarts.
+ *
+ * A stored session lets the next connection to the same server resume TLS
+ * with an abbreviated handshake. The server falls back to a full handshake
+ * if it does not accept the session any more.
+ *
+ * The file holds session secrets, it is only accessible by the user.
+ */
+class AuTlsSessionCache
+{
+public:
+    explicit AuTlsSessionCache(const QString& cache_dir);
+    ~AuTlsSessionCache() = default;
+
+    bool load();
+
+    /**
+     * @param server "host:port"
+     * @return the serialized session or an empty array if there is none or it expired
+     */
+    QByteArray find(const QString& server) const;
+
+    /**
+     * @param lifetime seconds as hinted by the server, negative if unknown
+     */
+    bool store(const QString& server, const QByteArray& session, int lifetime);
+
+private:
+    bool save() const;
+
+private:
+    struct Entry
+    {
+        QByteArray session;
+        qint64 expires;
+    };
+
+    QString m_file_name;
+    QMap<QString, Entry> m_entries;
+};
@@ -0,0 +1,91 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <QUrl>
+
+class AuNetworkSession;
+class QNetworkReply;
+
+/**
+ * Optional subscription to manifest changes, polling stays as fallback.
+ *
+ * The endpoint is either a Server-Sent Events stream or a long-poll url:
+ * - text/event-stream: every "manifest" (or unnamed) event carries the
+ *   ETag of the current manifest as data. Comment lines keep it alive.
+ * - anything else: the server holds the request until the manifest
+ *   differs from If-None-Match and answers with the new ETag (header or
+ *   body), or with "304 Not Modified" when its own timeout expires. A
+ *   server answering right away is polled with the failure backoff.
+ *
+ * manifestChanged() is emitted when the ETag differs from the last reported
+ * one, after a random delay so the machines of a site do not fetch the
+ * manifest at the same moment. Lost connections are reestablished with a
+ * jittered exponential backoff.
+ */
+class AuUpdateChannel : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AuUpdateChannel(AuNetworkSession* session, QObject* parent = nullptr);
+    ~AuUpdateChannel();
+
+    /**
+     * Subscribe to endpoint, an empty url only stops the subscription
+     */
+    void start(const QUrl& endpoint);
+    void stop();
+
+Q_SIGNALS:
+    void manifestChanged(QByteArray etag);
+
+private:
+    void connectChannel();
+    void responseHeaders();
+    void dataAvailable();
+    void replyFinished();
+    void parseEvents();
+    void dispatchEvent();
+    void reportETag(const QByteArray& etag);
+    void reconnect(int delay);
+    int backoffDelay();
+    void closeReply();
+
+private:
+    AuNetworkSession* m_session;
+    QUrl m_endpoint;
+    QNetworkReply* m_reply;
+    bool m_event_stream;
+    QByteArray m_buffer;
+    QByteArray m_event_name;
+    QByteArray m_event_data;
+    QByteArray m_last_event_id;
+    QByteArray m_etag;
+    QByteArray m_pending_etag;
+    int m_retry_ms;
+    int m_failures;
+    QElapsedTimer m_request_clock;
+    QTimer m_reconnect_timer;
+    QTimer m_idle_timer;
+    QTimer m_notify_timer;
+};
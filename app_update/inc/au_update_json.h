@@ -21,13 +21,42 @@
 #include <string>
 #include <vector>
 
-#include <QUrl>
-#include <QJsonDocument>
-#include <QVariant>
+#include <QByteArray>
+#include <QString>
 
 
 namespace au_doc
 {
+    /**
+     * Patch from an older installer to this version, e.g.
+     * "deltas": [ { "from_version": "5.4.0", "from_sha1": "...",
+     *               "url": "...", "format": "zstd", "sha1": "..." } ]
+     * sha1 is the digest of the patch file itself and optional.
+     */
+    struct AuDelta
+    {
+        std::string from_version;
+        std::string from_sha1;
+        std::string url;
+        std::string format;
+        std::string sha1;
+    };
+
+    /**
+     * Hash tree over fixed size chunks of the installer, e.g.
+     * "chunk_hashes": { "url": "...", "chunk_size": 1048576, "root": "..." }
+     * url points to the concatenated raw leaf hashes, root is hex encoded.
+     */
+    struct AuChunkHashes
+    {
+        std::string url;
+        std::string root;
+        qint64 chunk_size = 0;
+    };
+
+    /**
+     * "chunk_index" is the url of an AuChunkIndex of the installer, optional
+     */
     struct AuAppVersion
     {
         std::string beta;
@@ -38,9 +67,14 @@ namespace au_doc
         std::string url;
         std::string md5;
         std::string sha1;
+        std::string sha256;
+        std::string blake3;
         std::string notify;
+        std::string chunk_index;
+        AuChunkHashes chunk_hashes;
         std::vector<std::string> bundle;
         std::vector<std::string> changes;
+        std::vector<AuDelta> deltas;
     };
 
     struct AuApp
@@ -56,19 +90,26 @@ namespace au_doc
 
 
 
+/**
+ * Parses update.json in a single pass straight into au_doc::AuDoc.
+ * Unknown fields are skipped, so older clients read newer manifests.
+ */
 class AuUpdateJson
 {
 public:
     AuUpdateJson(const QByteArray& byte_array);
     ~AuUpdateJson() = default;
 
+    /**
+     * @return false if the manifest is no valid JSON, the document is empty then
+     */
     bool update();
 
-    QVariantMap getVariantMap() const;
-    au_doc::AuDoc getDocument() const;
+    QString getError() const;
+    const au_doc::AuDoc& getDocument() const;
 
 private:
     QByteArray m_byte_array;
-    QJsonDocument m_update_doc;
-    QVariantMap   m_update_map;
+    au_doc::AuDoc m_doc;
+    QString m_error;
 };
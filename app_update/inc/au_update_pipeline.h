@@ -0,0 +1,103 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QUrl>
+
+/**
+ * Staged "Update All": download -> verify -> install.
+ *
+ * All packages are handed to the download scheduler at once, so package N+1
+ * is downloading while package N is verified and package N-1 is installed.
+ * Verification uses the digests calculated while downloading. Installations
+ * run one at a time in package order, the package manager holds a global lock.
+ *
+ * The pipeline does not download itself. It requests downloads via
+ * downloadRequested() and is told about their outcome by the owner.
+ */
+class AuUpdatePipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Stage
+    {
+        PENDING,
+        DOWNLOADING,
+        VERIFYING,
+        WAITING,
+        INSTALLING,
+        DOWNLOADED,     // no installer for this platform, the user installs it
+        DONE,
+        FAILED
+    };
+
+    struct Package
+    {
+        QUrl url;
+        QString name;
+        QString version;
+        Stage stage;
+        QString file_name;
+        QString error;
+    };
+
+    explicit AuUpdatePipeline(QObject* parent = nullptr);
+    ~AuUpdatePipeline();
+
+    /**
+     * Start updating the given packages (url, name and version are used)
+     * @return false if a run is still in progress
+     */
+    bool start(const QList<Package>& packages);
+    bool isRunning() const;
+
+    const Package* getPackage(const QUrl& url) const;
+    static QString stageName(Stage stage);
+
+    // outcome of the requested downloads
+    void downloadProgress(const QUrl& url, qint64 curr, qint64 max);
+    void downloadVerified(const QUrl& url, const QString& file_name);
+    void downloadFailed(const QUrl& url, const QString& error);
+
+Q_SIGNALS:
+    void downloadRequested(QUrl url, QString name);
+    void packageChanged(QUrl url);
+    void finished(int done, int manual, int failed);
+
+private:
+    Q_SLOT void installFinished(int exit_code, QProcess::ExitStatus exit_status);
+    Q_SLOT void installError(QProcess::ProcessError error);
+
+private:
+    Package* findPackage(const QUrl& url);
+    static bool isFinal(Stage stage);
+    void setStage(Package& package, Stage stage, const QString& error = {});
+    void installNext();
+    bool installCommand(const QString& file_name, QString& program, QStringList& arguments) const;
+    void checkFinished();
+
+private:
+    QList<Package> m_packages;
+    QProcess* m_installer;
+    int m_installing;
+};
@@ -0,0 +1,120 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QObject>
+#include <QString>
+#include <memory>
+
+/**
+ * Unpacks a zip archive while it is downloaded.
+ *
+ * The worker lives in a background thread and is fed the same in-order
+ * stream as the hash workers. Entries are written below a staging directory,
+ * the CRC of every entry is checked as soon as it is complete. Once the
+ * download is verified, publish() moves the tree to its final place.
+ *
+ * Stored and deflated entries are supported, with or without data
+ * descriptor and ZIP64 sizes. Encrypted archives and other compression
+ * methods fail, the archive itself is kept and can be extracted by hand.
+ * Extraction needs zlib (AU_HAVE_ZLIB).
+ */
+class AuZipExtractor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AuZipExtractor(const QString& staging_dir);
+    ~AuZipExtractor();
+
+    static bool isSupported();
+
+    /**
+     * Replace target_dir with the extracted tree. The tree appears with a
+     * single rename, an existing target_dir is moved aside before.
+     */
+    static bool publish(const QString& staging_dir, const QString& target_dir);
+
+    Q_SLOT void addFile(const QString& file_name, qint64 offset, qint64 length);
+    Q_SLOT void addData(const QByteArray& chunk);
+    Q_SLOT void finish();
+    Q_SLOT void reset();
+
+Q_SIGNALS:
+    /**
+     * @param extracted the staging directory holds the complete archive
+     * @param error reason for an incomplete extraction, empty if the
+     *        download is no zip archive at all
+     */
+    void extractFinished(bool extracted, QString error);
+
+private:
+    enum class State
+    {
+        HEADER,
+        DATA,
+        DESCRIPTOR,
+        DONE,
+        NO_ARCHIVE,
+        FAILED
+    };
+
+    struct Entry
+    {
+        QString name;
+        quint16 flags;
+        quint16 method;
+        quint32 crc;
+        quint64 compressed_size;
+        quint64 size;
+        bool zip64;
+    };
+
+    void consume();
+    bool readHeader();
+    bool beginEntry(const Entry& entry);
+    bool readStored();
+    bool readDeflated();
+    bool endData();
+    bool readDescriptor();
+    bool finishEntry();
+    void write(const char* data, qint64 length);
+    void fail(const QString& error);
+    void close();
+    qint64 available() const;
+    const char* data() const;
+    static QString sanitizeName(const QString& name);
+
+private:
+    struct Inflater;
+
+    QString m_staging_dir;
+    State m_state;
+    QByteArray m_buffer;
+    qint64 m_pos;
+    Entry m_entry;
+    QFile m_file;
+    quint32 m_crc;
+    quint64 m_consumed;
+    quint64 m_written;
+    int m_entry_count;
+    QString m_error;
+    std::unique_ptr<Inflater> m_inflater;
+};
@@ -35,6 +35,33 @@ TabView {
         return ""
     }
 
+    function getStageText(stage) {
+        switch (stage) {
+        case "pending": return qsTr("Pending")
+        case "downloading": return qsTr("Downloading")
+        case "verifying": return qsTr("Verifying")
+        case "waiting": return qsTr("Waiting for installation")
+        case "installing": return qsTr("Installing")
+        case "downloaded": return qsTr("Downloaded, install manually")
+        case "done": return qsTr("Updated")
+        case "failed": return qsTr("Update failed")
+        }
+        return ""
+    }
+
+    function getTransferText(status) {
+        if (status.state != "running" || status.bytesPerSecond <= 0) {
+            return ""
+        }
+        var text = (status.bytesPerSecond / (1024 * 1024)).toFixed(1) + " MB/s"
+        if (status.eta >= 0) {
+            var minutes = Math.floor(status.eta / 60)
+            var seconds = status.eta % 60
+            text += ", " + minutes + ":" + (seconds < 10 ? "0" : "") + seconds + " " + qsTr("left")
+        }
+        return text
+    }
+
     function getUpdatesAvailableText(data) {
         var entry
         for (entry of data) {
@@ -78,6 +105,8 @@ TabView {
                         width: parent.width - 20
 
                         property var url: modelData["url"]
+                        // per url status, only this delegate is notified
+                        property var dlStatus: url ? app.getDownloadStatus(url) : null
 
                         Rectangle {
                             Layout.fillWidth: true
@@ -164,7 +193,21 @@ TabView {
                                     }
                                 }
 
-                                Item { }
+                                Text {
+                                    Layout.alignment: Qt.AlignRight
+                                    text: qsTr("Ready to install")
+                                    font.pointSize: 10; font.bold: false
+                                    color: "green"
+                                    visible: dlStatus ? (dlStatus.ready && !dlStatus.finished) : false
+                                }
+
+                                Text {
+                                    id: updateStage
+                                    Layout.alignment: Qt.AlignRight
+                                    text: dlStatus ? getStageText(dlStatus.stage) : ""
+                                    font.pointSize: 10; font.bold: false
+                                    visible: text.length > 0
+                                }
 
                                 // VerticalSpacer
                                 Item {
@@ -174,11 +217,7 @@ TabView {
                                 Button {
                                     id: btnOpenDownloads
                                     text: qsTr("Open Download")
-                                    visible: false
-                                    Connections {
-                                        target: app
-                                        onDownloadProgressChanged: { btnOpenDownloads.visible = app.getDownloadProgress(url) > 100 }
-                                    }
+                                    visible: dlStatus ? dlStatus.finished : false
                                     onClicked: {
                                         app.openDownloadFolder(url);
                                     }
@@ -208,20 +247,45 @@ TabView {
 
                         }
 
-                        ProgressBar {
-                            id: dlBar
-                            Layout.fillWidth: true
-                            from: 0
-                            to: 100
-                            value: 0
-                            visible: value > 0
-
-                            Connections {
-                                target: app
-                                onDownloadProgressChanged: {
-                                    var v = app.getDownloadProgress(url)
-                                    dlBar.value = v
-                                    dlBar.visible = (v > 0) && (v <= 100)
+                        RowLayout {
+                            id: dlRow
+                            property string dlState: dlStatus ? dlStatus.state : ""
+                            visible: dlState.length > 0
+
+                            ProgressBar {
+                                id: dlBar
+                                Layout.fillWidth: true
+                                from: 0
+                                to: 100
+                                value: dlStatus ? dlStatus.progress : 0
+                            }
+
+                            Text {
+                                text: dlStatus ? getTransferText(dlStatus) : ""
+                                font.pointSize: 10; font.bold: false
+                                visible: text.length > 0
+                            }
+
+                            Text {
+                                text: dlRow.dlState == "queued" ? qsTr("Waiting") : (dlRow.dlState == "paused" ? qsTr("Paused") : (dlRow.dlState == "retrying" ? qsTr("Retrying") : ""))
+                                font.pointSize: 10; font.bold: false
+                            }
+
+                            Button {
+                                text: dlRow.dlState == "paused" ? qsTr("Resume") : qsTr("Pause")
+                                onClicked: {
+                                    if (dlRow.dlState == "paused") {
+                                        app.resumeDownload(url)
+                                    } else {
+                                        app.pauseDownload(url)
+                                    }
+                                }
+                            }
+
+                            Button {
+                                text: qsTr("Cancel")
+                                onClicked: {
+                                    app.cancelDownload(url)
                                 }
                             }
                         }
@@ -338,6 +402,30 @@ TabView {
                                     app.autostart = checked
                                 }
                             }
+
+                            CheckBox {
+                                text: qsTr("Prefetch updates in the background")
+                                checked: app.prefetchUpdates
+                                onClicked: {
+                                    app.prefetchUpdates = checked
+                                }
+                            }
+
+                            CheckBox {
+                                text: qsTr("Share installers with PCs on the local network")
+                                checked: app.shareInstallers
+                                onClicked: {
+                                    app.shareInstallers = checked
+                                }
+                            }
+
+                            CheckBox {
+                                text: qsTr("Extract zip installers while downloading")
+                                checked: app.extractArchives
+                                onClicked: {
+                                    app.extractArchives = checked
+                                }
+                            }
                         }
                         // HorizontalSpacer
                         Item {
@@ -345,6 +433,13 @@ TabView {
                             height: 1
                         } 
                         
+                        Button {
+                            text: qsTr("Update All")
+                            onClicked: {
+                                app.updateAll()
+                            }
+                        }
+
                         Button {
                             text: qsTr("Check")
                             onClicked: {
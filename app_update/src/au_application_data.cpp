@@ -20,19 +20,49 @@
 #include "au_version_number.h"
 #include <QCoreApplication>
 #include <QCryptographicHash>
+#include <QDebug>
 #include <QDesktopServices>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QQmlEngine>
+#include <QSettings>
 #include <QStandardPaths>
 
 
 #define UPDATE_PORTAL "https://ccc.dewetron.com/dl/update.json"
 #define UPDATE_FILE   "update.json"
+#define DOWNLOAD_SEGMENTS 4
+#define MAX_CONCURRENT_DOWNLOADS 2
+#define PREFETCH_QUOTA_MB 4096
+#define PEER_RETRIES 2
+#define PREWARM_LEAD_MS (15 * 1000)
+#define INSTALLER_CACHE_MB 10240
+#define COMPACT_DELAY_MS (60 * 1000)
 
 
 bool getAutostartSetting();
 void setAutostartSetting(bool autostart);
 
+namespace
+{
+    std::string manifestDigest(const au_doc::AuAppVersion& app_version, AuDigest::Algorithm algorithm)
+    {
+        switch (algorithm)
+        {
+        case AuDigest::Algorithm::MD5:
+            return app_version.md5;
+        case AuDigest::Algorithm::SHA1:
+            return app_version.sha1;
+        case AuDigest::Algorithm::SHA256:
+            return app_version.sha256;
+        case AuDigest::Algorithm::BLAKE3:
+            return app_version.blake3;
+        }
+        return {};
+    }
+}
+
 
 AuApplicationData::AuApplicationData()
     : m_installed_software{}
@@ -40,15 +70,45 @@ AuApplicationData::AuApplicationData()
     , m_sw_enumerator()
     , m_bundle_map()
     , m_au_doc()
+    , m_manifest_cache(QStandardPaths::writableLocation(QStandardPaths::CacheLocation))
+    , m_changed_etag()
+    , m_installer_store(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation))
+    , m_network_session()
+    , m_mirrors()
+    , m_peer_share()
+    , m_scheduler()
+    , m_update_pipeline()
+    , m_update_channel()
+    , m_patch_thread()
+    , m_delta_patcher()
+    , m_delta_downloads()
+    , m_delta_failed()
+    , m_chunk_assembler()
+    , m_chunk_downloads()
+    , m_chunk_failed()
+    , m_local_copier()
+    , m_local_copies()
+    , m_peer_downloads()
+    , m_prefetch_urls()
+    , m_prefetch_requested()
+    , m_prefetch_skipped()
     , m_downloads()
     , m_message()
-    , m_progress()
+    , m_download_status()
     , m_filename_map()
     , m_daily_timer()
+    , m_prewarm_timer()
     , m_fast_timer()
+    , m_compact_timer()
     , m_autostart(false)
     , m_show_beta_versions(false)
     , m_show_older_versions(false)
+    , m_prefetch_updates(false)
+    , m_prefetch_quota(0)
+    , m_share_installers(false)
+    , m_extract_archives(false)
+    , m_cache_budget(0)
+    , m_local_repository()
 {
     // predefine bundles, which are only shown once
     m_bundle_map = std::map<std::string, std::string>
@@ -59,17 +119,124 @@ AuApplicationData::AuApplicationData()
         { "DEWETRON TRIONCAL",     "DEWETRON TRION Applications" }
     };
 
+    // one session for all downloads, connections are kept alive
+    m_network_session = new AuNetworkSession(this);
+    m_network_session->setCacheDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+
+    // manifest and installers are available from all configured mirrors
+    m_mirrors = new AuMirrorList(QUrl(UPDATE_PORTAL).adjusted(QUrl::RemoveFilename), m_network_session, this);
+    m_mirrors->load();
+
+    // limits concurrent transfers and their bandwidth
+    m_scheduler = new AuDownloadScheduler(this);
+    m_scheduler->setMaxConcurrent(MAX_CONCURRENT_DOWNLOADS);
+    connect(m_scheduler, &AuDownloadScheduler::stateChanged, this, [this](QUrl dl_url) {
+        downloadStatus(dl_url)->setState(AuDownloadScheduler::stateName(m_scheduler->getState(dl_url)));
+    });
+
+    m_update_pipeline = new AuUpdatePipeline(this);
+    connect(m_update_pipeline, &AuUpdatePipeline::downloadRequested, this, [this](QUrl url, QString name) {
+        doDownload(url, name, AuDownloadScheduler::Priority::USER);
+    });
+    connect(m_update_pipeline, &AuUpdatePipeline::packageChanged, this, [this](QUrl dl_url) {
+        auto package = m_update_pipeline->getPackage(dl_url);
+        downloadStatus(dl_url)->setStage(package ? AuUpdatePipeline::stageName(package->stage) : QString());
+    });
+    connect(m_update_pipeline, &AuUpdatePipeline::finished, this, &AuApplicationData::updatePipelineFinished);
+
+    // verified installers are reused and patched
+    m_installer_store.load();
+
+    // delta patches are applied in the background
+    m_delta_patcher = new AuDeltaPatcher;
+    m_delta_patcher->moveToThread(&m_patch_thread);
+    connect(&m_patch_thread, &QThread::finished, m_delta_patcher, &QObject::deleteLater);
+    connect(m_delta_patcher, &AuDeltaPatcher::patchApplied, this, &AuApplicationData::patchApplied);
+
+    // so are installers assembled from the chunks of local ones
+    m_chunk_assembler = new AuChunkAssembler(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/chunks");
+    m_chunk_assembler->moveToThread(&m_patch_thread);
+    connect(&m_patch_thread, &QThread::finished, m_chunk_assembler, &QObject::deleteLater);
+    connect(m_chunk_assembler, &AuChunkAssembler::chunksAssembled, this, &AuApplicationData::chunksAssembled);
+    connect(m_chunk_assembler, &AuChunkAssembler::chunksVerified, this, &AuApplicationData::chunksVerified);
+
+    // and installers copied from a local repository
+    m_local_copier = new AuLocalCopier;
+    m_local_copier->moveToThread(&m_patch_thread);
+    connect(&m_patch_thread, &QThread::finished, m_local_copier, &QObject::deleteLater);
+    connect(m_local_copier, &AuLocalCopier::copyProgress, this, &AuApplicationData::downloadProgress);
+    connect(m_local_copier, &AuLocalCopier::copied, this, &AuApplicationData::localCopied);
+    m_patch_thread.start();
+
     m_daily_timer = new QTimer(this);
-    connect(m_daily_timer, &QTimer::timeout, this, QOverload<>::of(&AuApplicationData::update));
+    connect(m_daily_timer, &QTimer::timeout, this, [this]() {
+        schedulePrewarm();
+        update();
+    });
     m_daily_timer->start(1000 * 60 * 60 * 24);   // check every 24hours
 
+    // optional: DNS and TLS are done shortly before the daily check starts
+    m_prewarm_timer = new QTimer(this);
+    m_prewarm_timer->setSingleShot(true);
+    connect(m_prewarm_timer, &QTimer::timeout, this, [this]() {
+        m_network_session->prewarm(m_mirrors->map(QUrl(UPDATE_PORTAL)));
+    });
+    schedulePrewarm();
+
     m_autostart = getAutostartSetting();
 
+    // opt-in: updates are downloaded in the background before they are requested
+    QSettings settings("DEWETRON", "AppUpdate");
+    m_prefetch_updates = settings.value("prefetch", false).toBool();
+    m_prefetch_quota = settings.value("prefetch_quota_mb", PREFETCH_QUOTA_MB).toLongLong() * 1024 * 1024;
+
+    // verified installers are exchanged with the other PCs of the site, only if the user opted in
+    m_peer_share = new AuPeerShare(m_installer_store, this);
+    m_share_installers = settings.value("peer_sharing", false).toBool();
+    if (m_share_installers)
+    {
+        m_peer_share->start();
+    }
+
+    // opt-in: zip installers are unpacked while they download
+    m_extract_archives = settings.value("extract_zip", false).toBool();
+
+    // the installer store is kept within its budget while nothing else is going on
+    m_cache_budget = settings.value("installer_cache_mb", INSTALLER_CACHE_MB).toLongLong() * 1024 * 1024;
+    m_compact_timer = new QTimer(this);
+    m_compact_timer->setSingleShot(true);
+    connect(m_compact_timer, &QTimer::timeout, this, &AuApplicationData::compactStore);
+
+    // optional: air-gapped benches update from a mounted directory
+    m_local_repository = settings.value("local_repository").toString();
+
+    // optional: the server announces new manifests, the daily check stays as fallback
+    m_update_channel = new AuUpdateChannel(m_network_session, this);
+    connect(m_update_channel, &AuUpdateChannel::manifestChanged, this, &AuApplicationData::manifestChanged);
+    m_update_channel->start(QUrl(settings.value("notify_url").toString()));
+
     update();
 }
 
 AuApplicationData::~AuApplicationData()
 {
+    // no queued download may start while the others are deleted
+    delete m_scheduler;
+    m_scheduler = nullptr;
+
+    // downloads use the network session, stop them first
+    delete m_update_channel;
+    m_update_channel = nullptr;
+    qDeleteAll(m_downloads);
+    m_downloads.clear();
+    delete m_mirrors;
+    m_mirrors = nullptr;
+    delete m_peer_share;
+    m_peer_share = nullptr;
+
+    m_patch_thread.quit();
+    m_patch_thread.wait();
+
     if (m_daily_timer)
     {
         delete m_daily_timer;
@@ -277,20 +444,71 @@ void AuApplicationData::checkForUpdates()
 
 void AuApplicationData::updateAll()
 {
-    // TODO:
-    // check for updates
-    // download updates
-    // install
+    if (m_update_pipeline->isRunning())
+    {
+        return;
+    }
+
+    auto packages = getUpdatePackages();
+    if (packages.isEmpty())
+    {
+        setMessage("No updates available");
+        return;
+    }
+
+    setMessage(QString("Updating %1 packages").arg(packages.size()));
+    m_update_pipeline->start(packages);
 }
 
 void AuApplicationData::download(QUrl download_url)
 {
-    doDownload(download_url, {});
+    doDownload(download_url, {}, AuDownloadScheduler::Priority::USER);
+}
+
+QObject* AuApplicationData::getDownloadStatus(QUrl download_url)
+{
+    return downloadStatus(download_url);
+}
+
+void AuApplicationData::pauseDownload(QUrl download_url)
+{
+    if (m_scheduler->pause(download_url))
+    {
+        setMessage(QString("Download paused: %1").arg(download_url.fileName()));
+    }
+}
+
+void AuApplicationData::resumeDownload(QUrl download_url)
+{
+    if (m_scheduler->resume(download_url))
+    {
+        setMessage(QString("Downloading %1").arg(download_url.fileName()));
+    }
 }
 
-int AuApplicationData::getDownloadProgress(QUrl download_url)
+void AuApplicationData::cancelDownload(QUrl download_url)
 {
-    return m_progress[download_url];
+    auto au_dl = m_scheduler->cancel(download_url);
+    if (!au_dl && !m_chunk_downloads.contains(download_url) && !m_local_copies.contains(download_url))
+    {
+        return;
+    }
+
+    if (au_dl)
+    {
+        releaseDownload(au_dl);
+    }
+    stopChunkDownload(download_url);
+    m_local_copies.remove(download_url);
+    m_delta_downloads.remove(download_url);
+    m_peer_downloads.remove(download_url);
+    m_prefetch_urls.remove(download_url);
+    m_prefetch_requested.remove(download_url);
+    m_prefetch_skipped.insert(download_url);
+    downloadStatus(download_url)->setProgress(0, 0);
+    setMessage(QString("Download cancelled: %1").arg(download_url.fileName()));
+
+    m_update_pipeline->downloadFailed(download_url, "Download cancelled");
 }
 
 void AuApplicationData::openDownloadFolder(QUrl download_url)
@@ -322,6 +540,15 @@ void AuApplicationData::showNotification(const QString& title, const QString& bo
     Q_EMIT doShowNotification(title, body);
 }
 
+void AuApplicationData::schedulePrewarm()
+{
+    QSettings settings("DEWETRON", "AppUpdate");
+    if (settings.value("prewarm", true).toBool())
+    {
+        m_prewarm_timer->start(qMax(0, m_daily_timer->remainingTime() - PREWARM_LEAD_MS));
+    }
+}
+
 void AuApplicationData::update()
 {
     Q_EMIT resetAlertIcon();
@@ -332,8 +559,17 @@ void AuApplicationData::update()
         delete m_fast_timer;
         m_fast_timer = nullptr;
     }
+    if (!m_local_repository.isEmpty() && loadLocalManifest())
+    {
+        // no network involved
+        return;
+    }
+
+    // pick the fastest mirror for the installers
+    m_mirrors->probe(QUrl(UPDATE_PORTAL));
+
     // download latest update.json file from server
-    doDownload(QUrl(UPDATE_PORTAL), UPDATE_FILE);
+    doDownload(QUrl(UPDATE_PORTAL), UPDATE_FILE, AuDownloadScheduler::Priority::MANIFEST);
 }
 
 
@@ -476,236 +712,1315 @@ bool AuApplicationData::hasUpdate(const std::string& app_name, const std::string
     return true;
 }
 
-bool AuApplicationData::doDownload(QUrl download_url, const QString nice_name)
+bool AuApplicationData::doDownload(QUrl download_url, const QString nice_name, AuDownloadScheduler::Priority priority)
 {
     auto dl_it = m_downloads.find(download_url);
 
     if (dl_it != m_downloads.end())
     {
-        // download in progress - ignore
-        return false;
-    }
-
-    setMessage(QString("Downloading %1").arg(nice_name));
-
-    auto au_dl = new AuDownloader(download_url, this);
-    m_downloads.insert(download_url, au_dl );
-
-    connect(au_dl, &AuDownloader::downloadFinished, this, &AuApplicationData::downloadFinished);
-    connect(au_dl, &AuDownloader::downloadError, this, &AuApplicationData::downloadError);
-    connect(au_dl, &AuDownloader::downloadProgress, this, &AuApplicationData::downloadProgress);
+        if ((priority != AuDownloadScheduler::Priority::BACKGROUND) && m_prefetch_urls.contains(download_url))
+        {
+            // prefetch in progress, delivered from the store once verified
+            m_prefetch_requested.insert(download_url);
+            m_scheduler->setPriority(download_url, priority);
+        }
 
-    return true;
-}
+        // download in progress - ignore, a paused one continues
+        return m_scheduler->resume(download_url);
+    }
 
-void AuApplicationData::downloadFinished(QUrl dl_url, QString filename)
-{
-    setMessage({});
+    if (m_chunk_downloads.contains(download_url) || m_local_copies.contains(download_url))
+    {
+        // assembled from chunks or copied, no downloader in between
+        return true;
+    }
 
-    auto au_dl_it = m_downloads.find(dl_url);
-    if (au_dl_it != m_downloads.end())
+    if ((QUrl(UPDATE_PORTAL) != download_url) && extractFromStore(download_url))
     {
-        auto au_dl = au_dl_it.value();
-        disconnect(au_dl, &AuDownloader::downloadFinished, this, &AuApplicationData::downloadFinished);
-        disconnect(au_dl, &AuDownloader::downloadError, this, &AuApplicationData::downloadError);
-        disconnect(au_dl, &AuDownloader::downloadProgress, this, &AuApplicationData::downloadProgress);
+        // installer already verified, no transfer needed
+        return true;
     }
 
-    auto content = au_dl_it.value()->getDownload();
+    if ((QUrl(UPDATE_PORTAL) != download_url) && copyFromRepository(download_url))
+    {
+        // available on a local or mounted file system
+        return true;
+    }
 
+    if (download_url.isLocalFile())
+    {
+        setMessage(QString("Could not find %1").arg(download_url.toLocalFile()));
+        m_update_pipeline->downloadFailed(download_url, m_message);
+        return false;
+    }
 
-    if ((QUrl(UPDATE_PORTAL) == dl_url) && (filename == UPDATE_FILE))
+    if (priority != AuDownloadScheduler::Priority::BACKGROUND)
     {
-        m_downloads.erase(au_dl_it);
-        updateJson(content);
-        return;
+        setMessage(QString("Downloading %1").arg(nice_name));
     }
 
-    // Check signatures
+    AuDownloader* au_dl = nullptr;
+    if (QUrl(UPDATE_PORTAL) == download_url)
     {
-        QCryptographicHash md5(QCryptographicHash::Md5);
-        md5.addData(content);
-        if (!compareHashMd5(dl_url, md5.result()))
+        // update.json is small, keep it in memory
+        au_dl = new AuDownloader(download_url, m_network_session, this);
+
+        // only transfer the manifest if it changed since the last check
+        if (m_manifest_cache.load())
         {
-            setMessage(QString("MD5 checksum failure for file %1").arg(filename));
-            return;
+            if (!m_manifest_cache.getETag().isEmpty())
+            {
+                au_dl->setRequestHeader("If-None-Match", m_manifest_cache.getETag());
+            }
+            if (!m_manifest_cache.getLastModified().isEmpty())
+            {
+                au_dl->setRequestHeader("If-Modified-Since", m_manifest_cache.getLastModified());
+            }
         }
     }
-
+    else
     {
-        QCryptographicHash sha1(QCryptographicHash::Sha1);
-        sha1.addData(content);
-        if (!compareHashSha1(dl_url, sha1.result()))
+        // installers are streamed to disk, prefetched ones only end up in the store
+        const QString downloads_folder = m_prefetch_urls.contains(download_url)
+            ? getPrefetchFolder()
+            : QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
+
+        auto app_version = findAppVersion(download_url);
+        const auto peer_url = (app_version && !app_version->sha1.empty())
+            ? m_peer_share->findPeer(QByteArray(app_version->sha1.c_str()))
+            : QUrl();
+
+        DeltaDownload delta_download;
+        ChunkDownload chunk_download;
+        if (peer_url.isEmpty() && !findDelta(download_url, delta_download) && findChunkSources(download_url, chunk_download))
         {
-            setMessage(QString("SHA1 checksum failure for file %1").arg(filename));
-            return;
+            // without a matching delta the installer is assembled from the chunks of older ones, the index comes first
+            au_dl = new AuDownloader(download_url, m_network_session, this);
+            au_dl->setTransferUrl(QUrl(app_version->chunk_index.c_str()));
+            for (const auto& sha1 : chunk_download.sources.keys())
+            {
+                m_installer_store.touch(sha1);
+            }
+            chunk_download.downloads_folder = downloads_folder;
+            m_chunk_downloads.insert(download_url, chunk_download);
+        }
+        else
+        {
+            au_dl = new AuDownloader(download_url, downloads_folder, m_network_session, this);
+            au_dl->setSegmentCount(DOWNLOAD_SEGMENTS);
+            au_dl->setDigests(getDigestAlgorithms(download_url));
+
+            if (!peer_url.isEmpty())
+            {
+                // another PC of the site has the verified installer, the LAN is fast enough for a single stream
+                au_dl->setTransferUrl(peer_url);
+                au_dl->setSegmentCount(1);
+                au_dl->setMaxRetries(PEER_RETRIES);
+                m_peer_downloads.insert(download_url, peer_url);
+            }
+            else if (!delta_download.source_file.isEmpty())
+            {
+                // only the patch against an installer we already have is transferred
+                au_dl->setTransferUrl(QUrl(delta_download.delta.url.c_str()));
+                m_delta_downloads.insert(download_url, delta_download);
+                m_installer_store.touch(QByteArray(delta_download.delta.from_sha1.c_str()));
+            }
+
+            if (app_version && !app_version->chunk_hashes.url.empty() && !m_delta_downloads.contains(download_url))
+            {
+                // corrupt chunks are detected and fetched again while the rest is still arriving
+                const auto& chunk_hashes = app_version->chunk_hashes;
+                au_dl->setChunkHashes(QUrl(chunk_hashes.url.c_str()), chunk_hashes.chunk_size,
+                    QByteArray::fromHex(QByteArray(chunk_hashes.root.c_str())));
+            }
+
+            if (m_extract_archives && !m_prefetch_urls.contains(download_url) && !m_delta_downloads.contains(download_url))
+            {
+                // unpacked from the same stream as the digests, published once they match
+                auto url_hash = QCryptographicHash::hash(download_url.toEncoded(), QCryptographicHash::Md5).toHex();
+                au_dl->setExtractDir(downloads_folder + "/AppUpdate_" + QString::fromLatin1(url_hash) + ".extracting");
+            }
         }
     }
+    au_dl->setMirrorList(m_mirrors);
+    m_downloads.insert(download_url, au_dl );
+    downloadStatus(download_url)->setFinished(false);
 
-    m_filename_map[dl_url] = filename;
+    connect(au_dl, &AuDownloader::downloadFinished, this, &AuApplicationData::downloadFinished);
+    connect(au_dl, &AuDownloader::downloadError, this, &AuApplicationData::downloadError);
+    connect(au_dl, &AuDownloader::downloadProgress, this, &AuApplicationData::downloadProgress);
+    connect(au_dl, &AuDownloader::stateChanged, this, &AuApplicationData::downloaderStateChanged);
 
-    const QString downloads_folder = QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
-    QFile dest_file(downloads_folder + "/" + filename);
+    m_scheduler->enqueue(au_dl, priority);
+
+    return true;
+}
+
+bool AuApplicationData::extractFromStore(QUrl download_url)
+{
+    auto app_version = findAppVersion(download_url);
+    if (!app_version || app_version->sha1.empty())
+    {
+        return false;
+    }
 
-    if (dest_file.exists())
+    // portal urls end in an id, the store knows the name the installer was delivered with
+    const QByteArray sha1 = QByteArray(app_version->sha1.c_str()).toLower();
+    QString filename = m_installer_store.getFileName(sha1);
+    if (filename.isEmpty())
     {
-        // removing old file
-        dest_file.remove();
+        filename = download_url.fileName();
     }
 
-    if (!dest_file.open(QIODevice::WriteOnly))
+    const QString downloads_folder = QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
+    const QString dest_file_name = downloads_folder + "/" + filename;
+    if (filename.isEmpty() || !m_installer_store.extract(sha1, dest_file_name))
     {
-        setMessage(QString("Could not create ") + dest_file.fileName());
+        return false;
     }
-    auto bytes_written = dest_file.write(content);
-    dest_file.close();
-    setMessage(QString("File downloaded to ") + dest_file.fileName());
-    
 
-    m_progress[dl_url] = 200;  // signal finished dl
-    Q_EMIT downloadProgressChanged();
+    qInfo().noquote() << QString("%1: taken from the installer store").arg(download_url.toString());
+    m_installer_store.touch(sha1);
+    m_filename_map[download_url] = filename;
+    downloadStatus(download_url)->setFinished(false);
 
-    m_downloads.erase(au_dl_it);
+    // report like a finished download, callers expect an asynchronous result
+    QTimer::singleShot(0, this, [this, download_url, dest_file_name, sha1]() {
+        installerVerified(download_url, dest_file_name, QByteArray::fromHex(sha1));
+    });
+    return true;
 }
 
-void AuApplicationData::downloadError(QUrl dl_url)
+AuDownloadStatus* AuApplicationData::downloadStatus(QUrl download_url)
 {
-    auto au_dl_it = m_downloads.find(dl_url);
-    if (au_dl_it != m_downloads.end())
+    auto status_it = m_download_status.find(download_url);
+    if (status_it != m_download_status.end())
     {
-        auto au_dl = au_dl_it.value();
-        disconnect(au_dl, &AuDownloader::downloadFinished, this, &AuApplicationData::downloadFinished);
-        disconnect(au_dl, &AuDownloader::downloadError, this, &AuApplicationData::downloadError);
-        disconnect(au_dl, &AuDownloader::downloadProgress, this, &AuApplicationData::downloadProgress);
+        return status_it.value();
+    }
+
+    auto status = new AuDownloadStatus(this);
+    QQmlEngine::setObjectOwnership(status, QQmlEngine::CppOwnership);
+    m_download_status.insert(download_url, status);
+    return status;
+}
+
+void AuApplicationData::releaseDownload(AuDownloader* au_dl)
+{
+    disconnect(au_dl, &AuDownloader::downloadFinished, this, &AuApplicationData::downloadFinished);
+    disconnect(au_dl, &AuDownloader::downloadError, this, &AuApplicationData::downloadError);
+    disconnect(au_dl, &AuDownloader::downloadProgress, this, &AuApplicationData::downloadProgress);
+    disconnect(au_dl, &AuDownloader::stateChanged, this, &AuApplicationData::downloaderStateChanged);
+    m_downloads.remove(au_dl->getUrl());
+    au_dl->deleteLater();
+}
+
+void AuApplicationData::downloadFinished(QUrl dl_url, QString filename)
+{
+    setMessage({});
 
-        setMessage(QString("Download error: %1").arg(au_dl->getError()));
+    auto au_dl_it = m_downloads.find(dl_url);
+    if (au_dl_it == m_downloads.end())
+    {
+        return;
     }
 
-    if ((QUrl(UPDATE_PORTAL) == dl_url))
+    auto au_dl = au_dl_it.value();
+    releaseDownload(au_dl);
+
+    if (QUrl(UPDATE_PORTAL) == dl_url)
     {
-        QStringList update_candidates{ "examples/update.json", "../examples/update.json" };
-        QByteArray json_data;
-        for (const auto& candidate : update_candidates)
+        qInfo().noquote() << QString("%1: %2 bytes transferred, %3 bytes decoded")
+            .arg(dl_url.toString()).arg(au_dl->getTransferSize()).arg(au_dl->getDecodedSize());
+
+        if (!au_dl->isNotModified())
         {
-            QFile uf(candidate);
-            if (uf.open(QIODevice::ReadOnly))
+            // only a valid manifest replaces the cached one
+            if (updateJson(au_dl->getDownload()))
             {
-                json_data = uf.readAll();
-                updateJson(json_data);
-                break;
+                m_manifest_cache.store(au_dl->getDownload(), au_dl->getETag(), au_dl->getLastModified());
             }
         }
+        else if (m_au_doc.m_apps.empty())
+        {
+            // first check since startup
+            updateJson(m_manifest_cache.getData());
+        }
+        else
+        {
+            // manifest unchanged, installed software might have changed
+            updateInstalledSoftware();
+        }
+        checkChangedManifest();
+        return;
     }
 
-    m_downloads.erase(au_dl_it);
-}
+    if (m_delta_downloads.contains(dl_url))
+    {
+        deltaFinished(au_dl, filename);
+        return;
+    }
 
-void AuApplicationData::downloadProgress(QUrl dl_url, qint64 curr, qint64 max)
-{
-    auto progress = (100.0 / max) * curr;
-    
-    m_progress[dl_url] = progress; 
-    Q_EMIT downloadProgressChanged();
-}
+    auto chunk_it = m_chunk_downloads.find(dl_url);
+    if ((chunk_it != m_chunk_downloads.end()) && chunk_it->fetching)
+    {
+        qInfo().noquote() << QString("%1: %2 bytes fetched").arg(dl_url.toString()).arg(au_dl->getTransferSize());
+        chunksFetched(dl_url);
+        return;
+    }
+    if (chunk_it != m_chunk_downloads.end())
+    {
+        chunkIndexFinished(au_dl);
+        return;
+    }
 
-void AuApplicationData::updateJson(const QByteArray& json)
-{
-    // get update json document
-    AuUpdateJson au_json(json);
+    // Check signatures, the digests were calculated while downloading
+    QString failed_digest;
+    const bool verified = verifyDigests(dl_url, au_dl->getDigests(), failed_digest);
 
-    if (au_json.update())
+    const auto peer_url = m_peer_downloads.take(dl_url);
+    if (!verified && !peer_url.isEmpty())
     {
-        m_au_doc = au_json.getDocument();
-        updateBundleMap();
+        // a broken copy on a peer, the installer comes from the mirrors instead
+        au_dl->discard();
+        peerFailed(dl_url, peer_url, QString("%1 checksum failure").arg(failed_digest));
+        return;
     }
 
-    // add a custom filter to display only relevant software packages
-    m_sw_enumerator.addFilter([](const SwEntry& sw) { return sw.m_publisher.find("DEWETRON") != std::string::npos; });
+    const bool prefetch = m_prefetch_urls.remove(dl_url) > 0;
+    const bool requested = m_prefetch_requested.remove(dl_url);
 
-    auto sw_entries = m_sw_enumerator.enumerate();
+    if (!verified)
+    {
+        setMessage(failed_digest.isEmpty()
+            ? QString("No checksum to verify file %1").arg(filename)
+            : QString("%1 checksum failure for file %2").arg(failed_digest, filename));
+        au_dl->discard();
+        m_prefetch_skipped.insert(dl_url);
+        m_update_pipeline->downloadFailed(dl_url, m_message);
+        return;
+    }
 
-    m_installed_software_internal.clear();
+    m_filename_map[dl_url] = filename;
 
-    // create list of installed sw
-    for (const auto& sw_entry : sw_entries)
+    auto dest_file_name = au_dl->commit(filename);
+    if (dest_file_name.isEmpty())
     {
-       AuVersionNumber latest_version(getHighestVersionNumber(sw_entry));
-       addToSwList(sw_entry, latest_version);
+        setMessage(au_dl->getError());
+        m_update_pipeline->downloadFailed(dl_url, m_message);
+        return;
     }
 
-    m_installed_software = toVariantList(m_installed_software_internal);
-
-    Q_EMIT updateableAppsChanged();
+    if (prefetch)
+    {
+        prefetchVerified(dl_url, dest_file_name, au_dl->getSha1(), requested);
+        return;
+    }
+    const auto extract_dir = publishExtracted(au_dl, dest_file_name);
+    installerVerified(dl_url, dest_file_name, au_dl->getSha1());
+    if (!extract_dir.isEmpty())
+    {
+        setMessage(QString("File downloaded to %1, extracted to %2").arg(dest_file_name, extract_dir));
+    }
 }
 
-bool AuApplicationData::compareHashMd5(QUrl download_url, const QByteArray& checksum) const
+QString AuApplicationData::publishExtracted(AuDownloader* au_dl, const QString& file_name)
 {
-    for (auto app : m_au_doc.m_apps) {
-
-        auto sorted_vn = getSortedVersionNumbers(app.first);
-
-        if (sorted_vn.isEmpty()) continue;
-
-        // Highest version first
-        {
-            auto ver = sorted_vn.first();
-            sorted_vn.pop_front();
-            auto app_version = app.second.m_app_versions[ver.toString().toStdString().c_str()];
+    const auto staging_dir = au_dl->getExtractDir();
+    if (staging_dir.isEmpty())
+    {
+        return {};
+    }
 
-            if (app_version.url == download_url.toString().toStdString())
-            {
-                return app_version.md5 == checksum.toHex().toStdString();
-            }
-        }
-        // look at older mentioned versions -> stored in entry.other map
-        for (auto ver : sorted_vn)
+    if (!au_dl->isExtracted())
+    {
+        if (!au_dl->getExtractError().isEmpty())
         {
-            auto app_version = app.second.m_app_versions[ver.toString().toStdString().c_str()];
-
-            if (app_version.url == download_url.toString().toStdString())
-            {
-                return app_version.md5 == checksum.toStdString();
-            }
+            qWarning().noquote() << QString("%1: %2").arg(file_name, au_dl->getExtractError());
         }
+        QDir(staging_dir).removeRecursively();
+        return {};
     }
 
-    return false;
+    // the tree next to the archive, named like it
+    QFileInfo archive(file_name);
+    const auto target_dir = archive.absolutePath() + "/" + archive.completeBaseName();
+    if (!AuZipExtractor::publish(staging_dir, target_dir))
+    {
+        qWarning().noquote() << QString("Could not move the extracted files to %1").arg(target_dir);
+        QDir(staging_dir).removeRecursively();
+        return {};
+    }
+    return target_dir;
 }
 
-bool AuApplicationData::compareHashSha1(QUrl download_url, const QByteArray& checksum) const
+void AuApplicationData::installerVerified(QUrl dl_url, const QString& file_name, const QByteArray& sha1)
 {
-    for (auto app : m_au_doc.m_apps) {
+    setMessage(QString("File downloaded to ") + file_name);
 
-        auto sorted_vn = getSortedVersionNumbers(app.first);
+    // reused for the same content and as source for delta updates
+    if (m_installer_store.add(sha1.toHex(), file_name, dl_url))
+    {
+        m_peer_share->announce();
+        scheduleCompaction();
+    }
+    m_update_pipeline->downloadVerified(dl_url, file_name);
 
-        if (sorted_vn.isEmpty()) continue;
+    downloadStatus(dl_url)->setFinished(true);
+}
 
-        // Highest version first
+void AuApplicationData::prefetchUpdates()
+{
+    for (const auto& package : getUpdatePackages())
+    {
+        // only installers which can be verified are prefetched
+        auto app_version = findAppVersion(package.url);
+        if (!app_version || app_version->sha1.empty())
         {
-            auto ver = sorted_vn.first();
-            sorted_vn.pop_front();
-            auto app_version = app.second.m_app_versions[ver.toString().toStdString().c_str()];
-
-            if (app_version.url == download_url.toString().toStdString())
-            {
-                return app_version.sha1 == checksum.toHex().toStdString();
-            }
+            continue;
         }
-        // look at older mentioned versions -> stored in entry.other map
-        for (auto ver : sorted_vn)
+
+        if (!m_installer_store.find(QByteArray(app_version->sha1.c_str())).isEmpty())
         {
-            auto app_version = app.second.m_app_versions[ver.toString().toStdString().c_str()];
+            downloadStatus(package.url)->setReady(true);
+            continue;
+        }
 
-            if (app_version.url == download_url.toString().toStdString())
-            {
-                return app_version.sha1 == checksum.toStdString();
-            }
+        if (!m_prefetch_updates || m_downloads.contains(package.url) || m_prefetch_skipped.contains(package.url)
+            || !findLocalFile(package.url).isEmpty())
+        {
+            // a local repository is as fast as the store
+            continue;
         }
-    }
 
+        if (m_installer_store.getTotalSize() >= m_prefetch_quota)
+        {
+            qInfo().noquote() << "Prefetch quota exhausted";
+            return;
+        }
+
+        qInfo().noquote() << QString("Prefetching %1 %2").arg(package.name, package.version);
+        m_prefetch_urls.insert(package.url, 0);
+        doDownload(package.url, package.name, AuDownloadScheduler::Priority::BACKGROUND);
+    }
+}
+
+void AuApplicationData::prefetchVerified(QUrl dl_url, const QString& file_name, const QByteArray& sha1, bool requested)
+{
+    // the store keeps the only copy
+    auto stored = m_installer_store.add(sha1.toHex(), file_name, dl_url);
+    if (!stored && requested)
+    {
+        m_filename_map[dl_url] = QFileInfo(file_name).fileName();
+        installerVerified(dl_url, file_name, sha1);
+        return;
+    }
+    QFile::remove(file_name);
+    if (stored)
+    {
+        m_peer_share->announce();
+        scheduleCompaction();
+    }
+
+    if (requested)
+    {
+        if (!extractFromStore(dl_url))
+        {
+            setMessage(QString("Could not create %1").arg(dl_url.fileName()));
+            m_update_pipeline->downloadFailed(dl_url, m_message);
+        }
+        return;
+    }
+
+    if (stored)
+    {
+        qInfo().noquote() << QString("%1: ready to install").arg(dl_url.toString());
+        downloadStatus(dl_url)->setReady(true);
+    }
+}
+
+void AuApplicationData::stopPrefetch(QUrl dl_url)
+{
+    m_prefetch_urls.remove(dl_url);
+    m_prefetch_skipped.insert(dl_url);
+    m_delta_downloads.remove(dl_url);
+    m_peer_downloads.remove(dl_url);
+    stopChunkDownload(dl_url);
+
+    auto au_dl = m_scheduler->cancel(dl_url);
+    if (au_dl)
+    {
+        releaseDownload(au_dl);
+    }
+    downloadStatus(dl_url)->setProgress(0, 0);
+}
+
+QString AuApplicationData::getPrefetchFolder() const
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/prefetch";
+}
+
+void AuApplicationData::scheduleCompaction()
+{
+    // restarted by every new installer, compaction runs once things settle
+    m_compact_timer->start(COMPACT_DELAY_MS);
+}
+
+void AuApplicationData::compactStore()
+{
+    if (m_au_doc.m_apps.empty())
+    {
+        // without a manifest nothing can be pinned, updateInstalledSoftware() schedules again
+        return;
+    }
+    if (!m_downloads.isEmpty() || !m_delta_downloads.isEmpty() || !m_chunk_downloads.isEmpty()
+        || !m_local_copies.isEmpty() || m_update_pipeline->isRunning())
+    {
+        // stored installers might be in use as source or for installation
+        scheduleCompaction();
+        return;
+    }
+
+    m_installer_store.setPinned(getPinnedInstallers());
+    const auto file_names = m_installer_store.compact(m_cache_budget);
+    if (file_names.isEmpty())
+    {
+        return;
+    }
+
+    qInfo().noquote() << QString("Installer cache: %1 MB in use, removing %2 files")
+        .arg(m_installer_store.getTotalSize() / (1024 * 1024)).arg(file_names.size());
+    m_peer_share->announce();
+
+    // removing large files takes a while on some file systems
+    QMetaObject::invokeMethod(m_delta_patcher, [file_names]() {
+        AuInstallerStore::removeFiles(file_names);
+    });
+}
+
+QSet<QByteArray> AuApplicationData::getPinnedInstallers() const
+{
+    QSet<QByteArray> pinned;
+
+    // the installed versions, for a rollback and as delta source
+    for (const auto& sw : m_installed_software_internal)
+    {
+        auto app_it = m_au_doc.m_apps.find(sw.package_name);
+        if (app_it == m_au_doc.m_apps.end())
+        {
+            continue;
+        }
+
+        auto installed_version = AuVersionNumber::fromString(sw.package_version.c_str());
+        for (const auto& version : app_it->second.m_app_versions)
+        {
+            auto version_number = AuVersionNumber::fromString(version.first.c_str());
+            if (!(version_number > installed_version) && !(installed_version > version_number)
+                && !version.second.sha1.empty())
+            {
+                pinned.insert(QByteArray(version.second.sha1.c_str()));
+            }
+        }
+    }
+
+    // and the updates waiting to be installed
+    for (const auto& package : getUpdatePackages())
+    {
+        auto app_version = findAppVersion(package.url);
+        if (app_version && !app_version->sha1.empty())
+        {
+            pinned.insert(QByteArray(app_version->sha1.c_str()));
+        }
+    }
+    return pinned;
+}
+
+void AuApplicationData::deltaFinished(AuDownloader* au_dl, QString filename)
+{
+    auto dl_url = au_dl->getUrl();
+    auto& delta_download = m_delta_downloads[dl_url];
+
+    qInfo().noquote() << QString("%1: %2 bytes delta patch transferred").arg(dl_url.toString()).arg(au_dl->getTransferSize());
+
+    if (!delta_download.delta.sha1.empty()
+        && (au_dl->getSha1().toHex() != QByteArray(delta_download.delta.sha1.c_str()).toLower()))
+    {
+        au_dl->discard();
+        deltaFailed(dl_url, QString("SHA1 checksum failure for patch %1").arg(delta_download.delta.url.c_str()));
+        return;
+    }
+
+    // the patch is served as <installer name>.zst
+    for (const auto& suffix : { ".zst", ".zstd", ".patch" })
+    {
+        if (filename.endsWith(suffix))
+        {
+            filename.chop(QString(suffix).size());
+        }
+    }
+    if (filename.isEmpty())
+    {
+        filename = dl_url.fileName();
+    }
+    delta_download.filename = filename;
+
+    delta_download.patch_file = au_dl->commit(filename + ".patch");
+    if (delta_download.patch_file.isEmpty())
+    {
+        deltaFailed(dl_url, au_dl->getError());
+        return;
+    }
+
+    setMessage(QString("Applying update patch for %1").arg(filename));
+
+    const QString target_file = QFileInfo(delta_download.patch_file).absolutePath() + "/" + filename + ".patched";
+    const QString format = delta_download.delta.format.c_str();
+    const QString source_file = delta_download.source_file;
+    const QString patch_file = delta_download.patch_file;
+    const auto algorithms = getDigestAlgorithms(dl_url);
+    QMetaObject::invokeMethod(m_delta_patcher, [this, dl_url, format, source_file, patch_file, target_file, algorithms]() {
+        m_delta_patcher->apply(dl_url, format, source_file, patch_file, target_file, algorithms);
+    });
+}
+
+void AuApplicationData::patchApplied(QUrl dl_url, QString target_file, QVariantMap digests, QString error)
+{
+    auto delta_it = m_delta_downloads.find(dl_url);
+    if (delta_it == m_delta_downloads.end())
+    {
+        return;
+    }
+    QFile::remove(delta_it->patch_file);
+
+    // the patched installer has to match the full file digests
+    QString failed_digest;
+    if (error.isEmpty() && !verifyDigests(dl_url, digests, failed_digest))
+    {
+        error = failed_digest.isEmpty()
+            ? QString("No checksum to verify patched %1").arg(delta_it->filename)
+            : QString("%1 checksum failure for patched %2").arg(failed_digest, delta_it->filename);
+    }
+    const auto sha1 = digests.value(AuDigest::name(AuDigest::Algorithm::SHA1)).toByteArray();
+
+    if (!error.isEmpty())
+    {
+        QFile::remove(target_file);
+        deltaFailed(dl_url, error);
+        return;
+    }
+
+    const auto filename = delta_it->filename;
+    m_delta_downloads.erase(delta_it);
+    installerAssembled(dl_url, target_file, filename, sha1);
+}
+
+QString AuApplicationData::findLocalFile(QUrl download_url) const
+{
+    auto app_version = findAppVersion(download_url);
+    if (!app_version)
+    {
+        return {};
+    }
+
+    // relative urls of a repository manifest refer to the repository
+    QUrl url = download_url;
+    if (url.isRelative() && !m_local_repository.isEmpty())
+    {
+        url = QUrl::fromLocalFile(m_local_repository + "/").resolved(url);
+    }
+
+    if (url.isLocalFile())
+    {
+        const auto file_name = url.toLocalFile();
+        return QFileInfo(file_name).isFile() ? file_name : QString();
+    }
+    if (m_local_repository.isEmpty())
+    {
+        return {};
+    }
+
+    // installers of the online manifest are placed in the repository by their delivered name,
+    // portal urls only end in an id
+    const QByteArray sha1 = QByteArray(app_version->sha1.c_str()).toLower();
+    const QStringList names{
+        sha1.isEmpty() ? QString() : m_installer_store.getFileName(sha1),
+        m_filename_map.value(download_url),
+        url.fileName()
+    };
+    for (const auto& name : names)
+    {
+        const auto file_name = m_local_repository + "/" + name;
+        if (!name.isEmpty() && QFileInfo(file_name).isFile())
+        {
+            return file_name;
+        }
+    }
+    return {};
+}
+
+bool AuApplicationData::copyFromRepository(QUrl download_url)
+{
+    const auto source_file = findLocalFile(download_url);
+    if (source_file.isEmpty())
+    {
+        return false;
+    }
+
+    const QString filename = QFileInfo(source_file).fileName();
+    const QString downloads_folder = QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
+    QDir().mkpath(downloads_folder);
+    const QString target_file = downloads_folder + "/" + filename + ".copying";
+
+    setMessage(QString("Copying %1").arg(filename));
+    m_local_copies.insert(download_url, filename);
+    downloadStatus(download_url)->setFinished(false);
+
+    const auto algorithms = getDigestAlgorithms(download_url);
+    QMetaObject::invokeMethod(m_local_copier, [this, download_url, source_file, target_file, algorithms]() {
+        m_local_copier->copy(download_url, source_file, target_file, algorithms);
+    });
+    return true;
+}
+
+void AuApplicationData::localCopied(QUrl dl_url, QString target_file, QVariantMap digests, QString error)
+{
+    auto copy_it = m_local_copies.find(dl_url);
+    if (copy_it == m_local_copies.end())
+    {
+        // cancelled meanwhile
+        QFile::remove(target_file);
+        return;
+    }
+    const auto filename = copy_it.value();
+    m_local_copies.erase(copy_it);
+    downloadStatus(dl_url)->setProgress(0, 0);
+
+    // a repository is not trusted more than a mirror
+    QString failed_digest;
+    if (error.isEmpty() && !verifyDigests(dl_url, digests, failed_digest))
+    {
+        error = failed_digest.isEmpty()
+            ? QString("No checksum to verify file %1").arg(filename)
+            : QString("%1 checksum failure for file %2").arg(failed_digest, filename);
+    }
+    if (!error.isEmpty())
+    {
+        QFile::remove(target_file);
+        setMessage(error);
+        m_update_pipeline->downloadFailed(dl_url, m_message);
+        return;
+    }
+
+    const auto sha1 = digests.value(AuDigest::name(AuDigest::Algorithm::SHA1)).toByteArray();
+    installerAssembled(dl_url, target_file, filename, sha1);
+}
+
+bool AuApplicationData::loadLocalManifest()
+{
+    QFile manifest_file(m_local_repository + "/" + UPDATE_FILE);
+    if (!manifest_file.open(QIODevice::ReadOnly))
+    {
+        qWarning().noquote() << QString("No manifest in the local repository %1").arg(m_local_repository);
+        return false;
+    }
+
+    qInfo().noquote() << QString("Using the local repository %1").arg(m_local_repository);
+    updateJson(manifest_file.readAll());
+    return true;
+}
+
+void AuApplicationData::installerAssembled(QUrl dl_url, const QString& target_file, const QString& filename, const QByteArray& sha1)
+{
+    const bool prefetch = m_prefetch_urls.remove(dl_url) > 0;
+    const bool requested = m_prefetch_requested.remove(dl_url);
+    const QString downloads_folder = prefetch
+        ? getPrefetchFolder()
+        : QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
+    const QString dest_file_name = downloads_folder + "/" + filename;
+
+    QFile::remove(dest_file_name);
+    if (!QFile::rename(target_file, dest_file_name))
+    {
+        QFile::remove(target_file);
+        setMessage(QString("Could not create %1").arg(dest_file_name));
+        m_update_pipeline->downloadFailed(dl_url, m_message);
+        return;
+    }
+
+    if (prefetch)
+    {
+        prefetchVerified(dl_url, dest_file_name, sha1, requested);
+        return;
+    }
+
+    m_filename_map[dl_url] = QFileInfo(dest_file_name).fileName();
+    installerVerified(dl_url, dest_file_name, sha1);
+}
+
+void AuApplicationData::deltaFailed(QUrl dl_url, const QString& error)
+{
+    qWarning().noquote() << QString("Delta update of %1 failed: %2").arg(dl_url.toString(), error);
+    m_delta_downloads.remove(dl_url);
+
+    // fall back to the full installer, once the patch downloader is done reporting
+    m_delta_failed.insert(dl_url);
+    auto priority = (m_prefetch_urls.contains(dl_url) && !m_prefetch_requested.contains(dl_url))
+        ? AuDownloadScheduler::Priority::BACKGROUND
+        : AuDownloadScheduler::Priority::USER;
+    QTimer::singleShot(0, this, [this, dl_url, priority]() {
+        doDownload(dl_url, {}, priority);
+    });
+}
+
+void AuApplicationData::peerFailed(QUrl dl_url, QUrl peer_url, const QString& error)
+{
+    qWarning().noquote() << QString("Download of %1 from peer %2 failed: %3")
+        .arg(dl_url.toString(), peer_url.toString(), error);
+    m_peer_share->reportFailure(peer_url);
+
+    // another peer or the mirrors, once the peer downloader is done reporting
+    auto priority = (m_prefetch_urls.contains(dl_url) && !m_prefetch_requested.contains(dl_url))
+        ? AuDownloadScheduler::Priority::BACKGROUND
+        : AuDownloadScheduler::Priority::USER;
+    QTimer::singleShot(0, this, [this, dl_url, priority]() {
+        doDownload(dl_url, {}, priority);
+    });
+}
+
+const au_doc::AuAppVersion* AuApplicationData::findAppVersion(QUrl download_url) const
+{
+    for (const auto& app : m_au_doc.m_apps)
+    {
+        for (const auto& app_version : app.second.m_app_versions)
+        {
+            if (app_version.second.url == download_url.toString().toStdString())
+            {
+                return &app_version.second;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool AuApplicationData::findDelta(QUrl download_url, DeltaDownload& delta_download) const
+{
+    auto app_version = findAppVersion(download_url);
+    if (!app_version || m_delta_failed.contains(download_url))
+    {
+        return false;
+    }
+
+    for (const auto& delta : app_version->deltas)
+    {
+        if (delta.url.empty() || !AuDeltaPatcher::isSupported(delta.format.c_str()))
+        {
+            continue;
+        }
+
+        auto source_file = m_installer_store.find(QByteArray(delta.from_sha1.c_str()));
+        if (!source_file.isEmpty())
+        {
+            delta_download.delta = delta;
+            delta_download.source_file = source_file;
+            return true;
+        }
+    }
     return false;
 }
 
+bool AuApplicationData::findChunkSources(QUrl download_url, ChunkDownload& chunk_download) const
+{
+    auto app_version = findAppVersion(download_url);
+    if (!app_version || app_version->chunk_index.empty() || m_chunk_failed.contains(download_url))
+    {
+        return false;
+    }
+
+    // consecutive releases of the same app share most of their chunks
+    for (const auto& app : m_au_doc.m_apps)
+    {
+        const auto& versions = app.second.m_app_versions;
+        auto same_app = std::any_of(versions.begin(), versions.end(),
+            [app_version](const std::pair<const std::string, au_doc::AuAppVersion>& version) {
+                return &version.second == app_version;
+            });
+        if (!same_app)
+        {
+            continue;
+        }
+        for (const auto& other_version : versions)
+        {
+            const QByteArray sha1 = QByteArray(other_version.second.sha1.c_str()).toLower();
+            auto source_file = sha1.isEmpty() ? QString() : m_installer_store.find(sha1);
+            if (!source_file.isEmpty() && (&other_version.second != app_version))
+            {
+                chunk_download.sources.insert(sha1, source_file);
+            }
+        }
+    }
+    chunk_download.fetching = false;
+    return !chunk_download.sources.isEmpty();
+}
+
+void AuApplicationData::chunkIndexFinished(AuDownloader* au_dl)
+{
+    auto dl_url = au_dl->getUrl();
+    auto& chunk_download = m_chunk_downloads[dl_url];
+
+    qInfo().noquote() << QString("%1: %2 bytes chunk index transferred").arg(dl_url.toString()).arg(au_dl->getTransferSize());
+    setMessage(QString("Assembling %1 from local installers").arg(dl_url.toString()));
+
+    auto url_hash = QCryptographicHash::hash(dl_url.toEncoded(), QCryptographicHash::Md5).toHex();
+    chunk_download.target_file = chunk_download.downloads_folder + "/AppUpdate_" + QString::fromLatin1(url_hash) + ".chunks";
+    QDir().mkpath(chunk_download.downloads_folder);
+
+    const auto index_json = au_dl->getDownload();
+    const auto sources = chunk_download.sources;
+    const auto target_file = chunk_download.target_file;
+    QMetaObject::invokeMethod(m_chunk_assembler, [this, dl_url, index_json, sources, target_file]() {
+        m_chunk_assembler->assemble(dl_url, index_json, sources, target_file);
+    });
+}
+
+void AuApplicationData::chunksAssembled(QUrl dl_url, QString target_file, QString file_name, QList<AuByteRange> missing,
+    qint64 reused, QString error)
+{
+    auto chunk_it = m_chunk_downloads.find(dl_url);
+    if (chunk_it == m_chunk_downloads.end())
+    {
+        // cancelled meanwhile
+        QFile::remove(target_file);
+        return;
+    }
+
+    if (file_name.isEmpty())
+    {
+        file_name = dl_url.fileName();
+    }
+    if (error.isEmpty() && file_name.isEmpty())
+    {
+        error = "No installer name in the chunk index";
+    }
+    if (!error.isEmpty())
+    {
+        chunkFailed(dl_url, error);
+        return;
+    }
+    chunk_it->filename = file_name;
+
+    qint64 missing_bytes = 0;
+    for (const auto& range : missing)
+    {
+        missing_bytes += range.second;
+    }
+    qInfo().noquote() << QString("%1: %2 bytes found in local installers, %3 bytes in %4 ranges to fetch")
+        .arg(dl_url.toString()).arg(reused).arg(missing_bytes).arg(missing.size());
+
+    if (missing.isEmpty())
+    {
+        chunksFetched(dl_url);
+        return;
+    }
+
+    // only the missing chunks of the full installer are transferred, scheduled and throttled like any download
+    setMessage(QString("Downloading %1").arg(file_name));
+    chunk_it->fetching = true;
+    auto au_dl = new AuDownloader(dl_url, m_network_session, this);
+    au_dl->setFetchRanges(target_file, missing);
+    au_dl->setMirrorList(m_mirrors);
+    m_downloads.insert(dl_url, au_dl);
+
+    connect(au_dl, &AuDownloader::downloadFinished, this, &AuApplicationData::downloadFinished);
+    connect(au_dl, &AuDownloader::downloadError, this, &AuApplicationData::downloadError);
+    connect(au_dl, &AuDownloader::downloadProgress, this, &AuApplicationData::downloadProgress);
+    connect(au_dl, &AuDownloader::stateChanged, this, &AuApplicationData::downloaderStateChanged);
+
+    auto priority = (m_prefetch_urls.contains(dl_url) && !m_prefetch_requested.contains(dl_url))
+        ? AuDownloadScheduler::Priority::BACKGROUND
+        : AuDownloadScheduler::Priority::USER;
+    m_scheduler->enqueue(au_dl, priority);
+}
+
+void AuApplicationData::chunksFetched(QUrl dl_url)
+{
+    auto chunk_it = m_chunk_downloads.find(dl_url);
+    if (chunk_it == m_chunk_downloads.end())
+    {
+        return;
+    }
+    chunk_it->fetching = false;
+    setMessage(QString("Verifying %1").arg(chunk_it->filename));
+
+    const auto target_file = chunk_it->target_file;
+    const auto algorithms = getDigestAlgorithms(dl_url);
+    QMetaObject::invokeMethod(m_chunk_assembler, [this, dl_url, target_file, algorithms]() {
+        m_chunk_assembler->verify(dl_url, target_file, algorithms);
+    });
+}
+
+void AuApplicationData::chunksVerified(QUrl dl_url, QString target_file, QVariantMap digests, QString error)
+{
+    auto chunk_it = m_chunk_downloads.find(dl_url);
+    if (chunk_it == m_chunk_downloads.end())
+    {
+        QFile::remove(target_file);
+        return;
+    }
+
+    // the assembled installer has to match the full file digests
+    QString failed_digest;
+    if (error.isEmpty() && !verifyDigests(dl_url, digests, failed_digest))
+    {
+        error = failed_digest.isEmpty()
+            ? QString("No checksum to verify assembled %1").arg(chunk_it->filename)
+            : QString("%1 checksum failure for assembled %2").arg(failed_digest, chunk_it->filename);
+    }
+    if (!error.isEmpty())
+    {
+        chunkFailed(dl_url, error);
+        return;
+    }
+
+    const auto filename = chunk_it->filename;
+    m_chunk_downloads.erase(chunk_it);
+    installerAssembled(dl_url, target_file, filename, digests.value(AuDigest::name(AuDigest::Algorithm::SHA1)).toByteArray());
+}
+
+void AuApplicationData::chunkFailed(QUrl dl_url, const QString& error)
+{
+    qWarning().noquote() << QString("Assembling %1 from chunks failed: %2").arg(dl_url.toString(), error);
+    stopChunkDownload(dl_url);
+
+    // fall back to the full installer
+    m_chunk_failed.insert(dl_url);
+    auto priority = (m_prefetch_urls.contains(dl_url) && !m_prefetch_requested.contains(dl_url))
+        ? AuDownloadScheduler::Priority::BACKGROUND
+        : AuDownloadScheduler::Priority::USER;
+    QTimer::singleShot(0, this, [this, dl_url, priority]() {
+        doDownload(dl_url, {}, priority);
+    });
+}
+
+void AuApplicationData::stopChunkDownload(QUrl dl_url)
+{
+    auto chunk_it = m_chunk_downloads.find(dl_url);
+    if (chunk_it == m_chunk_downloads.end())
+    {
+        return;
+    }
+    if (!chunk_it->target_file.isEmpty())
+    {
+        QFile::remove(chunk_it->target_file);
+    }
+    m_chunk_downloads.erase(chunk_it);
+}
+
+void AuApplicationData::manifestChanged(QByteArray etag)
+{
+    if (etag == m_manifest_cache.getETag())
+    {
+        // already known
+        return;
+    }
+    if (m_downloads.contains(QUrl(UPDATE_PORTAL)))
+    {
+        // the running fetch might predate the change, checked again once it is done
+        m_changed_etag = etag;
+        return;
+    }
+
+    qInfo().noquote() << QString("Manifest changed (%1), checking for updates").arg(QString::fromLatin1(etag));
+    update();
+}
+
+void AuApplicationData::downloadError(QUrl dl_url)
+{
+    auto au_dl_it = m_downloads.find(dl_url);
+    if (au_dl_it != m_downloads.end())
+    {
+        auto au_dl = au_dl_it.value();
+        auto error = QString("Download error: %1").arg(au_dl->getError());
+        releaseDownload(au_dl);
+
+        const auto peer_url = m_peer_downloads.take(dl_url);
+        if (!peer_url.isEmpty())
+        {
+            peerFailed(dl_url, peer_url, error);
+            return;
+        }
+
+        if (m_delta_downloads.contains(dl_url))
+        {
+            deltaFailed(dl_url, error);
+            return;
+        }
+
+        if (m_chunk_downloads.contains(dl_url))
+        {
+            chunkFailed(dl_url, error);
+            return;
+        }
+
+        const bool prefetch = m_prefetch_urls.remove(dl_url) > 0;
+        const bool requested = m_prefetch_requested.remove(dl_url);
+        if (prefetch && !requested)
+        {
+            // nobody waits for it, tried again after the next restart
+            qWarning().noquote() << QString("Prefetch of %1 failed: %2").arg(dl_url.toString(), error);
+            m_prefetch_skipped.insert(dl_url);
+            return;
+        }
+
+        setMessage(error);
+        m_update_pipeline->downloadFailed(dl_url, m_message);
+    }
+
+    if ((QUrl(UPDATE_PORTAL) == dl_url))
+    {
+        checkChangedManifest();
+        if (m_manifest_cache.load())
+        {
+            // last known manifest is better than the examples
+            updateJson(m_manifest_cache.getData());
+            return;
+        }
+
+        QStringList update_candidates{ "examples/update.json", "../examples/update.json" };
+        QByteArray json_data;
+        for (const auto& candidate : update_candidates)
+        {
+            QFile uf(candidate);
+            if (uf.open(QIODevice::ReadOnly))
+            {
+                json_data = uf.readAll();
+                updateJson(json_data);
+                break;
+            }
+        }
+    }
+}
+
+void AuApplicationData::checkChangedManifest()
+{
+    const auto etag = m_changed_etag;
+    m_changed_etag.clear();
+    if (etag.isEmpty() || (etag == m_manifest_cache.getETag()))
+    {
+        return;
+    }
+
+    // started from the event loop, the finished downloader still reports its result
+    qInfo().noquote() << QString("Manifest changed (%1) while it was fetched, checking again").arg(QString::fromLatin1(etag));
+    QTimer::singleShot(0, this, [this]() {
+        update();
+    });
+}
+
+void AuApplicationData::downloadProgress(QUrl dl_url, qint64 curr, qint64 max)
+{
+    // coalesced, only the delegate of this url is updated
+    downloadStatus(dl_url)->setProgress(curr, max);
+
+    auto prefetch_it = m_prefetch_urls.find(dl_url);
+    if ((prefetch_it != m_prefetch_urls.end()) && (max > prefetch_it.value()) && !m_prefetch_requested.contains(dl_url))
+    {
+        prefetch_it.value() = max;
+
+        // the store and all running prefetches have to fit into the quota
+        auto reserved = m_installer_store.getTotalSize();
+        for (auto size : m_prefetch_urls)
+        {
+            reserved += size;
+        }
+        if (reserved > m_prefetch_quota)
+        {
+            qInfo().noquote() << QString("Prefetch of %1 stopped, %2 MiB exceed the quota")
+                .arg(dl_url.toString()).arg(reserved / (1024 * 1024));
+            stopPrefetch(dl_url);
+            return;
+        }
+    }
+
+    m_update_pipeline->downloadProgress(dl_url, curr, max);
+}
+
+void AuApplicationData::downloaderStateChanged(QUrl dl_url)
+{
+    auto au_dl_it = m_downloads.find(dl_url);
+    if (au_dl_it == m_downloads.end())
+    {
+        return;
+    }
+
+    if (au_dl_it.value()->getState() == AuDownloader::State::RETRY_PENDING)
+    {
+        downloadStatus(dl_url)->setState("retrying");
+    }
+    else
+    {
+        downloadStatus(dl_url)->setState(AuDownloadScheduler::stateName(m_scheduler->getState(dl_url)));
+    }
+}
+
+bool AuApplicationData::updateJson(const QByteArray& json)
+{
+    // get update json document
+    AuUpdateJson au_json(json);
+
+    const bool valid = au_json.update();
+    if (valid)
+    {
+        m_au_doc = au_json.getDocument();
+        updateBundleMap();
+    }
+    else
+    {
+        // the last good manifest stays in use
+        qWarning().noquote() << QString("Invalid manifest: %1").arg(au_json.getError());
+    }
+
+    updateInstalledSoftware();
+    return valid;
+}
+
+void AuApplicationData::updateInstalledSoftware()
+{
+    // add a custom filter to display only relevant software packages
+    m_sw_enumerator.addFilter([](const SwEntry& sw) { return sw.m_publisher.find("DEWETRON") != std::string::npos; });
+
+    auto sw_entries = m_sw_enumerator.enumerate();
+
+    m_installed_software_internal.clear();
+
+    // create list of installed sw
+    for (const auto& sw_entry : sw_entries)
+    {
+       AuVersionNumber latest_version(getHighestVersionNumber(sw_entry));
+       addToSwList(sw_entry, latest_version);
+    }
+
+    m_installed_software = toVariantList(m_installed_software_internal);
+
+    Q_EMIT updateableAppsChanged();
+
+    prefetchUpdates();
+
+    // the pinned versions might have changed
+    scheduleCompaction();
+}
+
+QList<AuUpdatePipeline::Package> AuApplicationData::getUpdatePackages() const
+{
+    QList<AuUpdatePipeline::Package> packages;
+    for (const auto& app : m_au_doc.m_apps)
+    {
+        // "Update All" does not install new software
+        auto installed = std::any_of(m_installed_software_internal.begin(), m_installed_software_internal.end(),
+            [&app](const SwComponent& sw) { return sw.package_name == app.first; });
+        if (!installed)
+        {
+            continue;
+        }
+
+        // newest version, betas only if they are shown
+        for (const auto& ver : getSortedVersionNumbers(app.first))
+        {
+            auto version_it = app.second.m_app_versions.find(ver.toString().toStdString());
+            if (version_it == app.second.m_app_versions.end())
+            {
+                continue;
+            }
+
+            const auto& app_version = version_it->second;
+            if ((app_version.beta == "1") && !m_show_beta_versions)
+            {
+                continue;
+            }
+
+            if (!app_version.url.empty() && hasUpdate(app.first, ver.toString().toStdString()))
+            {
+                AuUpdatePipeline::Package package;
+                package.url = QUrl(app_version.url.c_str());
+                package.name = app.first.c_str();
+                package.version = app_version.version.c_str();
+                package.stage = AuUpdatePipeline::Stage::PENDING;
+                packages.append(package);
+            }
+            break;
+        }
+    }
+    return packages;
+}
+
+void AuApplicationData::updatePipelineFinished(int done, int manual, int failed)
+{
+    QString message;
+    if (failed > 0)
+    {
+        message = QString("Update finished, %1 of %2 packages failed").arg(failed).arg(done + manual + failed);
+    }
+    else
+    {
+        message = QString("Update finished, %1 packages updated").arg(done);
+    }
+    if (manual > 0)
+    {
+        // downloaded only, nothing was installed for them
+        message += QString(", %1 packages downloaded, install manually").arg(manual);
+    }
+    setMessage(message);
+
+    // show the new versions
+    updateInstalledSoftware();
+}
+
+QList<AuDigest::Algorithm> AuApplicationData::getDigestAlgorithms(QUrl download_url) const
+{
+    // SHA1 keys the installer store, the others are calculated if the manifest lists them
+    QList<AuDigest::Algorithm> algorithms{ AuDigest::Algorithm::SHA1 };
+    auto app_version = findAppVersion(download_url);
+    if (app_version)
+    {
+        for (auto algorithm : AuDigest::supportedAlgorithms())
+        {
+            if (!manifestDigest(*app_version, algorithm).empty() && !algorithms.contains(algorithm))
+            {
+                algorithms.append(algorithm);
+            }
+        }
+    }
+    return algorithms;
+}
+
+bool AuApplicationData::verifyDigests(QUrl download_url, const QVariantMap& digests, QString& failed_digest) const
+{
+    failed_digest.clear();
+    auto app_version = findAppVersion(download_url);
+    if (!app_version)
+    {
+        return false;
+    }
+
+    // every digest the manifest lists has to match
+    int verified = 0;
+    for (auto algorithm : AuDigest::supportedAlgorithms())
+    {
+        const auto expected = QByteArray(manifestDigest(*app_version, algorithm).c_str()).toLower();
+        const auto digest = digests.value(AuDigest::name(algorithm)).toByteArray();
+        if (expected.isEmpty() || digest.isEmpty())
+        {
+            continue;
+        }
+        if (digest.toHex() != expected)
+        {
+            failed_digest = AuDigest::name(algorithm).toUpper();
+            return false;
+        }
+        ++verified;
+    }
+    return verified > 0;
+}
+
 bool AuApplicationData::getShowBetaVersion() const
 {
     return m_show_beta_versions;
@@ -730,6 +2045,140 @@ void AuApplicationData::setShowOlderVersion(bool older_version)
     Q_EMIT updateableAppsChanged();
 }
 
+int AuApplicationData::getMaxConcurrentDownloads() const
+{
+    return m_scheduler->getMaxConcurrent();
+}
+
+void AuApplicationData::setMaxConcurrentDownloads(int max_downloads)
+{
+    m_scheduler->setMaxConcurrent(max_downloads);
+    Q_EMIT maxConcurrentDownloadsChanged();
+}
+
+int AuApplicationData::getBandwidthLimit() const
+{
+    return static_cast<int>(m_scheduler->getBandwidthLimit() / 1024);
+}
+
+void AuApplicationData::setBandwidthLimit(int kbytes_per_second)
+{
+    // 0 = unlimited
+    m_scheduler->setBandwidthLimit(static_cast<qint64>(kbytes_per_second) * 1024);
+    Q_EMIT bandwidthLimitChanged();
+}
+
+bool AuApplicationData::getPrefetchUpdates() const
+{
+    return m_prefetch_updates;
+}
+
+void AuApplicationData::setPrefetchUpdates(bool prefetch)
+{
+    m_prefetch_updates = prefetch;
+    QSettings settings("DEWETRON", "AppUpdate");
+    settings.setValue("prefetch", m_prefetch_updates);
+    Q_EMIT prefetchUpdatesChanged();
+
+    if (m_prefetch_updates)
+    {
+        prefetchUpdates();
+    }
+    else
+    {
+        // prefetches nobody asked for are stopped
+        for (const auto& dl_url : m_prefetch_urls.keys())
+        {
+            if (!m_prefetch_requested.contains(dl_url))
+            {
+                stopPrefetch(dl_url);
+            }
+        }
+    }
+}
+
+int AuApplicationData::getPrefetchQuota() const
+{
+    return static_cast<int>(m_prefetch_quota / (1024 * 1024));
+}
+
+void AuApplicationData::setPrefetchQuota(int mbytes)
+{
+    m_prefetch_quota = static_cast<qint64>(qMax(0, mbytes)) * 1024 * 1024;
+    QSettings settings("DEWETRON", "AppUpdate");
+    settings.setValue("prefetch_quota_mb", getPrefetchQuota());
+    Q_EMIT prefetchQuotaChanged();
+}
+
+bool AuApplicationData::getShareInstallers() const
+{
+    return m_share_installers;
+}
+
+void AuApplicationData::setShareInstallers(bool share)
+{
+    m_share_installers = share;
+    QSettings settings("DEWETRON", "AppUpdate");
+    settings.setValue("peer_sharing", m_share_installers);
+    Q_EMIT shareInstallersChanged();
+
+    if (m_share_installers)
+    {
+        m_peer_share->start();
+    }
+    else
+    {
+        m_peer_share->stop();
+    }
+}
+
+bool AuApplicationData::getExtractArchives() const
+{
+    return m_extract_archives;
+}
+
+void AuApplicationData::setExtractArchives(bool extract)
+{
+    m_extract_archives = extract;
+    QSettings settings("DEWETRON", "AppUpdate");
+    settings.setValue("extract_zip", m_extract_archives);
+    Q_EMIT extractArchivesChanged();
+}
+
+QString AuApplicationData::getLocalRepository() const
+{
+    return m_local_repository;
+}
+
+void AuApplicationData::setLocalRepository(const QString& repository_dir)
+{
+    m_local_repository = QDir::fromNativeSeparators(repository_dir);
+    while (m_local_repository.endsWith("/") && (m_local_repository.size() > 1))
+    {
+        m_local_repository.chop(1);
+    }
+    QSettings settings("DEWETRON", "AppUpdate");
+    settings.setValue("local_repository", m_local_repository);
+    Q_EMIT localRepositoryChanged();
+
+    update();
+}
+
+int AuApplicationData::getInstallerCacheSize() const
+{
+    return static_cast<int>(m_cache_budget / (1024 * 1024));
+}
+
+void AuApplicationData::setInstallerCacheSize(int mbytes)
+{
+    m_cache_budget = static_cast<qint64>(qMax(0, mbytes)) * 1024 * 1024;
+    QSettings settings("DEWETRON", "AppUpdate");
+    settings.setValue("installer_cache_mb", getInstallerCacheSize());
+    Q_EMIT installerCacheSizeChanged();
+
+    scheduleCompaction();
+}
+
 
 #ifdef Q_OS_WIN
 
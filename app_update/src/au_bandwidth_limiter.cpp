@@ -0,0 +1,91 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_bandwidth_limiter.h"
+#include <limits>
+
+namespace
+{
+    constexpr int REFILL_INTERVAL_MS = 100;
+}
+
+AuBandwidthLimiter::AuBandwidthLimiter(QObject* parent)
+    : QObject(parent)
+    , m_rate(0)
+    , m_tokens(0)
+    , m_clock()
+    , m_timer()
+{
+    m_timer.setInterval(REFILL_INTERVAL_MS);
+    connect(&m_timer, &QTimer::timeout, this, &AuBandwidthLimiter::refill);
+}
+
+AuBandwidthLimiter::~AuBandwidthLimiter()
+{
+}
+
+void AuBandwidthLimiter::setRate(qint64 bytes_per_second)
+{
+    m_rate = qMax<qint64>(0, bytes_per_second);
+    m_tokens = 0;
+
+    if (m_rate > 0)
+    {
+        m_clock.start();
+        m_timer.start();
+    }
+    else
+    {
+        m_timer.stop();
+        // readers waiting for tokens continue unthrottled
+        Q_EMIT refilled();
+    }
+}
+
+qint64 AuBandwidthLimiter::getRate() const
+{
+    return m_rate;
+}
+
+qint64 AuBandwidthLimiter::available() const
+{
+    if (m_rate == 0)
+    {
+        return std::numeric_limits<qint64>::max();
+    }
+    return qMax<qint64>(0, m_tokens);
+}
+
+void AuBandwidthLimiter::consume(qint64 bytes)
+{
+    if (m_rate > 0)
+    {
+        m_tokens -= bytes;
+    }
+}
+
+void AuBandwidthLimiter::refill()
+{
+    auto elapsed_ms = m_clock.restart();
+
+    // at most one second worth of burst after an idle period
+    m_tokens = qMin(m_tokens + (m_rate * elapsed_ms) / 1000, m_rate);
+    if (m_tokens > 0)
+    {
+        Q_EMIT refilled();
+    }
+}
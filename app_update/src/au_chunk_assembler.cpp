@@ -0,0 +1,213 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_chunk_assembler.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <memory>
+#include <vector>
+
+AuChunkAssembler::AuChunkAssembler(const QString& cache_dir)
+    : QObject(nullptr)
+    , m_cache_dir(cache_dir)
+    , m_indexes()
+{
+}
+
+AuChunkAssembler::~AuChunkAssembler()
+{
+}
+
+void AuChunkAssembler::assemble(QUrl dl_url, const QByteArray& index_json, const QMap<QByteArray, QString>& sources,
+    const QString& target_file)
+{
+    AuChunkIndex index;
+    if (!index.parse(index_json))
+    {
+        Q_EMIT chunksAssembled(dl_url, target_file, {}, {}, 0, index.getError());
+        return;
+    }
+
+    // where each chunk can be found locally, the first source wins
+    std::vector<std::unique_ptr<QFile>> source_files;
+    QHash<QByteArray, Location> locations;
+    for (auto source_it = sources.begin(); source_it != sources.end(); ++source_it)
+    {
+        AuChunkIndex source_index;
+        if (!loadSource(source_it.key(), source_it.value(), index, source_index))
+        {
+            qWarning().noquote() << source_index.getError();
+            continue;
+        }
+
+        std::unique_ptr<QFile> source_file(new QFile(source_it.value()));
+        if (!source_file->open(QIODevice::ReadOnly))
+        {
+            continue;
+        }
+        const auto source = static_cast<int>(source_files.size());
+        source_files.push_back(std::move(source_file));
+        for (const auto& chunk : source_index.getChunks())
+        {
+            if (!locations.contains(chunk.hash))
+            {
+                locations.insert(chunk.hash, { source, chunk.offset });
+            }
+        }
+    }
+
+    QFile target(target_file);
+    if (!target.open(QIODevice::WriteOnly | QIODevice::Truncate) || !target.resize(index.getSize()))
+    {
+        QFile::remove(target_file);
+        Q_EMIT chunksAssembled(dl_url, target_file, {}, {}, 0,
+            QString("Could not create %1: %2").arg(target_file, target.errorString()));
+        return;
+    }
+
+    QList<AuByteRange> missing;
+    qint64 reused = 0;
+    QByteArray buffer;
+    for (const auto& chunk : index.getChunks())
+    {
+        auto location_it = locations.constFind(chunk.hash);
+        bool found = false;
+        if (location_it != locations.constEnd())
+        {
+            // the local installer might have changed since it was cut
+            auto& source_file = source_files[location_it->source];
+            buffer.resize(static_cast<int>(chunk.size));
+            found = source_file->seek(location_it->offset)
+                && (source_file->read(buffer.data(), chunk.size) == chunk.size)
+                && (AuChunkIndex::hash(buffer.constData(), chunk.size) == chunk.hash);
+        }
+
+        if (found)
+        {
+            if (!target.seek(chunk.offset) || (target.write(buffer.constData(), chunk.size) != chunk.size))
+            {
+                target.close();
+                QFile::remove(target_file);
+                Q_EMIT chunksAssembled(dl_url, target_file, {}, {}, 0,
+                    QString("Could not write %1: %2").arg(target_file, target.errorString()));
+                return;
+            }
+            reused += chunk.size;
+        }
+        else if (!missing.isEmpty() && (missing.last().first + missing.last().second == chunk.offset))
+        {
+            missing.last().second += chunk.size;
+        }
+        else
+        {
+            missing.append({ chunk.offset, chunk.size });
+        }
+    }
+    target.close();
+
+    m_indexes.insert(dl_url, index);
+    Q_EMIT chunksAssembled(dl_url, target_file, index.getName(), missing, reused, {});
+}
+
+void AuChunkAssembler::verify(QUrl dl_url, const QString& target_file, const QList<AuDigest::Algorithm>& algorithms)
+{
+    const auto index = m_indexes.take(dl_url);
+
+    std::vector<std::unique_ptr<AuDigest>> digests;
+    for (auto algorithm : algorithms)
+    {
+        if (AuDigest::isSupported(algorithm))
+        {
+            digests.emplace_back(new AuDigest(algorithm));
+        }
+    }
+
+    QFile target(target_file);
+    if (index.getChunks().isEmpty() || !target.open(QIODevice::ReadOnly) || (target.size() != index.getSize()))
+    {
+        Q_EMIT chunksVerified(dl_url, target_file, {}, QString("Could not verify %1").arg(target_file));
+        return;
+    }
+
+    // every chunk is checked, the digests cover the whole installer
+    QByteArray buffer;
+    for (const auto& chunk : index.getChunks())
+    {
+        buffer.resize(static_cast<int>(chunk.size));
+        if (target.read(buffer.data(), chunk.size) != chunk.size)
+        {
+            Q_EMIT chunksVerified(dl_url, target_file, {},
+                QString("Could not read %1: %2").arg(target_file, target.errorString()));
+            return;
+        }
+        if (AuChunkIndex::hash(buffer.constData(), chunk.size) != chunk.hash)
+        {
+            Q_EMIT chunksVerified(dl_url, target_file, {},
+                QString("Chunk at offset %1 of %2 is corrupt").arg(chunk.offset).arg(target_file));
+            return;
+        }
+        for (auto& digest : digests)
+        {
+            digest->addData(buffer.constData(), chunk.size);
+        }
+    }
+
+    QVariantMap results;
+    for (auto& digest : digests)
+    {
+        results.insert(AuDigest::name(digest->getAlgorithm()), digest->result());
+    }
+    Q_EMIT chunksVerified(dl_url, target_file, results, {});
+}
+
+bool AuChunkAssembler::loadSource(const QByteArray& sha1, const QString& file_name, const AuChunkIndex& index,
+    AuChunkIndex& source_index)
+{
+    const auto cache_file_name = getCacheFileName(sha1);
+    QFile cache_file(cache_file_name);
+    if (cache_file.open(QIODevice::ReadOnly) && source_index.parse(cache_file.readAll())
+        && source_index.isCompatible(index) && (source_index.getSize() == QFileInfo(file_name).size()))
+    {
+        return true;
+    }
+    cache_file.close();
+
+    // cut with the parameters of the new index, kept for the next update
+    source_index = index;
+    if (!source_index.build(file_name))
+    {
+        return false;
+    }
+
+    QDir().mkpath(m_cache_dir);
+    QSaveFile save_file(cache_file_name);
+    if (save_file.open(QIODevice::WriteOnly))
+    {
+        save_file.write(source_index.toJson());
+        save_file.commit();
+    }
+    return true;
+}
+
+QString AuChunkAssembler::getCacheFileName(const QByteArray& sha1) const
+{
+    return m_cache_dir + "/" + QString::fromLatin1(sha1.toLower()) + ".json";
+}
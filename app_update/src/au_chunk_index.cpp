@@ -0,0 +1,309 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_chunk_index.h"
+#include "au_digest.h"
+#include <array>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace
+{
+    constexpr int INDEX_VERSION = 1;
+
+    /**
+     * Defaults of make_chunk_index.py
+     */
+    constexpr qint64 DEFAULT_MIN_SIZE = 16 * 1024;
+    constexpr qint64 DEFAULT_AVG_SIZE = 64 * 1024;
+    constexpr qint64 DEFAULT_MAX_SIZE = 256 * 1024;
+
+    /**
+     * Sane limits for published indexes
+     */
+    constexpr qint64 MIN_AVG_SIZE = 256;
+    constexpr qint64 MAX_CHUNK_SIZE = 64 * 1024 * 1024;
+
+    /**
+     * Normalized chunking: a harder mask before the average size, an easier
+     * one behind it, keeps the chunk sizes close to the average
+     */
+    constexpr int NORMALIZATION_LEVEL = 2;
+
+    constexpr qint64 READ_SIZE = 4 * 1024 * 1024;
+
+    /**
+     * Gear table, splitmix64 starting at 0 as in make_chunk_index.py
+     */
+    const std::array<quint64, 256>& gearTable()
+    {
+        static const std::array<quint64, 256> table = []() {
+            std::array<quint64, 256> gear;
+            quint64 state = 0;
+            for (auto& value : gear)
+            {
+                state += 0x9e3779b97f4a7c15ULL;
+                quint64 z = state;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                value = z ^ (z >> 31);
+            }
+            return gear;
+        }();
+        return table;
+    }
+
+    /**
+     * The gear hash shifts left, its top bits depend on the most bytes
+     */
+    quint64 topBitsMask(int bits)
+    {
+        return ((quint64(1) << bits) - 1) << (64 - bits);
+    }
+
+    int log2(qint64 value)
+    {
+        int bits = 0;
+        while ((qint64(1) << (bits + 1)) <= value)
+        {
+            ++bits;
+        }
+        return bits;
+    }
+}
+
+AuChunkIndex::AuChunkIndex()
+    : m_min_size(DEFAULT_MIN_SIZE)
+    , m_avg_size(DEFAULT_AVG_SIZE)
+    , m_max_size(DEFAULT_MAX_SIZE)
+    , m_mask_small(topBitsMask(log2(DEFAULT_AVG_SIZE) + NORMALIZATION_LEVEL))
+    , m_mask_large(topBitsMask(log2(DEFAULT_AVG_SIZE) - NORMALIZATION_LEVEL))
+    , m_name()
+    , m_size(0)
+    , m_chunks()
+    , m_error()
+{
+}
+
+bool AuChunkIndex::parse(const QByteArray& json)
+{
+    m_chunks.clear();
+    m_size = 0;
+
+    QJsonParseError parse_error;
+    const auto doc = QJsonDocument::fromJson(json, &parse_error);
+    if (parse_error.error != QJsonParseError::NoError)
+    {
+        return fail(QString("Invalid chunk index: %1").arg(parse_error.errorString()));
+    }
+
+    const auto index = doc.object();
+    if ((index["version"].toInt() != INDEX_VERSION) || (index["chunker"].toString() != "fastcdc")
+        || (index["hash"].toString() != "sha256"))
+    {
+        return fail("Unsupported chunk index format");
+    }
+
+    m_min_size = static_cast<qint64>(index["min_size"].toDouble());
+    m_avg_size = static_cast<qint64>(index["avg_size"].toDouble());
+    m_max_size = static_cast<qint64>(index["max_size"].toDouble());
+    if ((m_avg_size < MIN_AVG_SIZE) || (m_avg_size & (m_avg_size - 1)) || (m_min_size <= 0)
+        || (m_min_size > m_avg_size) || (m_avg_size > m_max_size) || (m_max_size > MAX_CHUNK_SIZE))
+    {
+        return fail("Invalid chunk sizes in chunk index");
+    }
+    m_mask_small = topBitsMask(log2(m_avg_size) + NORMALIZATION_LEVEL);
+    m_mask_large = topBitsMask(log2(m_avg_size) - NORMALIZATION_LEVEL);
+
+    // only a file name, never a path
+    m_name = index["name"].toString().section('/', -1).section('\\', -1);
+
+    const auto chunks = index["chunks"].toArray();
+    m_chunks.reserve(chunks.size());
+    for (const auto& chunk_val : chunks)
+    {
+        const auto chunk = chunk_val.toArray();
+        Chunk au_chunk;
+        au_chunk.hash = QByteArray::fromHex(chunk.at(0).toString().toLatin1());
+        au_chunk.offset = m_size;
+        au_chunk.size = static_cast<qint64>(chunk.at(1).toDouble());
+        if ((au_chunk.hash.size() != 32) || (au_chunk.size <= 0) || (au_chunk.size > m_max_size))
+        {
+            m_chunks.clear();
+            return fail("Invalid chunk in chunk index");
+        }
+        m_size += au_chunk.size;
+        m_chunks.append(au_chunk);
+    }
+
+    if (m_size != static_cast<qint64>(index["size"].toDouble()))
+    {
+        m_chunks.clear();
+        return fail("Chunk index does not cover the installer");
+    }
+    m_error.clear();
+    return true;
+}
+
+QByteArray AuChunkIndex::toJson() const
+{
+    QJsonArray chunks;
+    for (const auto& chunk : m_chunks)
+    {
+        chunks.append(QJsonArray{ QString::fromLatin1(chunk.hash.toHex()), static_cast<double>(chunk.size) });
+    }
+
+    QJsonObject index;
+    index["version"] = INDEX_VERSION;
+    index["chunker"] = "fastcdc";
+    index["hash"] = "sha256";
+    index["min_size"] = static_cast<double>(m_min_size);
+    index["avg_size"] = static_cast<double>(m_avg_size);
+    index["max_size"] = static_cast<double>(m_max_size);
+    if (!m_name.isEmpty())
+    {
+        index["name"] = m_name;
+    }
+    index["size"] = static_cast<double>(m_size);
+    index["chunks"] = chunks;
+    return QJsonDocument(index).toJson(QJsonDocument::Compact);
+}
+
+bool AuChunkIndex::build(const QString& file_name)
+{
+    m_chunks.clear();
+    m_name.clear();
+    m_size = 0;
+
+    QFile file(file_name);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return fail(QString("Could not open %1: %2").arg(file_name, file.errorString()));
+    }
+
+    // a chunk never spans more than max_size, keep that much ahead
+    QByteArray buffer;
+    qint64 pos = 0;
+    bool at_end = false;
+    while (true)
+    {
+        if (!at_end && (buffer.size() - pos < m_max_size))
+        {
+            buffer.remove(0, static_cast<int>(pos));
+            pos = 0;
+            auto block = file.read(READ_SIZE);
+            if (block.isEmpty())
+            {
+                if (file.error() != QFileDevice::NoError)
+                {
+                    m_chunks.clear();
+                    return fail(QString("Could not read %1: %2").arg(file_name, file.errorString()));
+                }
+                at_end = true;
+            }
+            buffer.append(block);
+            continue;
+        }
+
+        const auto available = buffer.size() - pos;
+        if (available == 0)
+        {
+            break;
+        }
+
+        const auto data = buffer.constData() + pos;
+        const auto size = cut(reinterpret_cast<const uchar*>(data), available);
+        m_chunks.append({ hash(data, size), m_size, size });
+        m_size += size;
+        pos += size;
+    }
+
+    m_error.clear();
+    return true;
+}
+
+bool AuChunkIndex::isCompatible(const AuChunkIndex& other) const
+{
+    return (m_min_size == other.m_min_size) && (m_avg_size == other.m_avg_size) && (m_max_size == other.m_max_size);
+}
+
+const QList<AuChunkIndex::Chunk>& AuChunkIndex::getChunks() const
+{
+    return m_chunks;
+}
+
+QString AuChunkIndex::getName() const
+{
+    return m_name;
+}
+
+qint64 AuChunkIndex::getSize() const
+{
+    return m_size;
+}
+
+QString AuChunkIndex::getError() const
+{
+    return m_error;
+}
+
+QByteArray AuChunkIndex::hash(const char* data, qint64 length)
+{
+    AuDigest digest(AuDigest::Algorithm::SHA256);
+    digest.addData(data, length);
+    return digest.result();
+}
+
+qint64 AuChunkIndex::cut(const uchar* data, qint64 length) const
+{
+    if (length <= m_min_size)
+    {
+        return length;
+    }
+
+    const auto& gear = gearTable();
+    const auto normal_size = qMin(m_avg_size, length);
+    const auto max_size = qMin(m_max_size, length);
+    quint64 fingerprint = 0;
+    qint64 i = m_min_size;
+
+    for (; i < normal_size; ++i)
+    {
+        fingerprint = (fingerprint << 1) + gear[data[i]];
+        if (!(fingerprint & m_mask_small))
+        {
+            return i + 1;
+        }
+    }
+    for (; i < max_size; ++i)
+    {
+        fingerprint = (fingerprint << 1) + gear[data[i]];
+        if (!(fingerprint & m_mask_large))
+        {
+            return i + 1;
+        }
+    }
+    return max_size;
+}
+
+bool AuChunkIndex::fail(const QString& error)
+{
+    m_error = error;
+    return false;
+}
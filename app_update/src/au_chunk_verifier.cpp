@@ -0,0 +1,256 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_chunk_verifier.h"
+#include "au_digest.h"
+#include <QFile>
+#include <QRunnable>
+#include <QThread>
+#include <functional>
+
+namespace
+{
+    /**
+     * Domain separation of leaves and inner nodes
+     */
+    constexpr char LEAF_PREFIX = 0x00;
+    constexpr char NODE_PREFIX = 0x01;
+
+    constexpr int HASH_SIZE = 32;
+
+    /**
+     * QRunnable::create() is not available before Qt 5.15
+     */
+    class FunctionRunnable : public QRunnable
+    {
+    public:
+        explicit FunctionRunnable(std::function<void()> function)
+            : m_function(std::move(function))
+        {
+        }
+
+        void run() override
+        {
+            m_function();
+        }
+
+    private:
+        std::function<void()> m_function;
+    };
+
+    QByteArray sha256(char prefix, const QByteArray& data)
+    {
+        AuDigest digest(AuDigest::Algorithm::SHA256);
+        digest.addData(&prefix, 1);
+        digest.addData(data);
+        return digest.result();
+    }
+}
+
+AuChunkVerifier::AuChunkVerifier(const QString& file_name, qint64 chunk_size, QObject* parent)
+    : QObject(parent)
+    , m_file_name(file_name)
+    , m_chunk_size(chunk_size)
+    , m_size(-1)
+    , m_chunks()
+    , m_verified_chunks(0)
+    , m_generation(0)
+    , m_pool()
+{
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+}
+
+AuChunkVerifier::~AuChunkVerifier()
+{
+    // the jobs report back to this object
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+bool AuChunkVerifier::setHashes(const QByteArray& leaves, const QByteArray& root)
+{
+    if ((m_chunk_size <= 0) || leaves.isEmpty() || (leaves.size() % HASH_SIZE != 0))
+    {
+        return false;
+    }
+
+    QList<QByteArray> nodes;
+    for (int pos = 0; pos < leaves.size(); pos += HASH_SIZE)
+    {
+        nodes.append(leaves.mid(pos, HASH_SIZE));
+    }
+    if (rootHash(nodes) != root)
+    {
+        return false;
+    }
+
+    m_chunks.clear();
+    for (const auto& hash : nodes)
+    {
+        m_chunks.push_back({ hash, 0, Status::MISSING });
+    }
+    reset();
+    return true;
+}
+
+bool AuChunkVerifier::setSize(qint64 size)
+{
+    const auto chunk_count = (size + m_chunk_size - 1) / m_chunk_size;
+    if (chunk_count != static_cast<qint64>(m_chunks.size()))
+    {
+        return false;
+    }
+    if (m_size != size)
+    {
+        // the last chunk might be complete now
+        m_size = size;
+        addReceived(size, 0);
+    }
+    return true;
+}
+
+void AuChunkVerifier::reset()
+{
+    ++m_generation;
+    for (auto& chunk : m_chunks)
+    {
+        chunk.received = 0;
+        chunk.status = Status::MISSING;
+    }
+    m_verified_chunks = 0;
+}
+
+void AuChunkVerifier::addReceived(qint64 offset, qint64 length)
+{
+    if (m_chunks.empty())
+    {
+        return;
+    }
+
+    // a zero length range only checks the chunk at offset
+    const auto end = offset + length;
+    const auto last = static_cast<int>(qMin<qint64>(static_cast<qint64>(m_chunks.size()) - 1,
+        (length > 0 ? end - 1 : offset) / m_chunk_size));
+    for (auto index = static_cast<int>(qMin<qint64>(offset / m_chunk_size, last)); index <= last; ++index)
+    {
+        auto& chunk = m_chunks[index];
+        const auto chunk_begin = index * m_chunk_size;
+        const auto overlap = qMin(end, chunk_begin + m_chunk_size) - qMax(offset, chunk_begin);
+        if (overlap > 0)
+        {
+            chunk.received += overlap;
+        }
+
+        const auto chunk_length = chunkLength(index);
+        if ((chunk.status == Status::MISSING) && (chunk_length >= 0) && (chunk.received >= chunk_length))
+        {
+            verify(index);
+        }
+    }
+}
+
+qint64 AuChunkVerifier::getVerifiedBytes() const
+{
+    if (m_verified_chunks == static_cast<int>(m_chunks.size()))
+    {
+        return m_size;
+    }
+    return m_verified_chunks * m_chunk_size;
+}
+
+bool AuChunkVerifier::isComplete() const
+{
+    return (m_size >= 0) && (m_verified_chunks == static_cast<int>(m_chunks.size()));
+}
+
+qint64 AuChunkVerifier::chunkLength(int index) const
+{
+    if (index + 1 < static_cast<int>(m_chunks.size()))
+    {
+        return m_chunk_size;
+    }
+    // unknown until the size is
+    return (m_size >= 0) ? (m_size - index * m_chunk_size) : -1;
+}
+
+void AuChunkVerifier::verify(int index)
+{
+    auto& chunk = m_chunks[index];
+    chunk.status = Status::VERIFYING;
+
+    const auto generation = m_generation;
+    const auto file_name = m_file_name;
+    const auto offset = index * m_chunk_size;
+    const auto length = chunkLength(index);
+    const auto hash = chunk.hash;
+    m_pool.start(new FunctionRunnable([this, generation, index, file_name, offset, length, hash]() {
+        QFile file(file_name);
+        bool valid = false;
+        if (file.open(QIODevice::ReadOnly) && file.seek(offset))
+        {
+            const auto data = file.read(length);
+            valid = (data.size() == length) && (sha256(LEAF_PREFIX, data) == hash);
+        }
+        QMetaObject::invokeMethod(this, [this, generation, index, valid]() {
+            chunkChecked(generation, index, valid);
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void AuChunkVerifier::chunkChecked(int generation, int index, bool valid)
+{
+    if (generation != m_generation)
+    {
+        // verified before a reset
+        return;
+    }
+
+    auto& chunk = m_chunks[index];
+    if (!valid)
+    {
+        chunk.received = 0;
+        chunk.status = Status::MISSING;
+        Q_EMIT chunkCorrupt(index * m_chunk_size, chunkLength(index));
+        return;
+    }
+
+    chunk.status = Status::VERIFIED;
+    while ((m_verified_chunks < static_cast<int>(m_chunks.size()))
+        && (m_chunks[m_verified_chunks].status == Status::VERIFIED))
+    {
+        ++m_verified_chunks;
+    }
+    Q_EMIT chunksVerified();
+}
+
+QByteArray AuChunkVerifier::rootHash(QList<QByteArray> nodes)
+{
+    while (nodes.size() > 1)
+    {
+        QList<QByteArray> parents;
+        for (int i = 0; i + 1 < nodes.size(); i += 2)
+        {
+            parents.append(sha256(NODE_PREFIX, nodes[i] + nodes[i + 1]));
+        }
+        if (nodes.size() % 2)
+        {
+            parents.append(nodes.last());
+        }
+        nodes = parents;
+    }
+    return nodes.value(0);
+}
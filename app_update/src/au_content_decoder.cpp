@@ -0,0 +1,240 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_content_decoder.h"
+
+#ifdef AU_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef AU_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+    enum class Encoding
+    {
+        IDENTITY,
+        ZLIB,
+        ZSTD
+    };
+
+    constexpr int OUTPUT_CHUNK_SIZE = 64 * 1024;
+}
+
+struct AuContentDecoder::Impl
+{
+    Encoding encoding = Encoding::IDENTITY;
+    bool stream_end = true;
+#ifdef AU_HAVE_ZLIB
+    z_stream zstream = {};
+    bool zstream_init = false;
+    bool raw_deflate = false;
+    bool first_input = true;
+#endif
+#ifdef AU_HAVE_ZSTD
+    ZSTD_DStream* zstd_stream = nullptr;
+#endif
+
+    void release()
+    {
+#ifdef AU_HAVE_ZLIB
+        if (zstream_init)
+        {
+            inflateEnd(&zstream);
+            zstream_init = false;
+        }
+#endif
+#ifdef AU_HAVE_ZSTD
+        if (zstd_stream)
+        {
+            ZSTD_freeDStream(zstd_stream);
+            zstd_stream = nullptr;
+        }
+#endif
+    }
+
+#ifdef AU_HAVE_ZLIB
+    bool initZlib(bool raw)
+    {
+        if (zstream_init)
+        {
+            inflateEnd(&zstream);
+        }
+        zstream = {};
+        // 15 + 32: zlib or gzip header detection, -15: headerless deflate
+        zstream_init = (inflateInit2(&zstream, raw ? -15 : 15 + 32) == Z_OK);
+        raw_deflate = raw;
+        return zstream_init;
+    }
+
+    bool inflateChunk(const QByteArray& input, QByteArray& output)
+    {
+        zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.constData()));
+        zstream.avail_in = static_cast<uInt>(input.size());
+
+        // a full output buffer means zlib might hold more, even without input left
+        bool output_full = false;
+        while (((zstream.avail_in > 0) || output_full) && !stream_end)
+        {
+            auto out_pos = output.size();
+            output.resize(out_pos + OUTPUT_CHUNK_SIZE);
+            zstream.next_out = reinterpret_cast<Bytef*>(output.data() + out_pos);
+            zstream.avail_out = OUTPUT_CHUNK_SIZE;
+
+            auto ret = inflate(&zstream, Z_NO_FLUSH);
+            output_full = (zstream.avail_out == 0);
+            output.resize(out_pos + OUTPUT_CHUNK_SIZE - static_cast<int>(zstream.avail_out));
+
+            if (ret == Z_STREAM_END)
+            {
+                stream_end = true;
+            }
+            else if (ret == Z_BUF_ERROR)
+            {
+                // no progress possible, waiting for more input
+                break;
+            }
+            else if ((ret == Z_DATA_ERROR) && first_input && !raw_deflate)
+            {
+                // some servers send "deflate" without the zlib header
+                first_input = false;
+                output.resize(out_pos);
+                return initZlib(true) && inflateChunk(input, output);
+            }
+            else if (ret != Z_OK)
+            {
+                return false;
+            }
+            first_input = false;
+        }
+        return true;
+    }
+#endif
+
+#ifdef AU_HAVE_ZSTD
+    bool decompressChunk(const QByteArray& input, QByteArray& output)
+    {
+        ZSTD_inBuffer in_buf = { input.constData(), static_cast<size_t>(input.size()), 0 };
+
+        // decoded blocks are larger than the output buffer, flush until it is not filled up
+        bool output_full = false;
+        while ((in_buf.pos < in_buf.size) || output_full)
+        {
+            auto out_pos = output.size();
+            output.resize(out_pos + OUTPUT_CHUNK_SIZE);
+            ZSTD_outBuffer out_buf = { output.data() + out_pos, OUTPUT_CHUNK_SIZE, 0 };
+
+            auto ret = ZSTD_decompressStream(zstd_stream, &out_buf, &in_buf);
+            output_full = (out_buf.pos == out_buf.size);
+            output.resize(out_pos + static_cast<int>(out_buf.pos));
+            if (ZSTD_isError(ret))
+            {
+                return false;
+            }
+            // 0 means a frame is complete, another one might follow
+            stream_end = (ret == 0);
+        }
+        return true;
+    }
+#endif
+};
+
+AuContentDecoder::AuContentDecoder()
+    : m_impl(new Impl)
+{
+}
+
+AuContentDecoder::~AuContentDecoder()
+{
+    m_impl->release();
+}
+
+QByteArray AuContentDecoder::acceptedEncodings()
+{
+    QByteArray encodings;
+#ifdef AU_HAVE_ZSTD
+    encodings += "zstd, ";
+#endif
+#ifdef AU_HAVE_ZLIB
+    encodings += "gzip, deflate, ";
+#endif
+    encodings.chop(2);
+    return encodings;
+}
+
+bool AuContentDecoder::init(const QByteArray& content_encoding)
+{
+    m_impl->release();
+    m_impl->encoding = Encoding::IDENTITY;
+    m_impl->stream_end = true;
+
+    auto encoding = content_encoding.trimmed().toLower();
+    if (encoding.isEmpty() || (encoding == "identity"))
+    {
+        return true;
+    }
+
+#ifdef AU_HAVE_ZLIB
+    if ((encoding == "gzip") || (encoding == "x-gzip") || (encoding == "deflate"))
+    {
+        m_impl->encoding = Encoding::ZLIB;
+        m_impl->stream_end = false;
+        m_impl->first_input = true;
+        return m_impl->initZlib(false);
+    }
+#endif
+
+#ifdef AU_HAVE_ZSTD
+    if (encoding == "zstd")
+    {
+        m_impl->encoding = Encoding::ZSTD;
+        m_impl->stream_end = false;
+        m_impl->zstd_stream = ZSTD_createDStream();
+        return m_impl->zstd_stream && !ZSTD_isError(ZSTD_initDStream(m_impl->zstd_stream));
+    }
+#endif
+
+    return false;
+}
+
+bool AuContentDecoder::decode(const QByteArray& input, QByteArray& output)
+{
+    switch (m_impl->encoding)
+    {
+    case Encoding::IDENTITY:
+        output.append(input);
+        return true;
+#ifdef AU_HAVE_ZLIB
+    case Encoding::ZLIB:
+        return m_impl->inflateChunk(input, output);
+#endif
+#ifdef AU_HAVE_ZSTD
+    case Encoding::ZSTD:
+        return m_impl->decompressChunk(input, output);
+#endif
+    default:
+        return false;
+    }
+}
+
+bool AuContentDecoder::finish()
+{
+    auto complete = m_impl->stream_end;
+    m_impl->release();
+    return complete;
+}
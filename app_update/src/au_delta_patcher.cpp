@@ -0,0 +1,186 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_delta_patcher.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <memory>
+#include <vector>
+
+#ifdef AU_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+#ifdef AU_HAVE_ZSTD
+    /**
+     * The whole old installer is the reference window of the patch
+     */
+    constexpr int WINDOW_LOG_MAX = (sizeof(size_t) == 8) ? 31 : 30;
+
+    QString applyZstd(QFile& source_file, QFile& patch_file, QFile& target_file,
+        std::vector<std::unique_ptr<AuDigest>>& digests)
+    {
+        auto source_size = source_file.size();
+        const uchar* source_data = (source_size > 0) ? source_file.map(0, source_size) : nullptr;
+        if ((source_size > 0) && !source_data)
+        {
+            return QString("Could not map %1: %2").arg(source_file.fileName(), source_file.errorString());
+        }
+
+        std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        if (!dctx
+            || ZSTD_isError(ZSTD_DCtx_setParameter(dctx.get(), ZSTD_d_windowLogMax, WINDOW_LOG_MAX))
+            || ZSTD_isError(ZSTD_DCtx_refPrefix(dctx.get(), source_data, static_cast<size_t>(source_size))))
+        {
+            return QString("Could not initialize the zstd decoder");
+        }
+
+        std::vector<char> in_buffer(ZSTD_DStreamInSize());
+        std::vector<char> out_buffer(ZSTD_DStreamOutSize());
+        size_t ret = 1;
+
+        while (!patch_file.atEnd())
+        {
+            auto in_size = patch_file.read(in_buffer.data(), static_cast<qint64>(in_buffer.size()));
+            if (in_size < 0)
+            {
+                return QString("Could not read %1: %2").arg(patch_file.fileName(), patch_file.errorString());
+            }
+
+            ZSTD_inBuffer input = { in_buffer.data(), static_cast<size_t>(in_size), 0 };
+            while (input.pos < input.size)
+            {
+                ZSTD_outBuffer output = { out_buffer.data(), out_buffer.size(), 0 };
+                ret = ZSTD_decompressStream(dctx.get(), &output, &input);
+                if (ZSTD_isError(ret))
+                {
+                    return QString("Invalid patch %1: %2").arg(patch_file.fileName(), ZSTD_getErrorName(ret));
+                }
+
+                auto out_size = static_cast<int>(output.pos);
+                if (target_file.write(out_buffer.data(), out_size) != out_size)
+                {
+                    return QString("Could not write %1: %2").arg(target_file.fileName(), target_file.errorString());
+                }
+                for (auto& digest : digests)
+                {
+                    digest->addData(out_buffer.data(), out_size);
+                }
+            }
+        }
+
+        // flush what the decoder still holds
+        while (ret != 0)
+        {
+            ZSTD_inBuffer input = { nullptr, 0, 0 };
+            ZSTD_outBuffer output = { out_buffer.data(), out_buffer.size(), 0 };
+            ret = ZSTD_decompressStream(dctx.get(), &output, &input);
+            if (ZSTD_isError(ret) || (output.pos == 0))
+            {
+                return QString("Truncated patch %1").arg(patch_file.fileName());
+            }
+
+            auto out_size = static_cast<int>(output.pos);
+            if (target_file.write(out_buffer.data(), out_size) != out_size)
+            {
+                return QString("Could not write %1: %2").arg(target_file.fileName(), target_file.errorString());
+            }
+            for (auto& digest : digests)
+            {
+                digest->addData(out_buffer.data(), out_size);
+            }
+        }
+        return {};
+    }
+#endif
+}
+
+AuDeltaPatcher::AuDeltaPatcher()
+{
+}
+
+AuDeltaPatcher::~AuDeltaPatcher()
+{
+}
+
+bool AuDeltaPatcher::isSupported(const QString& format)
+{
+#ifdef AU_HAVE_ZSTD
+    return format == "zstd";
+#else
+    Q_UNUSED(format);
+    return false;
+#endif
+}
+
+void AuDeltaPatcher::apply(QUrl dl_url, const QString& format, const QString& source_file,
+    const QString& patch_file, const QString& target_file, const QList<AuDigest::Algorithm>& algorithms)
+{
+    std::vector<std::unique_ptr<AuDigest>> digests;
+    for (auto algorithm : algorithms)
+    {
+        if (AuDigest::isSupported(algorithm))
+        {
+            digests.emplace_back(new AuDigest(algorithm));
+        }
+    }
+    QString error;
+
+    QFile source(source_file);
+    QFile patch(patch_file);
+    QFile target(target_file);
+
+    if (!isSupported(format))
+    {
+        error = QString("Unsupported patch format %1").arg(format);
+    }
+    else if (!source.open(QIODevice::ReadOnly))
+    {
+        error = QString("Could not open %1: %2").arg(source_file, source.errorString());
+    }
+    else if (!patch.open(QIODevice::ReadOnly))
+    {
+        error = QString("Could not open %1: %2").arg(patch_file, patch.errorString());
+    }
+    else if (!target.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        error = QString("Could not create %1: %2").arg(target_file, target.errorString());
+    }
+#ifdef AU_HAVE_ZSTD
+    else
+    {
+        error = applyZstd(source, patch, target, digests);
+    }
+#endif
+
+    target.close();
+    if (!error.isEmpty())
+    {
+        QFile::remove(target_file);
+        Q_EMIT patchApplied(dl_url, target_file, {}, error);
+        return;
+    }
+
+    QVariantMap results;
+    for (auto& digest : digests)
+    {
+        results.insert(AuDigest::name(digest->getAlgorithm()), digest->result());
+    }
+    Q_EMIT patchApplied(dl_url, target_file, results, {});
+}
@@ -0,0 +1,236 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_digest.h"
+#include <QCryptographicHash>
+
+#ifdef AU_HAVE_OPENSSL
+#include <openssl/evp.h>
+#endif
+#ifdef AU_HAVE_BLAKE3
+#include <blake3.h>
+#endif
+
+namespace
+{
+#ifdef AU_HAVE_BLAKE3_TBB
+    /**
+     * Blocks of at least this size are split across threads
+     */
+    constexpr qint64 BLAKE3_PARALLEL_SIZE = 4 * 1024 * 1024;
+#endif
+
+    QCryptographicHash::Algorithm qtAlgorithm(AuDigest::Algorithm algorithm)
+    {
+        switch (algorithm)
+        {
+        case AuDigest::Algorithm::MD5:
+            return QCryptographicHash::Md5;
+        case AuDigest::Algorithm::SHA256:
+            return QCryptographicHash::Sha256;
+        default:
+            return QCryptographicHash::Sha1;
+        }
+    }
+
+#ifdef AU_HAVE_OPENSSL
+    const EVP_MD* evpAlgorithm(AuDigest::Algorithm algorithm)
+    {
+        switch (algorithm)
+        {
+        case AuDigest::Algorithm::MD5:
+            return EVP_md5();
+        case AuDigest::Algorithm::SHA1:
+            return EVP_sha1();
+        case AuDigest::Algorithm::SHA256:
+            return EVP_sha256();
+        default:
+            return nullptr;
+        }
+    }
+#endif
+}
+
+struct AuDigest::Context
+{
+    explicit Context(Algorithm algorithm)
+        : qt_hash(qtAlgorithm(algorithm))
+#ifdef AU_HAVE_OPENSSL
+        , evp_md(evpAlgorithm(algorithm))
+        , evp_ctx(evp_md ? EVP_MD_CTX_new() : nullptr)
+#endif
+    {
+    }
+
+    ~Context()
+    {
+#ifdef AU_HAVE_OPENSSL
+        if (evp_ctx)
+        {
+            EVP_MD_CTX_free(evp_ctx);
+        }
+#endif
+    }
+
+    QCryptographicHash qt_hash;
+#ifdef AU_HAVE_OPENSSL
+    const EVP_MD* evp_md;
+    EVP_MD_CTX* evp_ctx;
+#endif
+#ifdef AU_HAVE_BLAKE3
+    blake3_hasher blake3;
+#endif
+};
+
+AuDigest::AuDigest(Algorithm algorithm)
+    : m_algorithm(algorithm)
+    , m_context(new Context(algorithm))
+{
+    reset();
+}
+
+AuDigest::~AuDigest()
+{
+}
+
+bool AuDigest::isSupported(Algorithm algorithm)
+{
+#ifdef AU_HAVE_BLAKE3
+    Q_UNUSED(algorithm);
+    return true;
+#else
+    return algorithm != Algorithm::BLAKE3;
+#endif
+}
+
+QList<AuDigest::Algorithm> AuDigest::supportedAlgorithms()
+{
+    QList<Algorithm> algorithms;
+    for (auto algorithm : { Algorithm::MD5, Algorithm::SHA1, Algorithm::SHA256, Algorithm::BLAKE3 })
+    {
+        if (isSupported(algorithm))
+        {
+            algorithms.append(algorithm);
+        }
+    }
+    return algorithms;
+}
+
+QString AuDigest::name(Algorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case Algorithm::MD5:
+        return "md5";
+    case Algorithm::SHA1:
+        return "sha1";
+    case Algorithm::SHA256:
+        return "sha256";
+    case Algorithm::BLAKE3:
+        return "blake3";
+    }
+    return {};
+}
+
+AuDigest::Algorithm AuDigest::getAlgorithm() const
+{
+    return m_algorithm;
+}
+
+void AuDigest::addData(const char* data, qint64 length)
+{
+    if (length <= 0)
+    {
+        return;
+    }
+
+#ifdef AU_HAVE_BLAKE3
+    if (m_algorithm == Algorithm::BLAKE3)
+    {
+#ifdef AU_HAVE_BLAKE3_TBB
+        if (length >= BLAKE3_PARALLEL_SIZE)
+        {
+            blake3_hasher_update_tbb(&m_context->blake3, data, static_cast<size_t>(length));
+            return;
+        }
+#endif
+        blake3_hasher_update(&m_context->blake3, data, static_cast<size_t>(length));
+        return;
+    }
+#endif
+
+#ifdef AU_HAVE_OPENSSL
+    if (m_context->evp_ctx)
+    {
+        EVP_DigestUpdate(m_context->evp_ctx, data, static_cast<size_t>(length));
+        return;
+    }
+#endif
+
+    m_context->qt_hash.addData(data, static_cast<int>(length));
+}
+
+void AuDigest::addData(const QByteArray& data)
+{
+    addData(data.constData(), data.size());
+}
+
+void AuDigest::reset()
+{
+#ifdef AU_HAVE_BLAKE3
+    if (m_algorithm == Algorithm::BLAKE3)
+    {
+        blake3_hasher_init(&m_context->blake3);
+        return;
+    }
+#endif
+
+#ifdef AU_HAVE_OPENSSL
+    if (m_context->evp_ctx)
+    {
+        EVP_DigestInit_ex(m_context->evp_ctx, m_context->evp_md, nullptr);
+        return;
+    }
+#endif
+
+    m_context->qt_hash.reset();
+}
+
+QByteArray AuDigest::result()
+{
+#ifdef AU_HAVE_BLAKE3
+    if (m_algorithm == Algorithm::BLAKE3)
+    {
+        QByteArray digest(BLAKE3_OUT_LEN, Qt::Uninitialized);
+        blake3_hasher_finalize(&m_context->blake3, reinterpret_cast<uint8_t*>(digest.data()), BLAKE3_OUT_LEN);
+        return digest;
+    }
+#endif
+
+#ifdef AU_HAVE_OPENSSL
+    if (m_context->evp_ctx)
+    {
+        QByteArray digest(EVP_MAX_MD_SIZE, Qt::Uninitialized);
+        unsigned int digest_size = 0;
+        EVP_DigestFinal_ex(m_context->evp_ctx, reinterpret_cast<unsigned char*>(digest.data()), &digest_size);
+        digest.resize(static_cast<int>(digest_size));
+        return digest;
+    }
+#endif
+
+    return m_context->qt_hash.result();
+}
@@ -0,0 +1,276 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_download_scheduler.h"
+#include "au_downloader.h"
+
+namespace
+{
+    constexpr int DEFAULT_MAX_CONCURRENT = 2;
+}
+
+AuDownloadScheduler::AuDownloadScheduler(QObject* parent)
+    : QObject(parent)
+    , m_limiter()
+    , m_jobs()
+    , m_max_concurrent(DEFAULT_MAX_CONCURRENT)
+    , m_sequence(0)
+{
+}
+
+AuDownloadScheduler::~AuDownloadScheduler()
+{
+    for (const auto& job : m_jobs)
+    {
+        disconnect(job.downloader, nullptr, this, nullptr);
+        job.downloader->setBandwidthLimiter(nullptr);
+    }
+}
+
+void AuDownloadScheduler::setMaxConcurrent(int max_concurrent)
+{
+    m_max_concurrent = qMax(1, max_concurrent);
+    schedule();
+}
+
+int AuDownloadScheduler::getMaxConcurrent() const
+{
+    return m_max_concurrent;
+}
+
+void AuDownloadScheduler::setBandwidthLimit(qint64 bytes_per_second)
+{
+    m_limiter.setRate(bytes_per_second);
+}
+
+qint64 AuDownloadScheduler::getBandwidthLimit() const
+{
+    return m_limiter.getRate();
+}
+
+void AuDownloadScheduler::enqueue(AuDownloader* downloader, Priority priority)
+{
+    const auto dl_url = downloader->getUrl();
+    auto job_it = m_jobs.find(dl_url);
+    if ((job_it != m_jobs.end()) && (job_it->downloader != downloader))
+    {
+        // a fallback queued while the previous downloader still reports its result
+        disconnect(job_it->downloader, nullptr, this, nullptr);
+        job_it->downloader->setBandwidthLimiter(nullptr);
+    }
+    m_jobs.insert(dl_url, { downloader, priority, State::QUEUED, m_sequence++ });
+
+    downloader->setBandwidthLimiter(&m_limiter);
+    connect(downloader, &AuDownloader::downloadFinished, this, [this, downloader]() { remove(downloader); });
+    connect(downloader, &AuDownloader::downloadError, this, [this, downloader]() { remove(downloader); });
+    connect(downloader, &QObject::destroyed, this, [this, downloader]() { remove(downloader); });
+
+    Q_EMIT stateChanged(dl_url);
+    schedule();
+}
+
+bool AuDownloadScheduler::pause(const QUrl& dl_url)
+{
+    auto job_it = m_jobs.find(dl_url);
+    if ((job_it == m_jobs.end()) || (job_it->state == State::PAUSED))
+    {
+        return false;
+    }
+
+    if (job_it->state == State::RUNNING)
+    {
+        job_it->downloader->abort();
+    }
+    job_it->state = State::PAUSED;
+
+    Q_EMIT stateChanged(dl_url);
+    schedule();
+    return true;
+}
+
+bool AuDownloadScheduler::resume(const QUrl& dl_url)
+{
+    auto job_it = m_jobs.find(dl_url);
+    if ((job_it == m_jobs.end()) || (job_it->state != State::PAUSED))
+    {
+        return false;
+    }
+
+    // back to the end of its priority class
+    job_it->state = State::QUEUED;
+    job_it->sequence = m_sequence++;
+
+    Q_EMIT stateChanged(dl_url);
+    schedule();
+    return true;
+}
+
+bool AuDownloadScheduler::setPriority(const QUrl& dl_url, Priority priority)
+{
+    auto job_it = m_jobs.find(dl_url);
+    if (job_it == m_jobs.end())
+    {
+        return false;
+    }
+
+    job_it->priority = priority;
+    schedule();
+    return true;
+}
+
+AuDownloader* AuDownloadScheduler::cancel(const QUrl& dl_url)
+{
+    auto job_it = m_jobs.find(dl_url);
+    if (job_it == m_jobs.end())
+    {
+        return nullptr;
+    }
+
+    auto downloader = job_it->downloader;
+    disconnect(downloader, nullptr, this, nullptr);
+    downloader->setBandwidthLimiter(nullptr);
+    downloader->abort();
+    downloader->discard();
+    m_jobs.erase(job_it);
+
+    Q_EMIT stateChanged(dl_url);
+    schedule();
+    return downloader;
+}
+
+AuDownloadScheduler::State AuDownloadScheduler::getState(const QUrl& dl_url) const
+{
+    auto job_it = m_jobs.find(dl_url);
+    if (job_it == m_jobs.end())
+    {
+        return State::NONE;
+    }
+    return job_it->state;
+}
+
+QString AuDownloadScheduler::stateName(State state)
+{
+    switch (state)
+    {
+    case State::QUEUED:
+        return "queued";
+    case State::RUNNING:
+        return "running";
+    case State::PAUSED:
+        return "paused";
+    case State::NONE:
+        break;
+    }
+    return {};
+}
+
+void AuDownloadScheduler::schedule()
+{
+    while (auto next = nextQueued())
+    {
+        if ((next->priority == Priority::MANIFEST) || (runningCount() < m_max_concurrent))
+        {
+            startJob(*next);
+            continue;
+        }
+
+        auto candidate = preemptionCandidate();
+        if (!candidate || (candidate->priority <= next->priority))
+        {
+            return;
+        }
+
+        // continues from its .part file once a slot is free again
+        candidate->downloader->abort();
+        candidate->state = State::QUEUED;
+        Q_EMIT stateChanged(candidate->downloader->getUrl());
+
+        startJob(*next);
+    }
+}
+
+void AuDownloadScheduler::startJob(Job& job)
+{
+    job.state = State::RUNNING;
+    Q_EMIT stateChanged(job.downloader->getUrl());
+    job.downloader->start();
+}
+
+void AuDownloadScheduler::remove(AuDownloader* downloader)
+{
+    // the url might be scheduled with another downloader by now
+    auto job_it = m_jobs.begin();
+    while ((job_it != m_jobs.end()) && (job_it->downloader != downloader))
+    {
+        ++job_it;
+    }
+    if (job_it == m_jobs.end())
+    {
+        return;
+    }
+    const auto dl_url = job_it.key();
+
+    disconnect(job_it->downloader, nullptr, this, nullptr);
+    m_jobs.erase(job_it);
+
+    Q_EMIT stateChanged(dl_url);
+    schedule();
+}
+
+int AuDownloadScheduler::runningCount() const
+{
+    int running = 0;
+    for (const auto& job : m_jobs)
+    {
+        if ((job.state == State::RUNNING) && (job.priority != Priority::MANIFEST))
+        {
+            ++running;
+        }
+    }
+    return running;
+}
+
+AuDownloadScheduler::Job* AuDownloadScheduler::nextQueued()
+{
+    Job* next = nullptr;
+    for (auto& job : m_jobs)
+    {
+        if ((job.state == State::QUEUED)
+            && (!next || (job.priority < next->priority)
+                || ((job.priority == next->priority) && (job.sequence < next->sequence))))
+        {
+            next = &job;
+        }
+    }
+    return next;
+}
+
+AuDownloadScheduler::Job* AuDownloadScheduler::preemptionCandidate()
+{
+    // the least important running download, the most recent one of its class
+    Job* candidate = nullptr;
+    for (auto& job : m_jobs)
+    {
+        if ((job.state == State::RUNNING) && (job.priority != Priority::MANIFEST)
+            && (!candidate || (job.priority > candidate->priority)
+                || ((job.priority == candidate->priority) && (job.sequence > candidate->sequence))))
+        {
+            candidate = &job;
+        }
+    }
+    return candidate;
+}
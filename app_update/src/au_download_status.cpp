@@ -0,0 +1,211 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_download_status.h"
+
+namespace
+{
+    /**
+     * At most 10 updates per second reach QML
+     */
+    constexpr int PUBLISH_INTERVAL_MS = 100;
+
+    /**
+     * Weight of the latest interval in the smoothed transfer rate
+     */
+    constexpr double RATE_SMOOTHING = 0.3;
+}
+
+AuDownloadStatus::AuDownloadStatus(QObject* parent)
+    : QObject(parent)
+    , m_curr(0)
+    , m_max(0)
+    , m_published_curr(0)
+    , m_published_max(0)
+    , m_rate_bytes(0)
+    , m_bytes_per_second(0)
+    , m_rate_clock()
+    , m_publish_timer()
+    , m_dirty(false)
+    , m_state()
+    , m_stage()
+    , m_finished(false)
+    , m_ready(false)
+{
+    m_publish_timer.setSingleShot(true);
+    m_publish_timer.setInterval(PUBLISH_INTERVAL_MS);
+    connect(&m_publish_timer, &QTimer::timeout, this, &AuDownloadStatus::publish);
+}
+
+AuDownloadStatus::~AuDownloadStatus()
+{
+}
+
+void AuDownloadStatus::setProgress(qint64 curr, qint64 max)
+{
+    m_curr = curr;
+    m_max = max;
+    m_dirty = true;
+
+    if (!m_publish_timer.isActive())
+    {
+        // the first update is shown right away, later ones are coalesced
+        publish();
+    }
+}
+
+void AuDownloadStatus::setState(const QString& state)
+{
+    if (state == m_state)
+    {
+        return;
+    }
+
+    if (state == "running")
+    {
+        // a resumed download starts with the bytes already on disk
+        resetRate();
+    }
+    m_state = state;
+    Q_EMIT stateChanged();
+}
+
+void AuDownloadStatus::setStage(const QString& stage)
+{
+    if (stage != m_stage)
+    {
+        m_stage = stage;
+        Q_EMIT stageChanged();
+    }
+}
+
+void AuDownloadStatus::setFinished(bool finished)
+{
+    if (m_dirty)
+    {
+        publish();
+    }
+
+    if (finished != m_finished)
+    {
+        m_finished = finished;
+        if (m_finished)
+        {
+            m_bytes_per_second = 0;
+        }
+        Q_EMIT finishedChanged();
+    }
+}
+
+void AuDownloadStatus::setReady(bool ready)
+{
+    if (ready != m_ready)
+    {
+        m_ready = ready;
+        Q_EMIT readyChanged();
+    }
+}
+
+int AuDownloadStatus::getProgress() const
+{
+    if (m_published_max <= 0)
+    {
+        return 0;
+    }
+    return static_cast<int>((100 * m_published_curr) / m_published_max);
+}
+
+qint64 AuDownloadStatus::getBytesReceived() const
+{
+    return m_published_curr;
+}
+
+qint64 AuDownloadStatus::getBytesTotal() const
+{
+    return m_published_max;
+}
+
+qint64 AuDownloadStatus::getBytesPerSecond() const
+{
+    return m_bytes_per_second;
+}
+
+int AuDownloadStatus::getEta() const
+{
+    if ((m_bytes_per_second <= 0) || (m_published_max <= 0))
+    {
+        return -1;
+    }
+    return static_cast<int>((m_published_max - m_published_curr + m_bytes_per_second - 1) / m_bytes_per_second);
+}
+
+QString AuDownloadStatus::getState() const
+{
+    return m_state;
+}
+
+QString AuDownloadStatus::getStage() const
+{
+    return m_stage;
+}
+
+bool AuDownloadStatus::isFinished() const
+{
+    return m_finished;
+}
+
+bool AuDownloadStatus::isReady() const
+{
+    return m_ready;
+}
+
+void AuDownloadStatus::publish()
+{
+    if (!m_dirty)
+    {
+        return;
+    }
+    m_dirty = false;
+
+    if (!m_rate_clock.isValid() || (m_curr < m_rate_bytes))
+    {
+        // first sample or the download started over
+        m_rate_clock.start();
+        m_rate_bytes = m_curr;
+    }
+    else if (m_rate_clock.elapsed() >= PUBLISH_INTERVAL_MS)
+    {
+        auto current_rate = (1000 * (m_curr - m_rate_bytes)) / m_rate_clock.restart();
+        m_bytes_per_second = (m_bytes_per_second == 0)
+            ? current_rate
+            : static_cast<qint64>(RATE_SMOOTHING * current_rate + (1.0 - RATE_SMOOTHING) * m_bytes_per_second);
+        m_rate_bytes = m_curr;
+    }
+
+    m_published_curr = m_curr;
+    m_published_max = m_max;
+    Q_EMIT progressChanged();
+
+    // trailing update for data arriving until then
+    m_publish_timer.start();
+}
+
+void AuDownloadStatus::resetRate()
+{
+    m_rate_clock.invalidate();
+    m_bytes_per_second = 0;
+}
@@ -16,61 +16,1582 @@
  */
 
 #include "au_downloader.h"
+#include "au_bandwidth_limiter.h"
+#include "au_chunk_verifier.h"
+#include "au_hash_worker.h"
+#include "au_mirror_list.h"
+#include "au_network_session.h"
+#include "au_range_fetcher.h"
+#include "au_zip_extractor.h"
+#include <algorithm>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QNetworkRequest>
 #include <QMetaEnum>
+#include <QRandomGenerator>
+#include <QSaveFile>
 
-AuDownloader::AuDownloader(QUrl dl_url, QObject* parent)
+namespace
+{
+    /**
+     * Network read chunk size. Also limits the amount of data buffered by the
+     * reply, keeping memory usage small for streamed downloads.
+     */
+    constexpr qint64 CHUNK_SIZE = 1024 * 1024;
+    constexpr qint64 READ_BUFFER_SIZE = 4 * CHUNK_SIZE;
+
+    /**
+     * Persist the resume journal every JOURNAL_INTERVAL bytes
+     */
+    constexpr qint64 JOURNAL_INTERVAL = 16 * CHUNK_SIZE;
+
+    /**
+     * Smaller files are not worth splitting into segments
+     */
+    constexpr qint64 MIN_SEGMENTED_SIZE = 32 * CHUNK_SIZE;
+
+    /**
+     * Time allowed for the response headers, the first body byte and
+     * between data while receiving
+     */
+    constexpr qint64 CONNECT_TIMEOUT_MS = 20000;
+    constexpr qint64 FIRST_BYTE_TIMEOUT_MS = 30000;
+    constexpr qint64 STALL_TIMEOUT_MS = 30000;
+    constexpr int WATCHDOG_INTERVAL_MS = 1000;
+
+    /**
+     * Failed transfers are retried DEFAULT_MAX_RETRIES times, waiting
+     * RETRY_BASE_DELAY_MS * 2^n (at most RETRY_MAX_DELAY_MS) minus up to
+     * half of it as jitter. Retries which made progress reset the count.
+     */
+    constexpr int DEFAULT_MAX_RETRIES = 5;
+    constexpr int RETRY_BASE_DELAY_MS = 2000;
+    constexpr int RETRY_MAX_DELAY_MS = 120000;
+
+    /**
+     * Corrupt chunks fetched again before the download fails
+     */
+    constexpr int MAX_CHUNK_REPAIRS = 16;
+
+    bool isRetryable(QNetworkReply::NetworkError error, int http_status)
+    {
+        if ((http_status == 408) || (http_status == 429) || (http_status >= 500))
+        {
+            return true;
+        }
+        switch (error)
+        {
+        case QNetworkReply::ConnectionRefusedError:
+        case QNetworkReply::RemoteHostClosedError:
+        case QNetworkReply::HostNotFoundError:
+        case QNetworkReply::TimeoutError:
+        case QNetworkReply::TemporaryNetworkFailureError:
+        case QNetworkReply::NetworkSessionFailedError:
+        case QNetworkReply::ProxyConnectionRefusedError:
+        case QNetworkReply::ProxyConnectionClosedError:
+        case QNetworkReply::ProxyTimeoutError:
+        case QNetworkReply::UnknownNetworkError:
+        case QNetworkReply::ServiceUnavailableError:
+        case QNetworkReply::InternalServerError:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    QString partFileName(const QUrl& dl_url, const QString& dest_dir)
+    {
+        auto url_hash = QCryptographicHash::hash(dl_url.toEncoded(), QCryptographicHash::Md5).toHex();
+        return dest_dir + "/AppUpdate_" + QString::fromLatin1(url_hash) + ".part";
+    }
+
+    /**
+     * The body of a non-2xx answer is an error page, not content
+     */
+    bool hasErrorStatus(const QNetworkReply* reply)
+    {
+        const auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+        return status.isValid() && ((status.toInt() < 200) || (status.toInt() >= 300));
+    }
+
+    QString fileNameFromReply(const QNetworkReply* reply)
+    {
+        // Content-Disposition --- "attachment; filename=\"DEWETRON_Oxygen_Setup_R5.2.0_x64.zip\""
+        auto content_disp = reply->header(QNetworkRequest::KnownHeaders::ContentDispositionHeader).toString();
+        QString filename = content_disp.remove("attachment; filename=");
+        filename.remove('\"');
+        return filename;
+    }
+}
+
+AuDownloader::AuDownloader(QUrl dl_url, AuNetworkSession* session, QObject* parent)
+    : AuDownloader(dl_url, QString(), session, parent)
+{
+}
+
+AuDownloader::AuDownloader(QUrl dl_url, const QString& dest_dir, AuNetworkSession* session, QObject* parent)
     : QObject(parent)
     , m_dl_url(dl_url)
-    , m_net_access()
+    , m_transfer_url(dl_url)
+    , m_request_url(dl_url)
+    , m_dest_dir(dest_dir)
+    , m_session(session)
+    , m_limiter(nullptr)
+    , m_mirrors(nullptr)
+    , m_mirror_switched(false)
+    , m_state(State::IDLE)
+    , m_watchdog_timer()
+    , m_activity_clock()
+    , m_retry_timer()
+    , m_retry_count(0)
+    , m_max_retries(DEFAULT_MAX_RETRIES)
+    , m_retry_bytes(0)
+    , m_reply(nullptr)
+    , m_probe_reply(nullptr)
+    , m_request_headers()
+    , m_not_modified(false)
+    , m_decoder()
+    , m_transfer_size(0)
     , m_downloaded_data()
+    , m_part_file()
+    , m_segment_count(1)
+    , m_segments()
+    , m_total_size(0)
+    , m_hashed(0)
+    , m_offset(0)
+    , m_bytes_received(0)
+    , m_journal_bytes(0)
+    , m_etag()
+    , m_last_modified()
+    , m_filename()
+    , m_file_error()
+    , m_timeout_error()
+    , m_algorithms({ AuDigest::Algorithm::MD5, AuDigest::Algorithm::SHA1 })
+    , m_hash_threads()
+    , m_digests()
+    , m_extract_dir()
+    , m_extract_thread()
+    , m_extract_finished(false)
+    , m_extracted(false)
+    , m_extract_error()
+    , m_chunk_hashes_url()
+    , m_chunk_size(0)
+    , m_chunk_root()
+    , m_hashes_reply(nullptr)
+    , m_chunk_verifier()
+    , m_repairs()
+    , m_repair_count(0)
+    , m_ranges_file()
+    , m_fetch_ranges()
+    , m_range_fetcher(nullptr)
+    , m_transfer_complete(false)
     , m_error()
     , m_ssl_errors()
 {
-    connect(&m_net_access, &QNetworkAccessManager::finished, this, &AuDownloader::fileDownloaded);
+    m_watchdog_timer.setInterval(WATCHDOG_INTERVAL_MS);
+    connect(&m_watchdog_timer, &QTimer::timeout, this, &AuDownloader::checkTimeout);
+    m_retry_timer.setSingleShot(true);
+    connect(&m_retry_timer, &QTimer::timeout, this, &AuDownloader::startTransfer);
+}
+
+AuDownloader::~AuDownloader()
+{
+    // an unfinished download is kept for resuming later
+    abort();
+    for (const auto& hash_thread : m_hash_threads)
+    {
+        hash_thread->quit();
+        hash_thread->wait();
+    }
+    if (m_extract_thread)
+    {
+        m_extract_thread->quit();
+        m_extract_thread->wait();
+    }
+}
+
+void AuDownloader::start()
+{
+    m_retry_count = 0;
+    m_retry_bytes = isStreaming() ? m_bytes_received : 0;
+    m_repair_count = 0;
+    startTransfer();
+}
+
+void AuDownloader::startTransfer()
+{
+    startHashWorkers();
+    m_digests.clear();
+    m_extract_finished = false;
+    m_extracted = false;
+    m_extract_error.clear();
+    m_error = QNetworkReply::NoError;
+    m_timeout_error.clear();
+    m_request_url = m_mirrors ? m_mirrors->map(m_transfer_url) : m_transfer_url;
+    m_transfer_complete = false;
+
+    if (!m_fetch_ranges.isEmpty())
+    {
+        startRangeFetch();
+        return;
+    }
+
+    if (!m_chunk_hashes_url.isEmpty())
+    {
+        // the leaves of the hash tree come first
+        fetchChunkHashes();
+        return;
+    }
+
+    if (isStreaming() && (m_segment_count > 1))
+    {
+        // size, range support and validator decide about segmenting
+        m_probe_reply = m_session->head(m_session->createRequest(m_request_url));
+        watchReply(m_probe_reply);
+        requestStarted();
+        return;
+    }
+
+    startSingle();
+}
+
+void AuDownloader::abort()
+{
+    m_watchdog_timer.stop();
+    m_retry_timer.stop();
+    if (m_hashes_reply)
+    {
+        disconnect(m_hashes_reply, nullptr, this, nullptr);
+        m_hashes_reply->abort();
+        m_hashes_reply->deleteLater();
+        m_hashes_reply = nullptr;
+    }
+    for (auto repair : m_repairs)
+    {
+        disconnect(repair, nullptr, this, nullptr);
+        repair->abort();
+        repair->deleteLater();
+    }
+    m_repairs.clear();
+    if (m_range_fetcher)
+    {
+        disconnect(m_range_fetcher, nullptr, this, nullptr);
+        m_range_fetcher->abort();
+        m_range_fetcher->deleteLater();
+        m_range_fetcher = nullptr;
+    }
+    m_transfer_complete = false;
+    if (m_probe_reply)
+    {
+        disconnect(m_probe_reply, nullptr, this, nullptr);
+        m_probe_reply->abort();
+        m_probe_reply->deleteLater();
+        m_probe_reply = nullptr;
+    }
+    if (m_reply)
+    {
+        disconnect(m_reply, nullptr, this, nullptr);
+        m_reply->abort();
+        m_reply->deleteLater();
+        m_reply = nullptr;
+    }
+    abortSegments();
+
+    if (m_part_file.isOpen())
+    {
+        m_part_file.close();
+        writeJournal();
+    }
+
+    if (isStreaming())
+    {
+        // start() hashes the data on disk again
+        Q_EMIT hashReset();
+        if (m_chunk_verifier)
+        {
+            m_chunk_verifier->reset();
+            m_hashed = 0;
+        }
+    }
+    setState(State::IDLE);
+}
+
+void AuDownloader::setSegmentCount(int segments)
+{
+    m_segment_count = qMax(1, segments);
+}
+
+void AuDownloader::setRequestHeader(const QByteArray& name, const QByteArray& value)
+{
+    m_request_headers.append({ name, value });
+}
+
+void AuDownloader::setTransferUrl(const QUrl& transfer_url)
+{
+    m_transfer_url = transfer_url;
+}
+
+void AuDownloader::setBandwidthLimiter(AuBandwidthLimiter* limiter)
+{
+    if (m_limiter)
+    {
+        disconnect(m_limiter, nullptr, this, nullptr);
+    }
+    m_limiter = limiter;
+    if (m_limiter)
+    {
+        connect(m_limiter, &AuBandwidthLimiter::refilled, this, &AuDownloader::readPending);
+    }
+    if (m_range_fetcher)
+    {
+        m_range_fetcher->setBandwidthLimiter(m_limiter);
+    }
+    for (auto repair : m_repairs)
+    {
+        repair->setBandwidthLimiter(m_limiter);
+    }
+}
+
+void AuDownloader::setDigests(const QList<AuDigest::Algorithm>& algorithms)
+{
+    m_algorithms.clear();
+    for (auto algorithm : algorithms)
+    {
+        if (AuDigest::isSupported(algorithm) && !m_algorithms.contains(algorithm))
+        {
+            m_algorithms.append(algorithm);
+        }
+    }
+}
+
+void AuDownloader::startHashWorkers()
+{
+    if (!isStreaming() || !m_hash_threads.empty())
+    {
+        return;
+    }
+
+    // one thread per algorithm, all of them see the same chunks
+    for (auto algorithm : m_algorithms)
+    {
+        auto hash_worker = new AuHashWorker(algorithm);
+        std::unique_ptr<QThread> hash_thread(new QThread);
+        hash_worker->moveToThread(hash_thread.get());
+        connect(hash_thread.get(), &QThread::finished, hash_worker, &QObject::deleteLater);
+        connect(this, &AuDownloader::hashFile, hash_worker, &AuHashWorker::addFile);
+        connect(this, &AuDownloader::hashData, hash_worker, &AuHashWorker::addData);
+        connect(this, &AuDownloader::hashReset, hash_worker, &AuHashWorker::reset);
+        connect(this, &AuDownloader::hashFinish, hash_worker, &AuHashWorker::finish);
+        connect(hash_worker, &AuHashWorker::hashReady, this, [this, algorithm](QByteArray digest) {
+            hashReady(algorithm, digest);
+        });
+        hash_thread->start();
+        m_hash_threads.push_back(std::move(hash_thread));
+    }
+
+    if (!m_extract_dir.isEmpty())
+    {
+        auto extractor = new AuZipExtractor(m_extract_dir);
+        m_extract_thread.reset(new QThread);
+        extractor->moveToThread(m_extract_thread.get());
+        connect(m_extract_thread.get(), &QThread::finished, extractor, &QObject::deleteLater);
+        connect(this, &AuDownloader::hashFile, extractor, &AuZipExtractor::addFile);
+        connect(this, &AuDownloader::hashData, extractor, &AuZipExtractor::addData);
+        connect(this, &AuDownloader::hashReset, extractor, &AuZipExtractor::reset);
+        connect(this, &AuDownloader::hashFinish, extractor, &AuZipExtractor::finish);
+        connect(extractor, &AuZipExtractor::extractFinished, this, &AuDownloader::extractFinished);
+        m_extract_thread->start();
+    }
+}
+
+void AuDownloader::setMirrorList(AuMirrorList* mirrors)
+{
+    m_mirrors = mirrors;
+}
+
+void AuDownloader::setExtractDir(const QString& staging_dir)
+{
+    if (isStreaming() && AuZipExtractor::isSupported())
+    {
+        m_extract_dir = staging_dir;
+    }
+}
+
+QString AuDownloader::getExtractDir() const
+{
+    return m_extract_dir;
+}
+
+bool AuDownloader::isExtracted() const
+{
+    return m_extracted;
+}
+
+QString AuDownloader::getExtractError() const
+{
+    return m_extract_error;
+}
+
+void AuDownloader::setChunkHashes(const QUrl& hashes_url, qint64 chunk_size, const QByteArray& root)
+{
+    if (isStreaming() && (chunk_size > 0) && !root.isEmpty())
+    {
+        m_chunk_hashes_url = hashes_url;
+        m_chunk_size = chunk_size;
+        m_chunk_root = root;
+    }
+}
+
+void AuDownloader::setFetchRanges(const QString& file_name, const QList<AuByteRange>& ranges)
+{
+    m_ranges_file = file_name;
+    m_fetch_ranges = ranges;
+}
+
+void AuDownloader::startRangeFetch()
+{
+    // the fetcher retries and fails over on its own, all ranges are requested again after a pause
+    m_range_fetcher = new AuRangeFetcher(m_transfer_url, m_ranges_file, m_session, this);
+    m_range_fetcher->setMirrorList(m_mirrors);
+    m_range_fetcher->setBandwidthLimiter(m_limiter);
+    connect(m_range_fetcher, &AuRangeFetcher::fetchProgress, this, [this](QUrl, qint64 curr, qint64 max)
+    {
+        m_transfer_size = curr;
+        setState(State::RECEIVING);
+        Q_EMIT downloadProgress(m_dl_url, curr, max);
+    });
+    connect(m_range_fetcher, &AuRangeFetcher::fetchFinished, this, [this]()
+    {
+        m_transfer_size = m_range_fetcher->getTransferSize();
+        m_range_fetcher->deleteLater();
+        m_range_fetcher = nullptr;
+        setState(State::FINISHED);
+        Q_EMIT downloadFinished(m_dl_url, QString());
+    });
+    connect(m_range_fetcher, &AuRangeFetcher::fetchError, this, [this]()
+    {
+        // already retried per request, e.g. a server without range support is final
+        m_file_error = m_range_fetcher->getError();
+        abort();
+        m_error = QNetworkReply::UnknownNetworkError;
+        fail(0);
+    });
+    setState(State::CONNECTING);
+    m_range_fetcher->start(m_fetch_ranges);
+}
+
+void AuDownloader::setMaxRetries(int retries)
+{
+    m_max_retries = qMax(0, retries);
+}
+
+void AuDownloader::watchReply(QNetworkReply* reply)
+{
+    // the session is shared, only handle our own replies
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() { fileDownloaded(reply); });
+    connect(reply, &QNetworkReply::sslErrors, this, &AuDownloader::sslErrors);
+}
+
+void AuDownloader::requestStarted()
+{
+    m_activity_clock.start();
+    m_watchdog_timer.start();
+    setState(State::CONNECTING);
+}
+
+void AuDownloader::setState(State state)
+{
+    if (state != m_state)
+    {
+        m_state = state;
+        Q_EMIT stateChanged(m_dl_url);
+    }
+}
+
+void AuDownloader::limitReadBuffer(QNetworkReply* reply)
+{
+    if (isStreaming() || m_limiter)
+    {
+        // unread data stalls the connection instead of filling the memory
+        reply->setReadBufferSize(READ_BUFFER_SIZE);
+    }
+}
+
+void AuDownloader::startSingle()
+{
+    if (!isStreaming())
+    {
+        // a retry must not continue the compressed stream of the failed attempt
+        m_decoder.init({});
+        m_downloaded_data.clear();
+        m_transfer_size = 0;
+        m_not_modified = false;
+    }
+
+    auto request = m_session->createRequest(m_request_url);
+    for (const auto& header : m_request_headers)
+    {
+        request.setRawHeader(header.first, header.second);
+    }
+
+    if (isStreaming())
+    {
+        // offsets and digests refer to the file itself
+        request.setRawHeader("Accept-Encoding", "identity");
+    }
+    else if (!AuContentDecoder::acceptedEncodings().isEmpty())
+    {
+        // decoded by m_decoder, Qt leaves the body untouched then
+        request.setRawHeader("Accept-Encoding", AuContentDecoder::acceptedEncodings());
+    }
+
+    if (isStreaming())
+    {
+        if (!openPartFile())
+        {
+            // nothing to write to, the transfer would be in vain
+            m_file_error = QString("Could not create %1").arg(m_part_file.fileName());
+            m_error = QNetworkReply::UnknownContentError;
+            fail(0);
+            return;
+        }
+        else
+        {
+            // a segmented journal continues with its contiguous part
+            m_segments.clear();
+            m_part_file.resize(m_offset);
+            m_part_file.seek(m_offset);
+            m_bytes_received = m_offset;
+            m_journal_bytes = m_offset;
+            if (m_chunk_verifier)
+            {
+                m_chunk_verifier->reset();
+                m_hashed = 0;
+            }
+
+            if (m_offset > 0)
+            {
+                // the server only honors the range if the file did not change
+                request.setRawHeader("Range", "bytes=" + QByteArray::number(m_offset) + "-");
+                if (!m_mirror_switched)
+                {
+                    request.setRawHeader("If-Range", m_etag.isEmpty() ? m_last_modified : m_etag);
+                }
+
+                // bring the digests up to date with the data already on disk
+                if (m_chunk_verifier)
+                {
+                    receivedChunk(0, m_offset);
+                }
+                else
+                {
+                    Q_EMIT hashFile(m_part_file.fileName(), 0, m_offset);
+                }
+            }
+        }
+    }
+
+    m_reply = m_session->get(request);
+    watchReply(m_reply);
+    requestStarted();
+    limitReadBuffer(m_reply);
+    connect(m_reply, &QNetworkReply::metaDataChanged, this, &AuDownloader::responseHeaders);
+    connect(m_reply, &QNetworkReply::readyRead, this, &AuDownloader::dataAvailable);
+    connect(m_reply, &QNetworkReply::downloadProgress, this, &AuDownloader::dlProgress);
+}
+
+void AuDownloader::startSegmented(qint64 size, const QByteArray& etag, const QByteArray& last_modified)
+{
+    if (!openPartFile())
+    {
+        m_file_error = QString("Could not create %1").arg(m_part_file.fileName());
+        m_error = QNetworkReply::UnknownContentError;
+        fail(0);
+        return;
+    }
+
+    // a single stream journal has no size, its validator is sufficient.
+    // Mirrors have their own validators, the digests check the content then.
+    bool same_file = ((m_total_size == 0) || (m_total_size == size))
+        && (m_mirror_switched || ((m_etag == etag) && (m_last_modified == last_modified)));
+    if (!same_file)
+    {
+        m_segments.clear();
+        m_offset = 0;
+    }
+    m_total_size = size;
+    m_etag = etag;
+    m_last_modified = last_modified;
+    if (m_chunk_verifier && !m_chunk_verifier->setSize(m_total_size))
+    {
+        dropChunkVerifier();
+    }
+
+    if (m_segments.empty())
+    {
+        // bytes before m_offset are already there (e.g. from a single stream journal)
+        if (m_offset > 0)
+        {
+            m_segments.push_back({ 0, m_offset, m_offset, nullptr });
+        }
+        auto segment_size = (m_total_size - m_offset + m_segment_count - 1) / m_segment_count;
+        for (qint64 begin = m_offset; begin < m_total_size; begin += segment_size)
+        {
+            m_segments.push_back({ begin, qMin(begin + segment_size, m_total_size), 0, nullptr });
+        }
+    }
+
+    // preallocate the destination file
+    if (!m_part_file.resize(m_total_size))
+    {
+        m_file_error = QString("Could not allocate %1: %2").arg(m_part_file.fileName(), m_part_file.errorString());
+        m_error = QNetworkReply::UnknownContentError;
+        m_part_file.close();
+        fail(0);
+        return;
+    }
+
+    m_bytes_received = 0;
+    for (const auto& segment : m_segments)
+    {
+        m_bytes_received += segment.received;
+    }
+    m_journal_bytes = m_bytes_received;
+
+    Q_EMIT hashReset();
+    if (m_chunk_verifier)
+    {
+        // the digests follow the verified chunks
+        m_chunk_verifier->reset();
+        m_hashed = 0;
+        for (const auto& segment : m_segments)
+        {
+            receivedChunk(segment.begin, segment.received);
+        }
+    }
+    else
+    {
+        m_hashed = contiguousBytes();
+        if (m_hashed > 0)
+        {
+            Q_EMIT hashFile(m_part_file.fileName(), 0, m_hashed);
+        }
+    }
+
+    for (auto& segment : m_segments)
+    {
+        if (segment.received < (segment.end - segment.begin))
+        {
+            requestSegment(segment);
+        }
+    }
+    writeJournal();
+
+    if (m_bytes_received == m_total_size)
+    {
+        // everything was already there
+        m_part_file.close();
+        QFile::remove(getJournalFileName());
+        transferComplete();
+    }
+}
+
+void AuDownloader::requestSegment(Segment& segment)
+{
+    auto range = QString("bytes=%1-%2").arg(segment.begin + segment.received).arg(segment.end - 1);
+
+    auto request = m_session->createRequest(m_request_url);
+    request.setRawHeader("Range", range.toLatin1());
+    if (!m_mirror_switched)
+    {
+        request.setRawHeader("If-Range", m_etag.isEmpty() ? m_last_modified : m_etag);
+    }
+
+    segment.reply = m_session->get(request);
+    watchReply(segment.reply);
+    requestStarted();
+    limitReadBuffer(segment.reply);
+    connect(segment.reply, &QNetworkReply::metaDataChanged, this, &AuDownloader::responseHeaders);
+    connect(segment.reply, &QNetworkReply::readyRead, this, &AuDownloader::dataAvailable);
+}
+
+void AuDownloader::abortSegments()
+{
+    for (auto& segment : m_segments)
+    {
+        if (segment.reply)
+        {
+            auto reply = segment.reply;
+            segment.reply = nullptr;
+            disconnect(reply, nullptr, this, nullptr);
+            reply->abort();
+            reply->deleteLater();
+        }
+    }
+}
+
+bool AuDownloader::hasActiveReplies() const
+{
+    return m_probe_reply || m_reply || m_hashes_reply
+        || std::any_of(m_segments.begin(), m_segments.end(), [](const Segment& s) { return s.reply != nullptr; });
+}
+
+bool AuDownloader::failover()
+{
+    if (!m_mirrors || !m_file_error.isEmpty())
+    {
+        return false;
+    }
+
+    m_mirrors->reportFailure(m_request_url);
+    auto request_url = m_mirrors->map(m_transfer_url);
+    if (request_url == m_request_url)
+    {
+        // no other mirror left
+        return false;
+    }
+
+    qInfo().noquote() << QString("%1: continuing from %2").arg(m_dl_url.toString(), request_url.toString());
+
+    // the data on disk is kept, the transfer continues with a Range request
+    abort();
+    m_mirror_switched = true;
+    startTransfer();
+    return true;
+}
+
+bool AuDownloader::retry(int http_status)
+{
+    if (!m_file_error.isEmpty() || !isRetryable(m_error, http_status))
+    {
+        return false;
+    }
+
+    auto bytes = isStreaming() ? m_bytes_received : 0;
+    if (bytes > m_retry_bytes)
+    {
+        // the last attempt made progress
+        m_retry_count = 0;
+        m_retry_bytes = bytes;
+    }
+    if (m_retry_count >= m_max_retries)
+    {
+        return false;
+    }
+
+    auto delay = qMin(RETRY_MAX_DELAY_MS, RETRY_BASE_DELAY_MS << m_retry_count);
+    delay -= static_cast<int>(QRandomGenerator::global()->bounded(delay / 2 + 1));
+    ++m_retry_count;
+
+    qInfo().noquote() << QString("%1: %2, retry %3 of %4 in %5 ms")
+        .arg(m_dl_url.toString(), getError().trimmed()).arg(m_retry_count).arg(m_max_retries).arg(delay);
+
+    abort();
+    setState(State::RETRY_PENDING);
+    m_retry_timer.start(delay);
+    return true;
+}
+
+void AuDownloader::fail(int http_status)
+{
+    if (failover() || retry(http_status))
+    {
+        return;
+    }
+
+    m_watchdog_timer.stop();
+    setState(State::FAILED);
+    Q_EMIT downloadError(m_dl_url);
+}
+
+AuDownloader::Segment* AuDownloader::findSegment(QNetworkReply* reply)
+{
+    if (!reply)
+    {
+        return nullptr;
+    }
+
+    for (auto& segment : m_segments)
+    {
+        if (segment.reply == reply)
+        {
+            return &segment;
+        }
+    }
+    return nullptr;
+}
+
+qint64 AuDownloader::contiguousBytes() const
+{
+    // segments are ordered by their begin offset
+    qint64 contiguous = 0;
+    for (const auto& segment : m_segments)
+    {
+        if (segment.begin > contiguous)
+        {
+            break;
+        }
+        contiguous = qMax(contiguous, segment.begin + segment.received);
+        if (segment.received < (segment.end - segment.begin))
+        {
+            break;
+        }
+    }
+    return contiguous;
+}
+
+void AuDownloader::hashContiguous()
+{
+    auto contiguous = m_chunk_verifier ? m_chunk_verifier->getVerifiedBytes() : contiguousBytes();
+    if (contiguous > m_hashed)
+    {
+        // the hash worker reads the newly contiguous range from disk
+        if (m_part_file.isOpen())
+        {
+            m_part_file.flush();
+        }
+        Q_EMIT hashFile(m_part_file.fileName(), m_hashed, contiguous - m_hashed);
+        m_hashed = contiguous;
+    }
+}
+
+bool AuDownloader::openPartFile()
+{
+    QDir().mkpath(m_dest_dir);
+    m_part_file.setFileName(partFileName(m_transfer_url, m_dest_dir));
+
+    m_offset = 0;
+    m_segments.clear();
+    if (readJournal() && m_part_file.exists())
+    {
+        // data written after the last journal update is fetched again
+        m_offset = qMin(m_journal_bytes, m_part_file.size());
+    }
+    else
+    {
+        m_etag.clear();
+        m_last_modified.clear();
+        m_total_size = 0;
+        m_segments.clear();
+    }
+
+    if (!m_part_file.open(QIODevice::ReadWrite))
+    {
+        return false;
+    }
+
+    if ((m_etag.isEmpty() && m_last_modified.isEmpty()))
+    {
+        // no validator, resuming is not safe
+        m_offset = 0;
+        m_segments.clear();
+    }
+
+    return true;
+}
+
+void AuDownloader::restartFromScratch()
+{
+    m_offset = 0;
+    m_bytes_received = 0;
+    m_journal_bytes = 0;
+    m_part_file.resize(0);
+    m_part_file.seek(0);
+    Q_EMIT hashReset();
+    if (m_chunk_verifier)
+    {
+        m_chunk_verifier->reset();
+        m_hashed = 0;
+    }
+}
+
+void AuDownloader::responseHeaders()
+{
+    auto reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply)
+    {
+        return;
+    }
+
+    // the response headers arrived, the body is next
+    if (m_state == State::CONNECTING)
+    {
+        m_activity_clock.restart();
+        setState(State::WAITING_FOR_DATA);
+    }
+
+    auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if ((status < 200) || (status >= 300))
+    {
+        // writeChunks drops an error body, fileDownloaded reports the status
+        return;
+    }
+
+    if (findSegment(reply))
+    {
+        if (status != 206)
+        {
+            // file changed on the server, fetch it again as a whole
+            abortSegments();
+            m_segments.clear();
+            m_part_file.close();
+            discard();
+            Q_EMIT hashReset();
+            startSingle();
+        }
+        return;
+    }
+
+    if (reply != m_reply)
+    {
+        return;
+    }
+
+    if (!isStreaming())
+    {
+        if (!m_decoder.init(reply->rawHeader("Content-Encoding")))
+        {
+            m_file_error = QString("Unsupported Content-Encoding %1").arg(QString::fromLatin1(reply->rawHeader("Content-Encoding")));
+            reply->abort();
+        }
+        return;
+    }
+
+    if ((m_offset > 0) && (status != 206))
+    {
+        // range ignored: file changed on the server or ranges are not supported
+        restartFromScratch();
+    }
+
+    m_etag = reply->rawHeader("ETag");
+    m_last_modified = reply->rawHeader("Last-Modified");
+    writeJournal();
+
+    auto content_length = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+    if (m_chunk_verifier && (content_length > 0) && !m_chunk_verifier->setSize(m_offset + content_length))
+    {
+        dropChunkVerifier();
+    }
+}
+
+void AuDownloader::probeFinished(QNetworkReply* reply)
+{
+    m_probe_reply = nullptr;
+    reply->deleteLater();
+
+    auto size = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+    bool accept_ranges = reply->rawHeader("Accept-Ranges").contains("bytes");
+    auto etag = reply->rawHeader("ETag");
+    auto last_modified = reply->rawHeader("Last-Modified");
+    m_filename = fileNameFromReply(reply);
+
+    if ((reply->error() != QNetworkReply::NoError)
+        || !accept_ranges
+        || (size < MIN_SEGMENTED_SIZE)
+        || (etag.isEmpty() && last_modified.isEmpty()))
+    {
+        startSingle();
+        return;
+    }
+
+    startSegmented(size, etag, last_modified);
+}
+
+void AuDownloader::segmentFinished(QNetworkReply* reply)
+{
+    auto segment = findSegment(reply);
+    auto error = reply->error();
+    auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if ((error == QNetworkReply::NoError) && !writeChunks(reply, false))
+    {
+        error = QNetworkReply::UnknownContentError;
+    }
+    segment->reply = nullptr;
+    reply->deleteLater();
+
+    if ((error == QNetworkReply::NoError) && (segment->received < (segment->end - segment->begin)))
+    {
+        // connection closed before the range was complete
+        error = QNetworkReply::RemoteHostClosedError;
+    }
+
+    if (error != QNetworkReply::NoError)
+    {
+        m_error = error;
+        abortSegments();
+
+        // keep the partial download for the next attempt
+        m_part_file.close();
+        writeJournal();
+        fail(status);
+        return;
+    }
+
+    if (std::all_of(m_segments.begin(), m_segments.end(), [](const Segment& s) {
+            return s.received == (s.end - s.begin);
+        }))
+    {
+        hashContiguous();
+        m_part_file.close();
+        QFile::remove(getJournalFileName());
+        if (m_filename.isEmpty())
+        {
+            m_filename = m_dl_url.fileName();
+        }
+        transferComplete();
+    }
+}
+
+void AuDownloader::fileDownloaded(QNetworkReply* reply)
+{
+    if (reply == m_probe_reply)
+    {
+        probeFinished(reply);
+        return;
+    }
+
+    if (findSegment(reply))
+    {
+        segmentFinished(reply);
+        return;
+    }
+
+    if (reply != m_reply)
+    {
+        // aborted on purpose
+        reply->deleteLater();
+        return;
+    }
+
+    m_reply = nullptr;
+    m_error = reply->error();
+
+    if (m_error == QNetworkReply::NoError)
+    {
+        // fetch what is left in the read buffer
+        if (!writeChunks(reply, false))
+        {
+            m_error = QNetworkReply::UnknownContentError;
+        }
+        else if (!isStreaming() && !m_decoder.finish())
+        {
+            m_file_error = QString("Incomplete compressed content");
+            m_error = QNetworkReply::UnknownContentError;
+        }
+    }
+
+    if (m_error == QNetworkReply::NoError)
+    {
+        QString filename = fileNameFromReply(reply);
+        reply->deleteLater();
+        if (isStreaming())
+        {
+            m_part_file.close();
+            QFile::remove(getJournalFileName());
+            m_filename = filename.isEmpty() ? m_dl_url.fileName() : filename;
+            transferComplete();
+        }
+        else
+        {
+            auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            m_not_modified = (status == 304);
+            m_etag = reply->rawHeader("ETag");
+            m_last_modified = reply->rawHeader("Last-Modified");
+            m_watchdog_timer.stop();
+            setState(State::FINISHED);
+            Q_EMIT downloadFinished(m_dl_url, filename);
+        }
+    }
+    else
+    {
+        auto err_str = QVariant::fromValue(m_error).toString();
+        auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        reply->deleteLater();
+
+        if (isStreaming() && (m_offset > 0) && (status == 416))
+        {
+            // stale journal, the requested range does not exist (anymore)
+            m_part_file.close();
+            discard();
+            Q_EMIT hashReset();
+            startTransfer();
+            return;
+        }
+
+        if (m_part_file.isOpen())
+        {
+            // keep the partial download for the next attempt
+            m_part_file.close();
+            writeJournal();
+        }
+        fail(status);
+    }
+}
+
+void AuDownloader::dataAvailable()
+{
+    auto reply = qobject_cast<QNetworkReply*>(sender());
+    if (reply && !writeChunks(reply, true))
+    {
+        // fileDownloaded reports the failure
+        reply->abort();
+    }
+}
 
-    QNetworkRequest request(m_dl_url);
-    auto reply = m_net_access.get(request);
-    connect(reply, &QNetworkReply::downloadProgress, this, &AuDownloader::dlProgress);
-    connect(reply, &QNetworkReply::sslErrors, this, &AuDownloader::sslErrors);
+void AuDownloader::readPending()
+{
+    // continue replies which were stopped by the bandwidth limit
+    QList<QNetworkReply*> replies;
+    if (m_reply)
+    {
+        replies.append(m_reply);
+    }
+    for (const auto& segment : m_segments)
+    {
+        if (segment.reply)
+        {
+            replies.append(segment.reply);
+        }
+    }
+
+    for (auto reply : replies)
+    {
+        if ((reply->bytesAvailable() > 0) && !writeChunks(reply, true))
+        {
+            reply->abort();
+        }
+    }
 }
 
-AuDownloader::~AuDownloader()
+qint64 AuDownloader::readSize(bool throttled) const
+{
+    if (!throttled || !m_limiter)
+    {
+        return CHUNK_SIZE;
+    }
+    return qMin(CHUNK_SIZE, m_limiter->available());
+}
+
+bool AuDownloader::decodeChunks(QNetworkReply* reply, bool throttled)
 {
+    while (reply->bytesAvailable() > 0)
+    {
+        auto read_size = readSize(throttled);
+        if (read_size <= 0)
+        {
+            // continued by readPending
+            break;
+        }
 
+        auto chunk = reply->read(read_size);
+        if (m_limiter)
+        {
+            m_limiter->consume(chunk.size());
+        }
+        m_activity_clock.restart();
+        setState(State::RECEIVING);
+        m_transfer_size += chunk.size();
+        if (!m_decoder.decode(chunk, m_downloaded_data))
+        {
+            m_file_error = QString("Could not decode %1").arg(m_transfer_url.toString());
+            return false;
+        }
+    }
+    return true;
 }
 
-void AuDownloader::fileDownloaded(QNetworkReply* reply)
+bool AuDownloader::writeChunks(QNetworkReply* reply, bool throttled)
 {
-    m_error = reply->error();
-    if (m_error == QNetworkReply::NoError)
+    if (hasErrorStatus(reply))
     {
-        // Content-Disposition --- "attachment; filename=\"DEWETRON_Oxygen_Setup_R5.2.0_x64.zip\""
-        auto content_disp = reply->header(QNetworkRequest::KnownHeaders::ContentDispositionHeader).toString();
-        QString filename = content_disp.remove("attachment; filename=");
-        filename.remove('\"');
-        m_downloaded_data = reply->readAll();
-        reply->deleteLater();
-        Q_EMIT downloadFinished(m_dl_url, filename);
+        // never part of the file or the decoded data
+        reply->readAll();
+        return true;
+    }
+
+    if (!isStreaming())
+    {
+        return decodeChunks(reply, throttled);
+    }
+
+    if (!m_part_file.isOpen())
+    {
+        return false;
+    }
+
+    auto segment = findSegment(reply);
+    if (segment)
+    {
+        // writes of concurrent segments are interleaved
+        if (!m_part_file.seek(segment->begin + segment->received))
+        {
+            m_file_error = QString("Could not write %1: %2").arg(m_part_file.fileName(), m_part_file.errorString());
+            return false;
+        }
+    }
+
+    while (reply->bytesAvailable() > 0)
+    {
+        auto read_size = readSize(throttled);
+        if (read_size <= 0)
+        {
+            // continued by readPending
+            break;
+        }
+
+        auto chunk = reply->read(read_size);
+        if (m_limiter)
+        {
+            m_limiter->consume(chunk.size());
+        }
+        m_activity_clock.restart();
+        setState(State::RECEIVING);
+        auto pos = m_part_file.pos();
+        if (segment)
+        {
+            // never write beyond the requested range
+            chunk.truncate(static_cast<int>(qMin<qint64>(chunk.size(), segment->end - pos)));
+        }
+
+        if (m_part_file.write(chunk) != chunk.size())
+        {
+            m_file_error = QString("Could not write %1: %2").arg(m_part_file.fileName(), m_part_file.errorString());
+            return false;
+        }
+        m_bytes_received += chunk.size();
+
+        if (m_chunk_verifier)
+        {
+            // the digests wait for the verification of the chunk
+            if (segment)
+            {
+                segment->received += chunk.size();
+            }
+            receivedChunk(pos, chunk.size());
+        }
+        else if (!segment)
+        {
+            Q_EMIT hashData(chunk);
+        }
+        else
+        {
+            segment->received += chunk.size();
+            if (pos == m_hashed)
+            {
+                // in order data goes straight to the hash worker
+                Q_EMIT hashData(chunk);
+                m_hashed += chunk.size();
+            }
+        }
+    }
+
+    if (segment)
+    {
+        hashContiguous();
+        Q_EMIT downloadProgress(m_dl_url, m_bytes_received, m_total_size);
+    }
+
+    if (m_bytes_received - m_journal_bytes >= JOURNAL_INTERVAL)
+    {
+        m_part_file.flush();
+        writeJournal();
+    }
+    return true;
+}
+
+QString AuDownloader::getJournalFileName() const
+{
+    auto part_file_name = partFileName(m_transfer_url, m_dest_dir);
+    part_file_name.chop(QString(".part").size());
+    return part_file_name + ".journal";
+}
+
+bool AuDownloader::readJournal()
+{
+    QFile journal_file(getJournalFileName());
+    if (!journal_file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    auto journal = QJsonDocument::fromJson(journal_file.readAll()).object();
+    if (QUrl(journal["url"].toString()) != m_transfer_url)
+    {
+        return false;
+    }
+
+    m_etag = journal["etag"].toString().toLatin1();
+    m_last_modified = journal["last_modified"].toString().toLatin1();
+    m_journal_bytes = static_cast<qint64>(journal["bytes_received"].toDouble());
+    m_total_size = static_cast<qint64>(journal["size"].toDouble());
+
+    m_segments.clear();
+    for (const auto& entry : journal["segments"].toArray())
+    {
+        auto values = entry.toArray();
+        m_segments.push_back({
+            static_cast<qint64>(values.at(0).toDouble()),
+            static_cast<qint64>(values.at(1).toDouble()),
+            static_cast<qint64>(values.at(2).toDouble()),
+            nullptr });
+    }
+    return true;
+}
+
+void AuDownloader::writeJournal()
+{
+    QJsonObject journal;
+    journal["url"] = m_transfer_url.toString();
+    journal["etag"] = QString::fromLatin1(m_etag);
+    journal["last_modified"] = QString::fromLatin1(m_last_modified);
+
+    if (m_segments.empty())
+    {
+        journal["bytes_received"] = static_cast<double>(m_bytes_received);
     }
     else
     {
-        auto err_str = QVariant::fromValue(m_error).toString();
-        Q_EMIT downloadError(m_dl_url);
+        // a single stream download can continue with the contiguous part
+        journal["bytes_received"] = static_cast<double>(contiguousBytes());
+        journal["size"] = static_cast<double>(m_total_size);
+
+        QJsonArray segments;
+        for (const auto& segment : m_segments)
+        {
+            segments.append(QJsonArray{
+                static_cast<double>(segment.begin),
+                static_cast<double>(segment.end),
+                static_cast<double>(segment.received) });
+        }
+        journal["segments"] = segments;
+    }
+
+    QSaveFile journal_file(getJournalFileName());
+    if (journal_file.open(QIODevice::WriteOnly))
+    {
+        journal_file.write(QJsonDocument(journal).toJson(QJsonDocument::Compact));
+        if (journal_file.commit())
+        {
+            m_journal_bytes = m_bytes_received;
+        }
     }
 }
 
 void AuDownloader::dlProgress(qint64 curr, qint64 max)
 {
-    Q_EMIT downloadProgress(m_dl_url, curr, max);
+    if (max > 0)
+    {
+        // a resumed reply only counts the missing part
+        max += m_offset;
+    }
+    Q_EMIT downloadProgress(m_dl_url, curr + m_offset, max);
 }
 
-
 void AuDownloader::sslErrors(const QList<QSslError>& ssl_errors)
 {
     m_ssl_errors = ssl_errors;
 }
 
+void AuDownloader::checkTimeout()
+{
+    if (!hasActiveReplies())
+    {
+        m_watchdog_timer.stop();
+        return;
+    }
+
+    qint64 timeout = STALL_TIMEOUT_MS;
+    if (m_state == State::CONNECTING)
+    {
+        m_timeout_error = "Connection timed out";
+        timeout = CONNECT_TIMEOUT_MS;
+    }
+    else if (m_state == State::WAITING_FOR_DATA)
+    {
+        m_timeout_error = "No data received";
+        timeout = FIRST_BYTE_TIMEOUT_MS;
+    }
+    else
+    {
+        m_timeout_error = "Transfer stalled";
+    }
+
+    if (m_activity_clock.elapsed() < timeout)
+    {
+        return;
+    }
+
+    qWarning().noquote() << QString("%1: %2 after %3 s").arg(m_request_url.toString(), m_timeout_error).arg(timeout / 1000);
+
+    // the replies are dropped, a streamed download keeps its data on disk
+    abort();
+    m_error = QNetworkReply::TimeoutError;
+    fail(0);
+}
+
+void AuDownloader::hashReady(AuDigest::Algorithm algorithm, const QByteArray& digest)
+{
+    m_digests.insert(algorithm, digest);
+    checkFinished();
+}
+
+void AuDownloader::extractFinished(bool extracted, const QString& error)
+{
+    m_extract_finished = true;
+    m_extracted = extracted;
+    m_extract_error = error;
+    checkFinished();
+}
+
+void AuDownloader::fetchChunkHashes()
+{
+    auto hashes_url = m_mirrors ? m_mirrors->map(m_chunk_hashes_url) : m_chunk_hashes_url;
+    m_hashes_reply = m_session->get(m_session->createRequest(hashes_url));
+    connect(m_hashes_reply, &QNetworkReply::finished, this, &AuDownloader::chunkHashesFetched);
+    connect(m_hashes_reply, &QNetworkReply::sslErrors, this, &AuDownloader::sslErrors);
+    requestStarted();
+}
+
+void AuDownloader::chunkHashesFetched()
+{
+    auto reply = m_hashes_reply;
+    m_hashes_reply = nullptr;
+    reply->deleteLater();
+
+    m_chunk_verifier.reset(new AuChunkVerifier(partFileName(m_transfer_url, m_dest_dir), m_chunk_size));
+    if ((reply->error() != QNetworkReply::NoError) || !m_chunk_verifier->setHashes(reply->readAll(), m_chunk_root))
+    {
+        // the digests of the whole file still protect the download
+        qWarning().noquote() << QString("%1: no usable chunk hashes from %2, %3")
+            .arg(m_dl_url.toString(), m_chunk_hashes_url.toString(), reply->errorString());
+        m_chunk_verifier.reset();
+    }
+    else
+    {
+        connect(m_chunk_verifier.get(), &AuChunkVerifier::chunksVerified, this, &AuDownloader::chunksVerified);
+        connect(m_chunk_verifier.get(), &AuChunkVerifier::chunkCorrupt, this, &AuDownloader::repairChunk);
+    }
+
+    m_chunk_hashes_url.clear();
+    startTransfer();
+}
+
+void AuDownloader::receivedChunk(qint64 offset, qint64 length)
+{
+    // the verifier reads the chunks from disk
+    if (m_part_file.isOpen())
+    {
+        m_part_file.flush();
+    }
+    m_chunk_verifier->addReceived(offset, length);
+}
+
+void AuDownloader::chunksVerified()
+{
+    hashContiguous();
+    if (m_transfer_complete && m_chunk_verifier->isComplete())
+    {
+        m_transfer_complete = false;
+        Q_EMIT hashFinish();
+    }
+}
+
+void AuDownloader::repairChunk(qint64 offset, qint64 length)
+{
+    qWarning().noquote() << QString("%1: chunk at offset %2 is corrupt, fetching it again")
+        .arg(m_dl_url.toString()).arg(offset);
+
+    if (++m_repair_count > MAX_CHUNK_REPAIRS)
+    {
+        m_file_error = QString("Chunk at offset %1 is corrupt").arg(offset);
+        abort();
+        m_error = QNetworkReply::UnknownContentError;
+        fail(0);
+        return;
+    }
+
+    auto repair = new AuRangeFetcher(m_request_url, m_part_file.fileName(), m_session, this);
+    repair->setMirrorList(m_mirrors);
+    repair->setBandwidthLimiter(m_limiter);
+    m_repairs.append(repair);
+    connect(repair, &AuRangeFetcher::fetchFinished, this, [this, repair, offset, length]()
+    {
+        m_repairs.removeOne(repair);
+        repair->deleteLater();
+        m_activity_clock.restart();
+        m_chunk_verifier->addReceived(offset, length);
+    });
+    connect(repair, &AuRangeFetcher::fetchError, this, [this, repair]()
+    {
+        qWarning().noquote() << QString("%1: %2").arg(m_dl_url.toString(), repair->getError());
+        // the retry verifies the data on disk again
+        abort();
+        m_error = QNetworkReply::UnknownNetworkError;
+        fail(0);
+    });
+    repair->start({ AuByteRange(offset, length) });
+}
+
+void AuDownloader::dropChunkVerifier()
+{
+    qWarning().noquote() << QString("%1: size does not match the chunk hashes, verifying the whole file only")
+        .arg(m_dl_url.toString());
+    m_chunk_verifier.reset();
+
+    if (!m_segments.empty())
+    {
+        hashContiguous();
+    }
+    else if (m_bytes_received > m_hashed)
+    {
+        if (m_part_file.isOpen())
+        {
+            m_part_file.flush();
+        }
+        Q_EMIT hashFile(m_part_file.fileName(), m_hashed, m_bytes_received - m_hashed);
+        m_hashed = m_bytes_received;
+    }
+}
+
+void AuDownloader::transferComplete()
+{
+    if (m_chunk_verifier && !m_chunk_verifier->setSize(m_bytes_received))
+    {
+        dropChunkVerifier();
+    }
+    if (m_chunk_verifier && !m_chunk_verifier->isComplete())
+    {
+        // chunksVerified() finishes the digests
+        m_transfer_complete = true;
+        return;
+    }
+
+    // downloadFinished is emitted as soon as the last chunk is hashed
+    hashContiguous();
+    Q_EMIT hashFinish();
+}
+
+void AuDownloader::checkFinished()
+{
+    if (m_digests.size() < static_cast<int>(m_hash_threads.size()))
+    {
+        return;
+    }
+    if (m_extract_thread && !m_extract_finished)
+    {
+        return;
+    }
+
+    m_watchdog_timer.stop();
+    setState(State::FINISHED);
+    Q_EMIT downloadFinished(m_dl_url, m_filename);
+}
+
 
 const QByteArray& AuDownloader::getDownload() const
 {
@@ -95,5 +1616,115 @@ QString AuDownloader::getError() const
         }
     }
 
+    if (!m_timeout_error.isEmpty())
+    {
+        error_string += QString("\n%1").arg(m_timeout_error);
+    }
+
+    if (!m_file_error.isEmpty())
+    {
+        error_string += QString("\n%1").arg(m_file_error);
+    }
+
     return error_string;
 }
+
+AuDownloader::State AuDownloader::getState() const
+{
+    return m_state;
+}
+
+bool AuDownloader::isStreaming() const
+{
+    return !m_dest_dir.isEmpty();
+}
+
+QString AuDownloader::getPartFileName() const
+{
+    return m_part_file.fileName();
+}
+
+bool AuDownloader::isNotModified() const
+{
+    return m_not_modified;
+}
+
+QByteArray AuDownloader::getETag() const
+{
+    return m_etag;
+}
+
+QByteArray AuDownloader::getLastModified() const
+{
+    return m_last_modified;
+}
+
+qint64 AuDownloader::getTransferSize() const
+{
+    return isStreaming() ? m_bytes_received : m_transfer_size;
+}
+
+qint64 AuDownloader::getDecodedSize() const
+{
+    return isStreaming() ? m_bytes_received : m_downloaded_data.size();
+}
+
+QByteArray AuDownloader::getDigest(AuDigest::Algorithm algorithm) const
+{
+    return m_digests.value(algorithm);
+}
+
+QVariantMap AuDownloader::getDigests() const
+{
+    QVariantMap digests;
+    for (auto digest_it = m_digests.begin(); digest_it != m_digests.end(); ++digest_it)
+    {
+        digests.insert(AuDigest::name(digest_it.key()), digest_it.value());
+    }
+    return digests;
+}
+
+QByteArray AuDownloader::getSha1() const
+{
+    return getDigest(AuDigest::Algorithm::SHA1);
+}
+
+QString AuDownloader::commit(const QString& filename)
+{
+    if (!isStreaming() || !m_part_file.exists())
+    {
+        return {};
+    }
+    m_part_file.close();
+
+    const QString dest_file_name = m_dest_dir + "/" + filename;
+    if (QFile::exists(dest_file_name))
+    {
+        // removing old file
+        QFile::remove(dest_file_name);
+    }
+
+    if (!m_part_file.rename(dest_file_name))
+    {
+        m_file_error = QString("Could not create %1: %2").arg(dest_file_name, m_part_file.errorString());
+        return {};
+    }
+
+    // the .part file is gone, do not touch the committed file later on
+    m_part_file.setFileName(QString());
+    return dest_file_name;
+}
+
+void AuDownloader::discard()
+{
+    if (isStreaming() && !m_part_file.fileName().isEmpty())
+    {
+        m_part_file.close();
+        m_part_file.remove();
+        QFile::remove(getJournalFileName());
+    }
+    if (!m_extract_dir.isEmpty())
+    {
+        QDir(m_extract_dir).removeRecursively();
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_hash_worker.h"
+#include <QFile>
+
+namespace
+{
+    /**
+     * Data on disk is mapped in windows of this size, large blocks let
+     * BLAKE3 hash in tree mode
+     */
+    constexpr qint64 MAP_WINDOW_SIZE = 256 * 1024 * 1024;
+    constexpr qint64 READ_CHUNK_SIZE = 1024 * 1024;
+}
+
+AuHashWorker::AuHashWorker(AuDigest::Algorithm algorithm)
+    : QObject(nullptr)
+    , m_digest(algorithm)
+{
+}
+
+AuHashWorker::~AuHashWorker()
+{
+}
+
+void AuHashWorker::addFile(const QString& file_name, qint64 offset, qint64 length)
+{
+    QFile file(file_name);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return;
+    }
+
+    while (length > 0)
+    {
+        auto window_size = qMin(length, MAP_WINDOW_SIZE);
+        auto window = file.map(offset, window_size);
+        if (!window)
+        {
+            break;
+        }
+        m_digest.addData(reinterpret_cast<const char*>(window), window_size);
+        file.unmap(window);
+        offset += window_size;
+        length -= window_size;
+    }
+
+    // not mappable, read it chunk by chunk
+    if ((length > 0) && file.seek(offset))
+    {
+        while (length > 0)
+        {
+            auto chunk = file.read(qMin(length, READ_CHUNK_SIZE));
+            if (chunk.isEmpty())
+            {
+                break;
+            }
+            m_digest.addData(chunk);
+            length -= chunk.size();
+        }
+    }
+}
+
+void AuHashWorker::addData(const QByteArray& chunk)
+{
+    m_digest.addData(chunk);
+}
+
+void AuHashWorker::finish()
+{
+    Q_EMIT hashReady(m_digest.result());
+}
+
+void AuHashWorker::reset()
+{
+    m_digest.reset();
+}
@@ -0,0 +1,364 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_installer_store.h"
+#include "au_local_copier.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <algorithm>
+
+#ifdef Q_OS_WIN
+#include "windows.h"
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr int SHA1_HEX_SIZE = 40;
+
+    /**
+     * A copy in progress is never older, older ones were interrupted
+     */
+    constexpr qint64 STALE_COPY_AGE_MS = 60 * 60 * 1000;
+
+    bool hardLink(const QString& source_file_name, const QString& dest_file_name)
+    {
+#ifdef Q_OS_WIN
+        return CreateHardLinkW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(dest_file_name).utf16()),
+                               reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(source_file_name).utf16()),
+                               nullptr) != 0;
+#else
+        return ::link(QFile::encodeName(source_file_name).constData(), QFile::encodeName(dest_file_name).constData()) == 0;
+#endif
+    }
+}
+
+AuInstallerStore::AuInstallerStore(const QString& store_dir)
+    : m_store_dir(store_dir + "/installers")
+    , m_entries()
+    , m_pinned()
+{
+    QDir().mkpath(m_store_dir);
+}
+
+bool AuInstallerStore::load()
+{
+    m_entries.clear();
+
+    QFile index_file(m_store_dir + "/index.json");
+    if (!index_file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    for (const auto& value : QJsonDocument::fromJson(index_file.readAll()).array())
+    {
+        auto entry = value.toObject();
+        auto sha1 = entry["sha1"].toString().toLatin1().toLower();
+        if (!isHash(sha1))
+        {
+            continue;
+        }
+        // older indexes have no usage time, the time of storing is as good
+        auto modified = static_cast<qint64>(entry["modified"].toDouble());
+        m_entries.insert(sha1, {
+            entry["file"].toString(),
+            QUrl(entry["url"].toString()),
+            static_cast<qint64>(entry["size"].toDouble()),
+            modified,
+            static_cast<qint64>(entry["used"].toDouble(static_cast<double>(modified))),
+            entry["source"].toString(),
+            static_cast<qint64>(entry["source_modified"].toDouble()) });
+    }
+    return true;
+}
+
+bool AuInstallerStore::add(const QByteArray& sha1, const QString& file_name, const QUrl& url)
+{
+    const auto key = sha1.toLower();
+    if (!isHash(key) || !QFileInfo::exists(file_name))
+    {
+        return false;
+    }
+
+    const auto object_file_name = getObjectFileName(key);
+    if (find(key).isEmpty())
+    {
+        // new content or the stored file was modified
+        QFile::remove(object_file_name);
+        if (!placeFile(file_name, object_file_name))
+        {
+            return false;
+        }
+    }
+
+    QFileInfo object_info(object_file_name);
+    QFileInfo source_info(file_name);
+    m_entries.insert(key, {
+        source_info.fileName(),
+        url,
+        object_info.size(),
+        object_info.lastModified().toMSecsSinceEpoch(),
+        QDateTime::currentMSecsSinceEpoch(),
+        source_info.absoluteFilePath(),
+        source_info.lastModified().toMSecsSinceEpoch() });
+    return save();
+}
+
+QString AuInstallerStore::find(const QByteArray& sha1) const
+{
+    auto entry_it = m_entries.find(sha1.toLower());
+    if (entry_it == m_entries.end())
+    {
+        return {};
+    }
+
+    QFileInfo file_info(getObjectFileName(entry_it.key()));
+    if (!file_info.exists()
+        || (file_info.size() != entry_it->size)
+        || (file_info.lastModified().toMSecsSinceEpoch() != entry_it->modified))
+    {
+        // removed or modified since it was verified
+        return {};
+    }
+    return file_info.absoluteFilePath();
+}
+
+void AuInstallerStore::touch(const QByteArray& sha1)
+{
+    auto entry_it = m_entries.find(sha1.toLower());
+    if (entry_it != m_entries.end())
+    {
+        entry_it->used = QDateTime::currentMSecsSinceEpoch();
+        save();
+    }
+}
+
+void AuInstallerStore::setPinned(const QSet<QByteArray>& hashes)
+{
+    m_pinned.clear();
+    for (const auto& sha1 : hashes)
+    {
+        m_pinned.insert(sha1.toLower());
+    }
+}
+
+QString AuInstallerStore::getFileName(const QByteArray& sha1) const
+{
+    auto entry_it = m_entries.find(sha1.toLower());
+    return (entry_it != m_entries.end()) ? entry_it->file_name : QString();
+}
+
+QList<QByteArray> AuInstallerStore::getHashes() const
+{
+    QList<QByteArray> hashes;
+    for (const auto& sha1 : m_entries.keys())
+    {
+        if (!find(sha1).isEmpty())
+        {
+            hashes.append(sha1);
+        }
+    }
+    return hashes;
+}
+
+qint64 AuInstallerStore::getTotalSize() const
+{
+    qint64 total_size = 0;
+    for (const auto& entry : m_entries)
+    {
+        total_size += entry.size;
+    }
+    return total_size;
+}
+
+bool AuInstallerStore::extract(const QByteArray& sha1, const QString& dest_file_name) const
+{
+    auto object_file_name = find(sha1);
+    if (object_file_name.isEmpty())
+    {
+        return false;
+    }
+
+    QFile::remove(dest_file_name);
+    return placeFile(object_file_name, dest_file_name);
+}
+
+QStringList AuInstallerStore::compact(qint64 budget)
+{
+    QStringList file_names;
+    bool changed = false;
+
+    // interrupted copies and removals
+    const auto now = QDateTime::currentMSecsSinceEpoch();
+    for (const auto& file_info : QDir(m_store_dir).entryInfoList({ "*.tmp", "*.evicted" }, QDir::Files))
+    {
+        if ((file_info.suffix() == "evicted") || (now - file_info.lastModified().toMSecsSinceEpoch() > STALE_COPY_AGE_MS))
+        {
+            file_names.append(file_info.absoluteFilePath());
+        }
+    }
+
+    // removed or modified since they were stored
+    for (auto entry_it = m_entries.begin(); entry_it != m_entries.end();)
+    {
+        if (find(entry_it.key()).isEmpty())
+        {
+            file_names.append(evictObject(entry_it.key()));
+            entry_it = m_entries.erase(entry_it);
+            changed = true;
+        }
+        else
+        {
+            ++entry_it;
+        }
+    }
+
+    // least recently used first
+    QList<QByteArray> candidates;
+    for (auto entry_it = m_entries.begin(); entry_it != m_entries.end(); ++entry_it)
+    {
+        if (!m_pinned.contains(entry_it.key()))
+        {
+            candidates.append(entry_it.key());
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](const QByteArray& lhs, const QByteArray& rhs) {
+        return m_entries[lhs].used < m_entries[rhs].used;
+    });
+
+    auto total_size = getTotalSize();
+    for (const auto& sha1 : candidates)
+    {
+        if (total_size <= budget)
+        {
+            break;
+        }
+
+        const auto entry = m_entries.take(sha1);
+        total_size -= entry.size;
+        changed = true;
+        file_names.append(evictObject(sha1));
+
+        // the download it was stored from, unless the user changed or replaced it
+        QFileInfo source_info(entry.source_path);
+        if (!entry.source_path.isEmpty()
+            && source_info.exists()
+            && (source_info.size() == entry.size)
+            && (source_info.lastModified().toMSecsSinceEpoch() == entry.source_modified))
+        {
+            file_names.append(source_info.absoluteFilePath());
+        }
+    }
+
+    if (changed)
+    {
+        save();
+    }
+    return file_names;
+}
+
+void AuInstallerStore::removeFiles(const QStringList& file_names)
+{
+    for (const auto& file_name : file_names)
+    {
+        QFile::remove(file_name);
+    }
+}
+
+bool AuInstallerStore::save() const
+{
+    QJsonArray index;
+    for (auto entry_it = m_entries.begin(); entry_it != m_entries.end(); ++entry_it)
+    {
+        QJsonObject entry;
+        entry["sha1"] = QString::fromLatin1(entry_it.key());
+        entry["file"] = entry_it->file_name;
+        entry["url"] = entry_it->url.toString();
+        entry["size"] = static_cast<double>(entry_it->size);
+        entry["modified"] = static_cast<double>(entry_it->modified);
+        entry["used"] = static_cast<double>(entry_it->used);
+        entry["source"] = entry_it->source_path;
+        entry["source_modified"] = static_cast<double>(entry_it->source_modified);
+        index.append(entry);
+    }
+
+    QSaveFile index_file(m_store_dir + "/index.json");
+    if (!index_file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    index_file.write(QJsonDocument(index).toJson(QJsonDocument::Compact));
+    return index_file.commit();
+}
+
+QString AuInstallerStore::getObjectFileName(const QByteArray& sha1) const
+{
+    return m_store_dir + "/" + QString::fromLatin1(sha1);
+}
+
+QString AuInstallerStore::evictObject(const QByteArray& sha1) const
+{
+    // renamed right away, a later add() of the same installer is not affected by the removal
+    const auto object_file_name = getObjectFileName(sha1);
+    const auto evicted_file_name = object_file_name + ".evicted";
+    QFile::remove(evicted_file_name);
+    return QFile::rename(object_file_name, evicted_file_name) ? evicted_file_name : object_file_name;
+}
+
+bool AuInstallerStore::isHash(const QByteArray& sha1)
+{
+    // the hash ends up in a file name
+    if (sha1.size() != SHA1_HEX_SIZE)
+    {
+        return false;
+    }
+    return std::all_of(sha1.begin(), sha1.end(), [](char c) {
+        return ((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'f'));
+    });
+}
+
+bool AuInstallerStore::placeFile(const QString& source_file_name, const QString& dest_file_name)
+{
+    // a hardlink or clone takes no time and no additional disk space
+    if (hardLink(source_file_name, dest_file_name))
+    {
+        return true;
+    }
+
+    // the copy only appears under its name when it is complete
+    const QString temp_file_name = dest_file_name + ".tmp";
+    QFile::remove(temp_file_name);
+    if (!AuLocalCopier::copyFile(source_file_name, temp_file_name))
+    {
+        QFile::remove(temp_file_name);
+        return false;
+    }
+    if (!QFile::rename(temp_file_name, dest_file_name))
+    {
+        QFile::remove(temp_file_name);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,269 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "au_local_copier.h"
+#include <QFile>
+#include <QFileInfo>
+#include <memory>
+#include <vector>
+
+#ifndef Q_OS_WIN
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#ifdef Q_OS_MACOS
+#include <sys/clonefile.h>
+#endif
+
+namespace
+{
+    /**
+     * Bytes per copy_file_range() call, also the progress granularity
+     */
+    constexpr qint64 KERNEL_COPY_BLOCK = 64 * 1024 * 1024;
+
+    /**
+     * Bytes mapped at once for hashing, keeps 32 bit address spaces usable
+     */
+    constexpr qint64 MAP_WINDOW = 256 * 1024 * 1024;
+
+    enum class CopyResult
+    {
+        COPIED,
+        FAILED,
+        UNSUPPORTED
+    };
+
+    bool cloneFile(const QString& source_file_name, const QString& dest_file_name)
+    {
+#if defined(Q_OS_LINUX)
+        auto source_fd = ::open(QFile::encodeName(source_file_name).constData(), O_RDONLY | O_CLOEXEC);
+        if (source_fd < 0)
+        {
+            return false;
+        }
+        auto dest_fd = ::open(QFile::encodeName(dest_file_name).constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (dest_fd < 0)
+        {
+            ::close(source_fd);
+            return false;
+        }
+
+        auto cloned = ::ioctl(dest_fd, FICLONE, source_fd) == 0;
+        ::close(dest_fd);
+        ::close(source_fd);
+        if (!cloned)
+        {
+            QFile::remove(dest_file_name);
+        }
+        return cloned;
+#elif defined(Q_OS_MACOS)
+        return ::clonefile(QFile::encodeName(source_file_name).constData(), QFile::encodeName(dest_file_name).constData(), 0) == 0;
+#else
+        Q_UNUSED(source_file_name);
+        Q_UNUSED(dest_file_name);
+        return false;
+#endif
+    }
+
+    CopyResult kernelCopy(const QString& source_file_name, const QString& dest_file_name,
+        const std::function<void(qint64)>& progress)
+    {
+#ifdef Q_OS_LINUX
+        auto source_fd = ::open(QFile::encodeName(source_file_name).constData(), O_RDONLY | O_CLOEXEC);
+        struct stat source_stat;
+        if ((source_fd < 0) || (::fstat(source_fd, &source_stat) != 0))
+        {
+            if (source_fd >= 0)
+            {
+                ::close(source_fd);
+            }
+            return CopyResult::FAILED;
+        }
+        auto dest_fd = ::open(QFile::encodeName(dest_file_name).constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (dest_fd < 0)
+        {
+            ::close(source_fd);
+            return CopyResult::FAILED;
+        }
+
+        // the data does not pass through user space, NFS and SMB copy on the server
+        auto result = CopyResult::COPIED;
+        const qint64 size = source_stat.st_size;
+        qint64 copied = 0;
+        while (copied < size)
+        {
+            auto length = static_cast<size_t>(qMin(size - copied, KERNEL_COPY_BLOCK));
+            auto count = ::copy_file_range(source_fd, nullptr, dest_fd, nullptr, length, 0);
+            if ((count < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            if (count < 0)
+            {
+                // older kernels do not copy across file systems
+                const bool unsupported = (errno == EXDEV) || (errno == ENOSYS) || (errno == EOPNOTSUPP) || (errno == EINVAL);
+                result = ((copied == 0) && unsupported) ? CopyResult::UNSUPPORTED : CopyResult::FAILED;
+                break;
+            }
+            if (count == 0)
+            {
+                // the source was truncated
+                result = CopyResult::FAILED;
+                break;
+            }
+            copied += count;
+            if (progress)
+            {
+                progress(copied);
+            }
+        }
+
+        ::close(dest_fd);
+        ::close(source_fd);
+        return result;
+#else
+        Q_UNUSED(source_file_name);
+        Q_UNUSED(dest_file_name);
+        Q_UNUSED(progress);
+        return CopyResult::UNSUPPORTED;
+#endif
+    }
+
+    QString hashMapped(const QString& file_name, std::vector<std::unique_ptr<AuDigest>>& digests)
+    {
+        QFile file(file_name);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            return QString("Could not open %1: %2").arg(file_name, file.errorString());
+        }
+
+        // the copy is hashed from the page cache, no read buffers in between
+        const auto size = file.size();
+        for (qint64 offset = 0; offset < size; offset += MAP_WINDOW)
+        {
+            const auto length = qMin(MAP_WINDOW, size - offset);
+            auto data = file.map(offset, length);
+            if (!data)
+            {
+                return QString("Could not map %1: %2").arg(file_name, file.errorString());
+            }
+            for (auto& digest : digests)
+            {
+                digest->addData(reinterpret_cast<const char*>(data), length);
+            }
+            file.unmap(data);
+        }
+        return {};
+    }
+}
+
+AuLocalCopier::AuLocalCopier()
+{
+}
+
+AuLocalCopier::~AuLocalCopier()
+{
+}
+
+void AuLocalCopier::copy(QUrl dl_url, const QString& source_file, const QString& target_file,
+    const QList<AuDigest::Algorithm>& algorithms)
+{
+    std::vector<std::unique_ptr<AuDigest>> digests;
+    for (auto algorithm : algorithms)
+    {
+        if (AuDigest::isSupported(algorithm))
+        {
+            digests.emplace_back(new AuDigest(algorithm));
+        }
+    }
+    QString error;
+
+    const auto size = QFileInfo(source_file).size();
+    auto progress = [this, dl_url, size](qint64 copied) {
+        Q_EMIT copyProgress(dl_url, copied, size);
+    };
+
+    if (!QFileInfo(source_file).isFile())
+    {
+        error = QString("Could not find %1").arg(source_file);
+    }
+    else if (!copyFile(source_file, target_file, progress))
+    {
+        error = QString("Could not copy %1 to %2").arg(source_file, target_file);
+    }
+    else
+    {
+        error = hashMapped(target_file, digests);
+    }
+
+    if (!error.isEmpty())
+    {
+        QFile::remove(target_file);
+        Q_EMIT copied(dl_url, target_file, {}, error);
+        return;
+    }
+
+    QVariantMap results;
+    for (auto& digest : digests)
+    {
+        results.insert(AuDigest::name(digest->getAlgorithm()), digest->result());
+    }
+    Q_EMIT copied(dl_url, target_file, results, {});
+}
+
+bool AuLocalCopier::copyFile(const QString& source_file_name, const QString& dest_file_name,
+    const std::function<void(qint64)>& progress)
+{
+    QFile::remove(dest_file_name);
+    if (cloneFile(source_file_name, dest_file_name))
+    {
+        if (progress)
+        {
+            progress(QFileInfo(dest_file_name).size());
+        }
+        return true;
+    }
+
+    switch (kernelCopy(source_file_name, dest_file_name, progress))
+    {
+    case CopyResult::COPIED:
+        return true;
+    case CopyResult::FAILED:
+        QFile::remove(dest_file_name);
+        return false;
+    case CopyResult::UNSUPPORTED:
+        break;
+    }
+
+    // CopyFile() on Windows, offloaded to the server on SMB shares
+    QFile::remove(dest_file_name);
+    if (!QFile::copy(source_file_name, dest_file_name))
+    {
+        return false;
+    }
+    if (progress)
+    {
+        progress(QFileInfo(dest_file_name).size());
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_manifest_cache.h"
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+AuManifestCache::AuManifestCache(const QString& cache_dir)
+    : m_data_file_name(cache_dir + "/update.json")
+    , m_meta_file_name(cache_dir + "/update.meta.json")
+    , m_etag()
+    , m_last_modified()
+{
+    QDir().mkpath(cache_dir);
+}
+
+bool AuManifestCache::load()
+{
+    m_etag.clear();
+    m_last_modified.clear();
+
+    QFile meta_file(m_meta_file_name);
+    if (!QFile::exists(m_data_file_name) || !meta_file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    auto meta = QJsonDocument::fromJson(meta_file.readAll()).object();
+    m_etag = meta["etag"].toString().toLatin1();
+    m_last_modified = meta["last_modified"].toString().toLatin1();
+    return true;
+}
+
+bool AuManifestCache::store(const QByteArray& data, const QByteArray& etag, const QByteArray& last_modified)
+{
+    QSaveFile data_file(m_data_file_name);
+    if (!data_file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    data_file.write(data);
+    if (!data_file.commit())
+    {
+        return false;
+    }
+
+    QJsonObject meta;
+    meta["etag"] = QString::fromLatin1(etag);
+    meta["last_modified"] = QString::fromLatin1(last_modified);
+
+    QSaveFile meta_file(m_meta_file_name);
+    if (!meta_file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    meta_file.write(QJsonDocument(meta).toJson(QJsonDocument::Compact));
+    if (!meta_file.commit())
+    {
+        return false;
+    }
+
+    m_etag = etag;
+    m_last_modified = last_modified;
+    return true;
+}
+
+QByteArray AuManifestCache::getData() const
+{
+    QFile data_file(m_data_file_name);
+    if (!data_file.open(QIODevice::ReadOnly))
+    {
+        return {};
+    }
+    return data_file.readAll();
+}
+
+QByteArray AuManifestCache::getETag() const
+{
+    return m_etag;
+}
+
+QByteArray AuManifestCache::getLastModified() const
+{
+    return m_last_modified;
+}
@@ -0,0 +1,253 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_mirror_list.h"
+#include "au_network_session.h"
+#include <QDebug>
+#include <QNetworkReply>
+#include <QSettings>
+#include <QTimer>
+#include <algorithm>
+
+namespace
+{
+    /**
+     * Bytes fetched from every mirror by probe()
+     */
+    constexpr qint64 PROBE_SIZE = 16 * 1024;
+
+    /**
+     * Mirror speeds hardly change, a probe per update check would mostly
+     * cost bandwidth
+     */
+    constexpr qint64 PROBE_INTERVAL_MS = 24 * 60 * 60 * 1000;
+
+    /**
+     * Mirrors not answering within this time are considered unhealthy
+     */
+    constexpr int PROBE_TIMEOUT_MS = 10000;
+
+    /**
+     * Mirrors are compared by the estimated time to fetch this amount
+     */
+    constexpr qint64 COST_REFERENCE_SIZE = 1024 * 1024;
+}
+
+AuMirrorList::AuMirrorList(const QUrl& origin, AuNetworkSession* session, QObject* parent)
+    : QObject(parent)
+    , m_origin(origin)
+    , m_session(session)
+    , m_mirrors()
+    , m_probe_age()
+    , m_probe_due(true)
+{
+    setMirrors({});
+}
+
+AuMirrorList::~AuMirrorList()
+{
+    setMirrors({});
+}
+
+void AuMirrorList::load()
+{
+    QSettings settings("DEWETRON", "AppUpdate");
+    setMirrors(settings.value("mirrors").toStringList());
+}
+
+QStringList AuMirrorList::getMirrors() const
+{
+    QStringList mirrors;
+    for (const auto& mirror : m_mirrors)
+    {
+        mirrors.append(mirror.base.toString());
+    }
+    return mirrors;
+}
+
+void AuMirrorList::probe(const QUrl& probe_url)
+{
+    auto probe_mirror = findMirror(probe_url);
+    if (!probe_mirror || (m_mirrors.size() < 2))
+    {
+        // nothing to choose from
+        return;
+    }
+    if (!m_probe_due && m_probe_age.isValid() && (m_probe_age.elapsed() < PROBE_INTERVAL_MS))
+    {
+        return;
+    }
+    m_probe_due = false;
+    m_probe_age.start();
+
+    const auto relative_path = probe_url.toString().mid(probe_mirror->base.toString().size());
+
+    for (std::size_t index = 0; index < m_mirrors.size(); ++index)
+    {
+        auto& mirror = m_mirrors[index];
+        if (mirror.probe_reply)
+        {
+            continue;
+        }
+
+        auto request = m_session->createRequest(QUrl(mirror.base.toString() + relative_path));
+        request.setRawHeader("Range", "bytes=0-" + QByteArray::number(PROBE_SIZE - 1));
+        request.setRawHeader("Accept-Encoding", "identity");
+
+        auto reply = m_session->get(request);
+        mirror.latency = -1;
+        mirror.probe_reply = reply;
+        mirror.probe_clock.start();
+
+        connect(reply, &QNetworkReply::metaDataChanged, this, [this, index]() {
+            auto& mirror = m_mirrors[index];
+            if (mirror.latency < 0)
+            {
+                mirror.latency = mirror.probe_clock.elapsed();
+            }
+        });
+        connect(reply, &QNetworkReply::finished, this, [this, index, reply]() {
+            probeReply(m_mirrors[index], reply);
+        });
+        QTimer::singleShot(PROBE_TIMEOUT_MS, reply, [reply]() { reply->abort(); });
+    }
+}
+
+QUrl AuMirrorList::map(const QUrl& url) const
+{
+    auto mirror = findMirror(url);
+    auto best_mirror = bestMirror();
+    if (!mirror || !best_mirror || (mirror == best_mirror))
+    {
+        return url;
+    }
+    return QUrl(best_mirror->base.toString() + url.toString().mid(mirror->base.toString().size()));
+}
+
+void AuMirrorList::reportFailure(const QUrl& url)
+{
+    auto mirror = findMirror(url);
+    if (mirror && mirror->healthy)
+    {
+        qWarning().noquote() << QString("Mirror %1 failed, switching to the next one").arg(mirror->base.toString());
+        mirror->healthy = false;
+        m_probe_due = true;
+    }
+}
+
+void AuMirrorList::setMirrors(const QStringList& mirrors)
+{
+    for (auto& mirror : m_mirrors)
+    {
+        if (mirror.probe_reply)
+        {
+            disconnect(mirror.probe_reply, nullptr, this, nullptr);
+            mirror.probe_reply->abort();
+            mirror.probe_reply->deleteLater();
+        }
+    }
+    m_mirrors.clear();
+    m_probe_due = true;
+
+    // the origin is the last resort unless it is configured explicitly
+    auto bases = mirrors;
+    bases.append(m_origin.toString());
+
+    for (const auto& base_string : bases)
+    {
+        QUrl base(base_string.endsWith("/") ? base_string : base_string + "/");
+        if (!base.isValid() || base.isRelative() || findMirror(base))
+        {
+            continue;
+        }
+        m_mirrors.push_back({ base, true, -1, 0, nullptr, QElapsedTimer() });
+    }
+}
+
+void AuMirrorList::probeReply(Mirror& mirror, QNetworkReply* reply)
+{
+    mirror.probe_reply = nullptr;
+    reply->deleteLater();
+
+    auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    mirror.healthy = (reply->error() == QNetworkReply::NoError) && (status >= 200) && (status < 300);
+    if (mirror.healthy)
+    {
+        auto bytes = reply->readAll().size();
+        auto transfer_time = qMax<qint64>(1, mirror.probe_clock.elapsed() - qMax<qint64>(0, mirror.latency));
+        mirror.bytes_per_second = (1000 * bytes) / transfer_time;
+    }
+
+    if (std::any_of(m_mirrors.begin(), m_mirrors.end(), [](const Mirror& m) { return m.probe_reply != nullptr; }))
+    {
+        return;
+    }
+
+    auto best_mirror = bestMirror();
+    if (best_mirror)
+    {
+        qInfo().noquote() << QString("Using mirror %1 (%2 ms, %3 KiB/s)")
+            .arg(best_mirror->base.toString()).arg(best_mirror->latency).arg(best_mirror->bytes_per_second / 1024);
+    }
+    Q_EMIT probeFinished();
+}
+
+AuMirrorList::Mirror* AuMirrorList::findMirror(const QUrl& url)
+{
+    return const_cast<Mirror*>(static_cast<const AuMirrorList*>(this)->findMirror(url));
+}
+
+const AuMirrorList::Mirror* AuMirrorList::findMirror(const QUrl& url) const
+{
+    const auto url_string = url.toString();
+    for (const auto& mirror : m_mirrors)
+    {
+        if (url_string.startsWith(mirror.base.toString()))
+        {
+            return &mirror;
+        }
+    }
+    return nullptr;
+}
+
+const AuMirrorList::Mirror* AuMirrorList::bestMirror() const
+{
+    // measured mirrors by their cost, otherwise the configured order
+    const Mirror* best_mirror = nullptr;
+    for (const auto& mirror : m_mirrors)
+    {
+        if (!mirror.healthy)
+        {
+            continue;
+        }
+        if (!best_mirror)
+        {
+            best_mirror = &mirror;
+        }
+        else if ((mirror.bytes_per_second > 0)
+            && ((best_mirror->bytes_per_second == 0) || (cost(mirror) < cost(*best_mirror))))
+        {
+            best_mirror = &mirror;
+        }
+    }
+    return best_mirror;
+}
+
+qint64 AuMirrorList::cost(const Mirror& mirror)
+{
+    return qMax<qint64>(0, mirror.latency) + (1000 * COST_REFERENCE_SIZE) / qMax<qint64>(1, mirror.bytes_per_second);
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_network_session.h"
+#include <QDebug>
+
+namespace
+{
+    QString serverName(const QUrl& url)
+    {
+        return QString("%1:%2").arg(url.host()).arg(url.port(443));
+    }
+}
+
+AuNetworkSession::AuNetworkSession(QObject* parent)
+    : QObject(parent)
+    , m_net_access()
+    , m_tls_sessions()
+{
+    connect(&m_net_access, &QNetworkAccessManager::finished, this, &AuNetworkSession::replyFinished);
+}
+
+AuNetworkSession::~AuNetworkSession()
+{
+}
+
+QNetworkRequest AuNetworkSession::createRequest(const QUrl& url) const
+{
+    QNetworkRequest request(url);
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+    if (url.scheme() == "https")
+    {
+        request.setSslConfiguration(getSslConfiguration(url));
+    }
+    return request;
+}
+
+void AuNetworkSession::setCacheDir(const QString& cache_dir)
+{
+    m_tls_sessions.reset(new AuTlsSessionCache(cache_dir));
+    m_tls_sessions->load();
+}
+
+void AuNetworkSession::prewarm(const QUrl& url)
+{
+    qInfo().noquote() << QString("Connecting to %1").arg(url.host());
+
+    // the connection waits in the pool of m_net_access, the DNS answer in the host cache
+    if (url.scheme() == "https")
+    {
+        // a request allowing HTTP/2 only reuses a connection which negotiated it
+        auto ssl_config = getSslConfiguration(url);
+        ssl_config.setAllowedNextProtocols({ QSslConfiguration::ALPNProtocolHTTP2, QSslConfiguration::NextProtocolHttp1_1 });
+        m_net_access.connectToHostEncrypted(url.host(), static_cast<quint16>(url.port(443)), ssl_config);
+    }
+    else
+    {
+        m_net_access.connectToHost(url.host(), static_cast<quint16>(url.port(80)));
+    }
+}
+
+QNetworkReply* AuNetworkSession::get(const QNetworkRequest& request)
+{
+    return m_net_access.get(request);
+}
+
+QNetworkReply* AuNetworkSession::head(const QNetworkRequest& request)
+{
+    return m_net_access.head(request);
+}
+
+QSslConfiguration AuNetworkSession::getSslConfiguration(const QUrl& url) const
+{
+    // Qt only exposes the session of a connection with persistence enabled
+    auto ssl_config = QSslConfiguration::defaultConfiguration();
+    ssl_config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    if (m_tls_sessions)
+    {
+        auto session = m_tls_sessions->find(serverName(url));
+        if (!session.isEmpty())
+        {
+            ssl_config.setSessionTicket(session);
+        }
+    }
+    return ssl_config;
+}
+
+void AuNetworkSession::replyFinished(QNetworkReply* reply)
+{
+    if (!m_tls_sessions || !reply->attribute(QNetworkRequest::ConnectionEncryptedAttribute).toBool())
+    {
+        return;
+    }
+
+    // TLS 1.3 servers send new tickets after the handshake, the latest one is kept
+    auto ssl_config = reply->sslConfiguration();
+    auto session = ssl_config.sessionTicket();
+    if (!session.isEmpty())
+    {
+        m_tls_sessions->store(serverName(reply->url()), session, ssl_config.sessionTicketLifeTimeHint());
+    }
+}
@@ -0,0 +1,553 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_peer_share.h"
+#include "au_installer_store.h"
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QSettings>
+#include <QTcpSocket>
+#include <QUuid>
+
+namespace
+{
+    /**
+     * Announcements go to an administratively scoped group with a TTL of 1,
+     * they never leave the site
+     */
+    constexpr const char* DISCOVERY_GROUP = "239.255.43.21";
+    constexpr quint16 DEFAULT_DISCOVERY_PORT = 45821;
+    constexpr const char* SERVICE_NAME = "AppUpdate";
+    constexpr const char* INSTALLER_PATH = "/installers/";
+
+    /**
+     * Announcements are repeated regularly, peers which missed three of
+     * them are forgotten
+     */
+    constexpr int ANNOUNCE_INTERVAL_MS = 30000;
+    constexpr qint64 PEER_TIMEOUT_MS = 3 * ANNOUNCE_INTERVAL_MS + 5000;
+
+    /**
+     * New peers are answered after a random delay up to this time, so a
+     * site does not answer in a single burst
+     */
+    constexpr int ANSWER_DELAY_MS = 1000;
+
+    /**
+     * A peer which failed a transfer is not used for this time
+     */
+    constexpr qint64 PEER_AVOID_MS = 10 * 60 * 1000;
+
+    /**
+     * Larger announcements are truncated
+     */
+    constexpr int MAX_DATAGRAM_SIZE = 16 * 1024;
+
+    /**
+     * The file server answers one request per connection
+     */
+    constexpr int MAX_UPLOADS = 32;
+    constexpr int MAX_REQUEST_SIZE = 8 * 1024;
+    constexpr int REQUEST_TIMEOUT_MS = 10000;
+    constexpr qint64 SEND_CHUNK_SIZE = 256 * 1024;
+    constexpr qint64 SEND_BUFFER_SIZE = 1024 * 1024;
+
+    /**
+     * Single byte range of a Range header, end is exclusive
+     * @return false if the range cannot be satisfied
+     */
+    bool parseRange(const QByteArray& range, qint64 size, qint64& begin, qint64& end)
+    {
+        if (!range.startsWith("bytes=") || range.contains(','))
+        {
+            return false;
+        }
+
+        const auto spec = range.mid(6).trimmed();
+        const auto dash = spec.indexOf('-');
+        if (dash < 0)
+        {
+            return false;
+        }
+        const auto first = spec.left(dash).trimmed();
+        const auto last = spec.mid(dash + 1).trimmed();
+
+        bool first_ok = true;
+        bool last_ok = true;
+        if (first.isEmpty())
+        {
+            // the last n bytes
+            auto length = last.toLongLong(&last_ok);
+            begin = qMax<qint64>(0, size - length);
+            end = size;
+            return last_ok && (length > 0) && (begin < end);
+        }
+
+        begin = first.toLongLong(&first_ok);
+        end = last.isEmpty() ? size : qMin(size, last.toLongLong(&last_ok) + 1);
+        return first_ok && last_ok && (begin >= 0) && (begin < end);
+    }
+}
+
+AuPeerShare::AuPeerShare(const AuInstallerStore& store, QObject* parent)
+    : QObject(parent)
+    , m_store(store)
+    , m_id(QUuid::createUuid().toByteArray(QUuid::WithoutBraces))
+    , m_discovery_socket()
+    , m_discovery_address()
+    , m_discovery_port(DEFAULT_DISCOVERY_PORT)
+    , m_server()
+    , m_announce_timer()
+    , m_answer_timer()
+    , m_clock()
+    , m_peers()
+    , m_uploads()
+{
+    m_clock.start();
+
+    m_announce_timer.setInterval(ANNOUNCE_INTERVAL_MS);
+    connect(&m_announce_timer, &QTimer::timeout, this, [this]() {
+        expirePeers();
+        announce();
+    });
+    m_answer_timer.setSingleShot(true);
+    connect(&m_answer_timer, &QTimer::timeout, this, &AuPeerShare::announce);
+
+    connect(&m_discovery_socket, &QUdpSocket::readyRead, this, &AuPeerShare::readDatagrams);
+    connect(&m_server, &QTcpServer::newConnection, this, &AuPeerShare::acceptConnections);
+}
+
+AuPeerShare::~AuPeerShare()
+{
+    stop();
+}
+
+bool AuPeerShare::start()
+{
+    if (isRunning())
+    {
+        return true;
+    }
+
+    QSettings settings("DEWETRON", "AppUpdate");
+    m_discovery_port = static_cast<quint16>(settings.value("peer_port", DEFAULT_DISCOVERY_PORT).toUInt());
+
+    // all instances of a host share the port, e.g. several test instances on loopback
+    if (!m_discovery_socket.bind(QHostAddress::AnyIPv4, m_discovery_port,
+        QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint))
+    {
+        qWarning().noquote() << QString("Peer discovery on port %1 failed: %2")
+            .arg(m_discovery_port).arg(m_discovery_socket.errorString());
+        return false;
+    }
+
+    m_discovery_address = QHostAddress(DISCOVERY_GROUP);
+    if (m_discovery_socket.joinMulticastGroup(m_discovery_address))
+    {
+        m_discovery_socket.setSocketOption(QAbstractSocket::MulticastTtlOption, 1);
+        m_discovery_socket.setSocketOption(QAbstractSocket::MulticastLoopbackOption, 1);
+    }
+    else
+    {
+        m_discovery_address = QHostAddress(QHostAddress::Broadcast);
+    }
+
+    // any free port, it is part of the announcement
+    if (!m_server.listen(QHostAddress::AnyIPv4))
+    {
+        qWarning().noquote() << QString("Installer sharing failed: %1").arg(m_server.errorString());
+        m_discovery_socket.close();
+        return false;
+    }
+
+    qInfo().noquote() << QString("Sharing installers on port %1, discovery on %2:%3")
+        .arg(m_server.serverPort()).arg(m_discovery_address.toString()).arg(m_discovery_port);
+    announce();
+    m_announce_timer.start();
+    return true;
+}
+
+void AuPeerShare::stop()
+{
+    if (!isRunning())
+    {
+        return;
+    }
+
+    // peers stop using us right away instead of after the timeout
+    sendAnnouncement(true);
+    m_announce_timer.stop();
+    m_answer_timer.stop();
+
+    if (m_discovery_address != QHostAddress(QHostAddress::Broadcast))
+    {
+        m_discovery_socket.leaveMulticastGroup(m_discovery_address);
+    }
+    m_discovery_socket.close();
+    m_server.close();
+
+    for (auto& upload : m_uploads)
+    {
+        disconnect(upload.first, nullptr, this, nullptr);
+        upload.first->abort();
+        upload.first->deleteLater();
+    }
+    m_uploads.clear();
+
+    m_peers.clear();
+    Q_EMIT peersChanged();
+}
+
+bool AuPeerShare::isRunning() const
+{
+    return m_server.isListening();
+}
+
+void AuPeerShare::announce()
+{
+    if (isRunning())
+    {
+        sendAnnouncement(false);
+    }
+}
+
+QUrl AuPeerShare::findPeer(const QByteArray& sha1) const
+{
+    const auto now = m_clock.elapsed();
+    const auto hash = sha1.toLower();
+
+    QList<const Peer*> candidates;
+    for (const auto& peer : m_peers)
+    {
+        if (peer.installers.contains(hash) && (peer.avoid_until <= now))
+        {
+            candidates.append(&peer);
+        }
+    }
+    if (candidates.isEmpty())
+    {
+        return {};
+    }
+
+    // spread the downloads of a site over all peers which have the installer
+    auto peer = candidates[QRandomGenerator::global()->bounded(candidates.size())];
+    return QUrl(QString("http://%1:%2%3%4")
+        .arg(peer->address.toString()).arg(peer->port).arg(INSTALLER_PATH, QString::fromLatin1(hash)));
+}
+
+void AuPeerShare::reportFailure(const QUrl& peer_url)
+{
+    for (auto& peer : m_peers)
+    {
+        if ((peer.address == QHostAddress(peer_url.host())) && (peer.port == peer_url.port()))
+        {
+            qWarning().noquote() << QString("Peer %1:%2 failed, avoiding it for %3 minutes")
+                .arg(peer.address.toString()).arg(peer.port).arg(PEER_AVOID_MS / 60000);
+            peer.avoid_until = m_clock.elapsed() + PEER_AVOID_MS;
+        }
+    }
+}
+
+void AuPeerShare::sendAnnouncement(bool leaving)
+{
+    QJsonArray installers;
+    if (!leaving)
+    {
+        int size = 0;
+        for (const auto& sha1 : m_store.getHashes())
+        {
+            // room for the other members
+            size += sha1.size() + 3;
+            if (size > MAX_DATAGRAM_SIZE - 512)
+            {
+                break;
+            }
+            installers.append(QString::fromLatin1(sha1));
+        }
+    }
+
+    QJsonObject announcement{
+        { "service", SERVICE_NAME },
+        { "id", QString::fromLatin1(m_id) },
+        { "port", m_server.serverPort() },
+        { "installers", installers }
+    };
+    if (leaving)
+    {
+        announcement.insert("leaving", true);
+    }
+
+    m_discovery_socket.writeDatagram(QJsonDocument(announcement).toJson(QJsonDocument::Compact),
+        m_discovery_address, m_discovery_port);
+}
+
+void AuPeerShare::readDatagrams()
+{
+    bool new_peer = false;
+    while (m_discovery_socket.hasPendingDatagrams())
+    {
+        auto datagram = m_discovery_socket.receiveDatagram(MAX_DATAGRAM_SIZE);
+        auto announcement = QJsonDocument::fromJson(datagram.data()).object();
+
+        // our own announcements come back through the loopback
+        const auto id = announcement.value("id").toString().toLatin1();
+        if ((announcement.value("service").toString() != SERVICE_NAME) || id.isEmpty() || (id == m_id))
+        {
+            continue;
+        }
+
+        if (announcement.value("leaving").toBool())
+        {
+            m_peers.remove(id);
+            continue;
+        }
+
+        auto peer_it = m_peers.find(id);
+        if (peer_it == m_peers.end())
+        {
+            new_peer = true;
+            peer_it = m_peers.insert(id, { QHostAddress(), 0, {}, 0, 0 });
+        }
+        peer_it->address = datagram.senderAddress();
+        peer_it->port = static_cast<quint16>(announcement.value("port").toInt());
+        peer_it->installers.clear();
+        for (const auto& sha1 : announcement.value("installers").toArray())
+        {
+            peer_it->installers.insert(sha1.toString().toLatin1().toLower());
+        }
+        peer_it->last_seen = m_clock.elapsed();
+    }
+
+    if (new_peer && !m_answer_timer.isActive())
+    {
+        // a new instance learns about us without waiting for the next interval
+        m_answer_timer.start(QRandomGenerator::global()->bounded(ANSWER_DELAY_MS));
+    }
+    Q_EMIT peersChanged();
+}
+
+void AuPeerShare::expirePeers()
+{
+    const auto now = m_clock.elapsed();
+    for (auto peer_it = m_peers.begin(); peer_it != m_peers.end();)
+    {
+        if (now - peer_it->last_seen > PEER_TIMEOUT_MS)
+        {
+            peer_it = m_peers.erase(peer_it);
+        }
+        else
+        {
+            ++peer_it;
+        }
+    }
+}
+
+void AuPeerShare::acceptConnections()
+{
+    while (m_server.hasPendingConnections())
+    {
+        auto socket = m_server.nextPendingConnection();
+        const bool busy = (static_cast<int>(m_uploads.size()) >= MAX_UPLOADS);
+        m_uploads.emplace(socket, Upload());
+
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { readRequest(socket); });
+        connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]() { sendBody(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() { closeUpload(socket); });
+
+        if (busy)
+        {
+            // the downloader retries later or falls back to the mirrors
+            m_uploads[socket].responded = true;
+            sendResponse(socket, 503, "Service Unavailable", { "Retry-After: 5", "Content-Length: 0" });
+            sendBody(socket);
+            continue;
+        }
+
+        // connections without a complete request are dropped
+        QTimer::singleShot(REQUEST_TIMEOUT_MS, socket, [this, socket]() {
+            auto upload_it = m_uploads.find(socket);
+            if ((upload_it != m_uploads.end()) && !upload_it->second.responded)
+            {
+                socket->abort();
+            }
+        });
+    }
+}
+
+void AuPeerShare::readRequest(QTcpSocket* socket)
+{
+    auto upload_it = m_uploads.find(socket);
+    if (upload_it == m_uploads.end())
+    {
+        return;
+    }
+    auto& upload = upload_it->second;
+
+    if (upload.responded)
+    {
+        // one request per connection
+        socket->readAll();
+        return;
+    }
+
+    upload.request.append(socket->readAll());
+    if (upload.request.contains("\r\n\r\n"))
+    {
+        upload.responded = true;
+        handleRequest(socket, upload);
+    }
+    else if (upload.request.size() > MAX_REQUEST_SIZE)
+    {
+        upload.responded = true;
+        sendResponse(socket, 431, "Request Header Fields Too Large", { "Content-Length: 0" });
+        sendBody(socket);
+    }
+}
+
+void AuPeerShare::handleRequest(QTcpSocket* socket, Upload& upload)
+{
+    auto lines = upload.request.left(upload.request.indexOf("\r\n\r\n")).split('\n');
+    const auto request_line = lines.takeFirst().trimmed().split(' ');
+    if ((request_line.size() != 3) || !request_line[2].startsWith("HTTP/1."))
+    {
+        sendResponse(socket, 400, "Bad Request", { "Content-Length: 0" });
+        sendBody(socket);
+        return;
+    }
+
+    const auto& method = request_line[0];
+    const auto& path = request_line[1];
+    if ((method != "GET") && (method != "HEAD"))
+    {
+        sendResponse(socket, 405, "Method Not Allowed", { "Allow: GET, HEAD", "Content-Length: 0" });
+        sendBody(socket);
+        return;
+    }
+
+    // only verified installers are served, the path is nothing but their hash
+    const auto sha1 = path.startsWith(INSTALLER_PATH) ? path.mid(qstrlen(INSTALLER_PATH)).toLower() : QByteArray();
+    const auto file_name = sha1.isEmpty() ? QString() : m_store.find(sha1);
+    std::unique_ptr<QFile> file(new QFile(file_name));
+    if (file_name.isEmpty() || !file->open(QIODevice::ReadOnly))
+    {
+        sendResponse(socket, 404, "Not Found", { "Content-Length: 0" });
+        sendBody(socket);
+        return;
+    }
+
+    QByteArray range;
+    for (const auto& line : lines)
+    {
+        const auto colon = line.indexOf(':');
+        if ((colon > 0) && (line.left(colon).trimmed().toLower() == "range"))
+        {
+            range = line.mid(colon + 1).trimmed();
+        }
+    }
+
+    // the hash is a strong validator, the downloader resumes with If-Range
+    const auto size = file->size();
+    QList<QByteArray> headers{
+        "Accept-Ranges: bytes",
+        "Content-Type: application/octet-stream",
+        "ETag: \"" + sha1 + "\""
+    };
+    const auto stored_name = m_store.getFileName(sha1);
+    if (!stored_name.isEmpty())
+    {
+        headers.append("Content-Disposition: attachment; filename=\"" + stored_name.toUtf8() + "\"");
+    }
+
+    qint64 begin = 0;
+    qint64 end = size;
+    int status = 200;
+    QByteArray reason = "OK";
+    if (!range.isEmpty())
+    {
+        if (!parseRange(range, size, begin, end))
+        {
+            sendResponse(socket, 416, "Range Not Satisfiable",
+                { "Content-Range: bytes */" + QByteArray::number(size), "Content-Length: 0" });
+            sendBody(socket);
+            return;
+        }
+        status = 206;
+        reason = "Partial Content";
+        headers.append("Content-Range: bytes " + QByteArray::number(begin) + "-"
+            + QByteArray::number(end - 1) + "/" + QByteArray::number(size));
+    }
+    headers.append("Content-Length: " + QByteArray::number(end - begin));
+    sendResponse(socket, status, reason, headers);
+
+    if (method == "GET")
+    {
+        file->seek(begin);
+        upload.file = std::move(file);
+        upload.remaining = end - begin;
+    }
+    sendBody(socket);
+}
+
+void AuPeerShare::sendResponse(QTcpSocket* socket, int status, const QByteArray& reason, const QList<QByteArray>& headers)
+{
+    QByteArray response = "HTTP/1.1 " + QByteArray::number(status) + " " + reason + "\r\n";
+    for (const auto& header : headers)
+    {
+        response += header + "\r\n";
+    }
+    response += "Connection: close\r\n\r\n";
+    socket->write(response);
+}
+
+void AuPeerShare::sendBody(QTcpSocket* socket)
+{
+    auto upload_it = m_uploads.find(socket);
+    if (upload_it == m_uploads.end())
+    {
+        return;
+    }
+    auto& upload = upload_it->second;
+
+    // keep the socket busy without reading the whole installer into memory
+    while ((upload.remaining > 0) && (socket->bytesToWrite() < SEND_BUFFER_SIZE))
+    {
+        auto chunk = upload.file->read(qMin(upload.remaining, SEND_CHUNK_SIZE));
+        if (chunk.isEmpty())
+        {
+            // the downloader notices the short body
+            socket->abort();
+            return;
+        }
+        upload.remaining -= chunk.size();
+        socket->write(chunk);
+    }
+
+    if ((upload.remaining == 0) && (socket->state() == QAbstractSocket::ConnectedState))
+    {
+        // closed once the buffered data is sent
+        socket->disconnectFromHost();
+    }
+}
+
+void AuPeerShare::closeUpload(QTcpSocket* socket)
+{
+    m_uploads.erase(socket);
+    socket->deleteLater();
+}
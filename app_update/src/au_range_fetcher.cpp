@@ -0,0 +1,467 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_range_fetcher.h"
+#include "au_bandwidth_limiter.h"
+#include "au_mirror_list.h"
+#include "au_network_session.h"
+#include <algorithm>
+#include <QNetworkRequest>
+
+namespace
+{
+    /**
+     * Fetching a small gap is cheaper than another range
+     */
+    constexpr qint64 MAX_GAP = 4 * 1024;
+
+    /**
+     * Limits of one request, the reply is kept in memory until it completes
+     */
+    constexpr int MAX_RANGES_PER_REQUEST = 16;
+    constexpr qint64 MAX_REQUEST_BYTES = 8 * 1024 * 1024;
+
+    constexpr int MAX_PARALLEL_REQUESTS = 4;
+
+    /**
+     * Unread data of a throttled reply stalls the connection
+     */
+    constexpr qint64 READ_BUFFER_SIZE = 1024 * 1024;
+
+    constexpr int MAX_RETRIES = 3;
+
+    /**
+     * Requests without any progress for that long are given up
+     */
+    constexpr int WATCHDOG_INTERVAL_MS = 60 * 1000;
+}
+
+AuRangeFetcher::AuRangeFetcher(QUrl dl_url, const QString& file_name, AuNetworkSession* session, QObject* parent)
+    : QObject(parent)
+    , m_dl_url(dl_url)
+    , m_request_url(dl_url)
+    , m_session(session)
+    , m_mirrors(nullptr)
+    , m_limiter(nullptr)
+    , m_file(file_name)
+    , m_pending()
+    , m_replies()
+    , m_bodies()
+    , m_watchdog_timer()
+    , m_retry_count(0)
+    , m_progressed(false)
+    , m_total(0)
+    , m_fetched(0)
+    , m_error()
+{
+    m_watchdog_timer.setInterval(WATCHDOG_INTERVAL_MS);
+    connect(&m_watchdog_timer, &QTimer::timeout, this, &AuRangeFetcher::checkTimeout);
+}
+
+AuRangeFetcher::~AuRangeFetcher()
+{
+    abort();
+}
+
+void AuRangeFetcher::setMirrorList(AuMirrorList* mirrors)
+{
+    m_mirrors = mirrors;
+}
+
+void AuRangeFetcher::setBandwidthLimiter(AuBandwidthLimiter* limiter)
+{
+    if (m_limiter)
+    {
+        disconnect(m_limiter, nullptr, this, nullptr);
+    }
+    m_limiter = limiter;
+    if (m_limiter)
+    {
+        connect(m_limiter, &AuBandwidthLimiter::refilled, this, &AuRangeFetcher::readPending);
+    }
+}
+
+void AuRangeFetcher::start(const QList<AuByteRange>& ranges)
+{
+    abort();
+    m_pending.clear();
+    m_retry_count = 0;
+    m_total = 0;
+    m_fetched = 0;
+    m_error.clear();
+    m_request_url = m_mirrors ? m_mirrors->map(m_dl_url) : m_dl_url;
+
+    if (!m_file.open(QIODevice::ReadWrite))
+    {
+        fail(QString("Could not open %1: %2").arg(m_file.fileName(), m_file.errorString()));
+        return;
+    }
+
+    auto sorted = ranges;
+    std::sort(sorted.begin(), sorted.end());
+
+    // merge neighbours, split what does not fit into one request
+    QList<AuByteRange> merged;
+    for (const auto& range : sorted)
+    {
+        if (!merged.isEmpty() && (range.first <= merged.last().first + merged.last().second + MAX_GAP))
+        {
+            auto& last = merged.last();
+            last.second = qMax(last.first + last.second, range.first + range.second) - last.first;
+        }
+        else
+        {
+            merged.append(range);
+        }
+    }
+
+    Batch batch;
+    qint64 batch_bytes = 0;
+    for (auto range : merged)
+    {
+        m_total += range.second;
+        while (range.second > 0)
+        {
+            const auto length = qMin(range.second, MAX_REQUEST_BYTES - batch_bytes);
+            batch.append({ range.first, length });
+            batch_bytes += length;
+            range.first += length;
+            range.second -= length;
+
+            if ((batch.size() == MAX_RANGES_PER_REQUEST) || (batch_bytes == MAX_REQUEST_BYTES))
+            {
+                m_pending.append(batch);
+                batch.clear();
+                batch_bytes = 0;
+            }
+        }
+    }
+    if (!batch.isEmpty())
+    {
+        m_pending.append(batch);
+    }
+
+    Q_EMIT fetchProgress(m_dl_url, 0, m_total);
+    m_watchdog_timer.start();
+    requestNext();
+}
+
+void AuRangeFetcher::abort()
+{
+    m_watchdog_timer.stop();
+    for (auto reply_it = m_replies.begin(); reply_it != m_replies.end(); ++reply_it)
+    {
+        disconnect(reply_it.key(), nullptr, this, nullptr);
+        reply_it.key()->abort();
+        reply_it.key()->deleteLater();
+    }
+    m_replies.clear();
+    m_bodies.clear();
+    m_file.close();
+}
+
+QUrl AuRangeFetcher::getUrl() const
+{
+    return m_dl_url;
+}
+
+QString AuRangeFetcher::getError() const
+{
+    return m_error;
+}
+
+qint64 AuRangeFetcher::getTransferSize() const
+{
+    return m_total;
+}
+
+void AuRangeFetcher::requestNext()
+{
+    while (!m_pending.isEmpty() && (m_replies.size() < MAX_PARALLEL_REQUESTS))
+    {
+        const auto batch = m_pending.takeFirst();
+
+        QByteArray range = "bytes=";
+        for (const auto& byte_range : batch)
+        {
+            if (range.size() > 6)
+            {
+                range += ",";
+            }
+            range += QByteArray::number(byte_range.first) + "-" + QByteArray::number(byte_range.first + byte_range.second - 1);
+        }
+
+        auto request = m_session->createRequest(m_request_url);
+        request.setRawHeader("Range", range);
+        request.setRawHeader("Accept-Encoding", "identity");
+
+        auto reply = m_session->get(request);
+        connect(reply, &QNetworkReply::finished, this, &AuRangeFetcher::replyFinished);
+        connect(reply, &QNetworkReply::downloadProgress, this, [this]() {
+            m_progressed = true;
+        });
+        if (m_limiter)
+        {
+            // the body is collected as the limit allows instead of at once
+            reply->setReadBufferSize(READ_BUFFER_SIZE);
+            connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
+                readReply(reply, true);
+            });
+        }
+        m_replies.insert(reply, batch);
+    }
+
+    if (m_replies.isEmpty() && m_error.isEmpty())
+    {
+        m_watchdog_timer.stop();
+        m_file.close();
+        Q_EMIT fetchFinished(m_dl_url);
+    }
+}
+
+void AuRangeFetcher::replyFinished()
+{
+    auto reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply || !m_replies.contains(reply))
+    {
+        return;
+    }
+    const auto batch = m_replies.take(reply);
+    reply->deleteLater();
+    m_progressed = true;
+
+    // the rest of a finished reply is read anyway
+    readReply(reply, false);
+    const auto body = m_bodies.take(reply);
+
+    if (reply->error() != QNetworkReply::NoError)
+    {
+        if (++m_retry_count > MAX_RETRIES)
+        {
+            if (m_mirrors)
+            {
+                m_mirrors->reportFailure(m_request_url);
+            }
+            fail(reply->errorString());
+            return;
+        }
+        // the other requests continue, this one is queued again
+        m_pending.append(batch);
+        requestNext();
+        return;
+    }
+
+    if (!writeReply(reply, body, batch))
+    {
+        return;
+    }
+    requestNext();
+}
+
+void AuRangeFetcher::readPending()
+{
+    // continue replies which were stopped by the bandwidth limit
+    for (auto reply : m_replies.keys())
+    {
+        readReply(reply, true);
+    }
+}
+
+void AuRangeFetcher::readReply(QNetworkReply* reply, bool throttled)
+{
+    auto& body = m_bodies[reply];
+    while (reply->bytesAvailable() > 0)
+    {
+        auto read_size = reply->bytesAvailable();
+        if (throttled && m_limiter)
+        {
+            read_size = qMin(read_size, m_limiter->available());
+            if (read_size <= 0)
+            {
+                // continued by readPending
+                return;
+            }
+        }
+
+        const auto chunk = reply->read(read_size);
+        if (chunk.isEmpty())
+        {
+            return;
+        }
+        if (m_limiter)
+        {
+            m_limiter->consume(chunk.size());
+        }
+        body += chunk;
+    }
+}
+
+void AuRangeFetcher::checkTimeout()
+{
+    if (!m_progressed && !m_replies.isEmpty())
+    {
+        fail("Range request timed out");
+        return;
+    }
+    m_progressed = false;
+}
+
+bool AuRangeFetcher::writeReply(QNetworkReply* reply, const QByteArray& body, const Batch& batch)
+{
+    const auto http_status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (http_status != 206)
+    {
+        fail(QString("Server does not support range requests (HTTP %1)").arg(http_status));
+        return false;
+    }
+
+    const auto content_type = reply->header(QNetworkRequest::ContentTypeHeader).toByteArray();
+    QList<AuByteRange> received;
+
+    if (content_type.startsWith("multipart/byteranges"))
+    {
+        const auto boundary_pos = content_type.indexOf("boundary=");
+        auto boundary = (boundary_pos >= 0) ? content_type.mid(boundary_pos + 9).trimmed() : QByteArray();
+        if (boundary.startsWith('"') && boundary.endsWith('"'))
+        {
+            boundary = boundary.mid(1, boundary.size() - 2);
+        }
+        if (boundary.isEmpty() || !writeMultipart(boundary, body, received))
+        {
+            if (m_error.isEmpty())
+            {
+                fail("Invalid multipart response");
+            }
+            return false;
+        }
+    }
+    else
+    {
+        // a single range, or all of them combined into one
+        qint64 first = 0;
+        qint64 last = 0;
+        if (!parseContentRange(reply->rawHeader("Content-Range"), first, last) || (last - first + 1 != body.size()))
+        {
+            fail("Invalid Content-Range");
+            return false;
+        }
+        if (!writeRange(first, body.constData(), body.size()))
+        {
+            return false;
+        }
+        received.append({ first, body.size() });
+    }
+
+    for (const auto& range : batch)
+    {
+        auto covered = std::any_of(received.begin(), received.end(), [&range](const AuByteRange& part) {
+            return (part.first <= range.first) && (range.first + range.second <= part.first + part.second);
+        });
+        if (!covered)
+        {
+            fail(QString("Server did not send bytes %1-%2").arg(range.first).arg(range.first + range.second - 1));
+            return false;
+        }
+        m_fetched += range.second;
+    }
+    Q_EMIT fetchProgress(m_dl_url, m_fetched, m_total);
+    return true;
+}
+
+bool AuRangeFetcher::writeMultipart(const QByteArray& boundary, const QByteArray& body, QList<AuByteRange>& received)
+{
+    const QByteArray delimiter = "--" + boundary;
+    auto pos = body.indexOf(delimiter);
+    while (pos >= 0)
+    {
+        pos += delimiter.size();
+        if (body.mid(pos, 2) == "--")
+        {
+            // closing delimiter
+            return true;
+        }
+
+        const auto headers_end = body.indexOf("\r\n\r\n", pos);
+        if (headers_end < 0)
+        {
+            return false;
+        }
+
+        qint64 first = -1;
+        qint64 last = -1;
+        for (const auto& line : body.mid(pos, headers_end - pos).split('\n'))
+        {
+            const auto header = line.trimmed();
+            if (header.toLower().startsWith("content-range:"))
+            {
+                parseContentRange(header.mid(14).trimmed(), first, last);
+            }
+        }
+
+        // the part length is known, binary data may contain anything
+        const auto data_pos = headers_end + 4;
+        const auto length = last - first + 1;
+        if ((first < 0) || (last < first) || (data_pos + length > body.size()))
+        {
+            return false;
+        }
+        if (!writeRange(first, body.constData() + data_pos, length))
+        {
+            return false;
+        }
+        received.append({ first, length });
+        pos = body.indexOf(delimiter, static_cast<int>(data_pos + length));
+    }
+    return false;
+}
+
+bool AuRangeFetcher::writeRange(qint64 offset, const char* data, qint64 length)
+{
+    if (!m_file.seek(offset) || (m_file.write(data, length) != length))
+    {
+        fail(QString("Could not write %1: %2").arg(m_file.fileName(), m_file.errorString()));
+        return false;
+    }
+    return true;
+}
+
+void AuRangeFetcher::fail(const QString& error)
+{
+    abort();
+    m_pending.clear();
+    m_error = error;
+    Q_EMIT fetchError(m_dl_url);
+}
+
+bool AuRangeFetcher::parseContentRange(const QByteArray& content_range, qint64& first, qint64& last)
+{
+    // "bytes 0-499/1234"
+    if (!content_range.startsWith("bytes "))
+    {
+        return false;
+    }
+    const auto range = content_range.mid(6).split('/').value(0).split('-');
+    if (range.size() != 2)
+    {
+        return false;
+    }
+    bool first_ok = false;
+    bool last_ok = false;
+    first = range[0].trimmed().toLongLong(&first_ok);
+    last = range[1].trimmed().toLongLong(&last_ok);
+    return first_ok && last_ok && (first <= last);
+}
@@ -0,0 +1,118 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_tls_session_cache.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+namespace
+{
+    /**
+     * Used if the server gives no lifetime hint, long enough to reach the
+     * next daily check
+     */
+    constexpr qint64 DEFAULT_LIFETIME_S = 36 * 60 * 60;
+
+    /**
+     * Upper limit of TLS 1.3 tickets
+     */
+    constexpr qint64 MAX_LIFETIME_S = 7 * 24 * 60 * 60;
+}
+
+AuTlsSessionCache::AuTlsSessionCache(const QString& cache_dir)
+    : m_file_name(cache_dir + "/tls_sessions.json")
+    , m_entries()
+{
+    QDir().mkpath(cache_dir);
+}
+
+bool AuTlsSessionCache::load()
+{
+    m_entries.clear();
+
+    QFile cache_file(m_file_name);
+    if (!cache_file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    const auto now = QDateTime::currentMSecsSinceEpoch();
+    const auto sessions = QJsonDocument::fromJson(cache_file.readAll()).object();
+    for (const auto& server : sessions.keys())
+    {
+        auto entry = sessions[server].toObject();
+        auto expires = static_cast<qint64>(entry["expires"].toDouble());
+        if (expires > now)
+        {
+            m_entries.insert(server, { QByteArray::fromBase64(entry["session"].toString().toLatin1()), expires });
+        }
+    }
+    return true;
+}
+
+QByteArray AuTlsSessionCache::find(const QString& server) const
+{
+    auto entry_it = m_entries.find(server);
+    if ((entry_it == m_entries.end()) || (entry_it->expires <= QDateTime::currentMSecsSinceEpoch()))
+    {
+        return {};
+    }
+    return entry_it->session;
+}
+
+bool AuTlsSessionCache::store(const QString& server, const QByteArray& session, int lifetime)
+{
+    auto entry_it = m_entries.find(server);
+    if ((entry_it != m_entries.end()) && (entry_it->session == session))
+    {
+        return true;
+    }
+
+    const auto lifetime_s = (lifetime < 0) ? DEFAULT_LIFETIME_S : qMin<qint64>(lifetime, MAX_LIFETIME_S);
+    m_entries.insert(server, { session, QDateTime::currentMSecsSinceEpoch() + 1000 * lifetime_s });
+    return save();
+}
+
+bool AuTlsSessionCache::save() const
+{
+    QJsonObject sessions;
+    for (auto entry_it = m_entries.begin(); entry_it != m_entries.end(); ++entry_it)
+    {
+        QJsonObject entry;
+        entry["session"] = QString::fromLatin1(entry_it->session.toBase64());
+        entry["expires"] = static_cast<double>(entry_it->expires);
+        sessions[entry_it.key()] = entry;
+    }
+
+    QSaveFile cache_file(m_file_name);
+    if (!cache_file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    // session tickets are secrets, the temporary file is restricted before it receives them
+    if (!cache_file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner))
+    {
+        cache_file.cancelWriting();
+        return false;
+    }
+    cache_file.write(QJsonDocument(sessions).toJson(QJsonDocument::Compact));
+    return cache_file.commit();
+}
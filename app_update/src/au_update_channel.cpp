@@ -0,0 +1,322 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_update_channel.h"
+#include "au_network_session.h"
+#include <QDebug>
+#include <QNetworkReply>
+#include <QRandomGenerator>
+
+namespace
+{
+    /**
+     * Reconnect delay of a closed stream unless the server sends "retry:",
+     * failures double it up to MAX_RECONNECT_MS
+     */
+    constexpr int DEFAULT_RETRY_MS = 3000;
+    constexpr int MAX_RECONNECT_MS = 5 * 60 * 1000;
+
+    /**
+     * A channel without any data for this time is considered dead. Servers
+     * send keepalive comments or answer long-polls well before.
+     */
+    constexpr int IDLE_TIMEOUT_MS = 120000;
+
+    /**
+     * Long-polls are not repeated faster than this
+     */
+    constexpr int MIN_POLL_INTERVAL_MS = 1000;
+
+    /**
+     * A long-poll answered faster was not held by the server, e.g. a plain
+     * web server or a proxy, and is repeated with the failure backoff
+     */
+    constexpr qint64 MIN_HOLD_MS = 10000;
+
+    /**
+     * Changes are reported after a random delay up to this time
+     */
+    constexpr int NOTIFY_JITTER_MS = 30000;
+}
+
+AuUpdateChannel::AuUpdateChannel(AuNetworkSession* session, QObject* parent)
+    : QObject(parent)
+    , m_session(session)
+    , m_endpoint()
+    , m_reply(nullptr)
+    , m_event_stream(false)
+    , m_buffer()
+    , m_event_name()
+    , m_event_data()
+    , m_last_event_id()
+    , m_etag()
+    , m_pending_etag()
+    , m_retry_ms(DEFAULT_RETRY_MS)
+    , m_failures(0)
+    , m_request_clock()
+    , m_reconnect_timer()
+    , m_idle_timer()
+    , m_notify_timer()
+{
+    m_reconnect_timer.setSingleShot(true);
+    connect(&m_reconnect_timer, &QTimer::timeout, this, &AuUpdateChannel::connectChannel);
+
+    m_idle_timer.setSingleShot(true);
+    m_idle_timer.setInterval(IDLE_TIMEOUT_MS);
+    connect(&m_idle_timer, &QTimer::timeout, this, [this]() {
+        if (m_reply)
+        {
+            qWarning().noquote() << QString("Update channel %1 idle, reconnecting").arg(m_endpoint.toString());
+            m_reply->abort();
+        }
+    });
+
+    m_notify_timer.setSingleShot(true);
+    connect(&m_notify_timer, &QTimer::timeout, this, [this]() {
+        Q_EMIT manifestChanged(m_pending_etag);
+    });
+}
+
+AuUpdateChannel::~AuUpdateChannel()
+{
+    stop();
+}
+
+void AuUpdateChannel::start(const QUrl& endpoint)
+{
+    stop();
+    m_endpoint = endpoint;
+    if (m_endpoint.isValid() && !m_endpoint.isRelative())
+    {
+        connectChannel();
+    }
+}
+
+void AuUpdateChannel::stop()
+{
+    m_reconnect_timer.stop();
+    m_notify_timer.stop();
+    closeReply();
+    m_endpoint = QUrl();
+    m_failures = 0;
+}
+
+void AuUpdateChannel::connectChannel()
+{
+    closeReply();
+    m_event_stream = false;
+    m_buffer.clear();
+    m_event_name.clear();
+    m_event_data.clear();
+
+    auto request = m_session->createRequest(m_endpoint);
+    request.setRawHeader("Accept", "text/event-stream");
+    request.setRawHeader("Cache-Control", "no-cache");
+    if (!m_last_event_id.isEmpty())
+    {
+        request.setRawHeader("Last-Event-ID", m_last_event_id);
+    }
+    if (!m_etag.isEmpty())
+    {
+        // a long-poll server answers once the manifest differs
+        request.setRawHeader("If-None-Match", m_etag);
+    }
+
+    m_reply = m_session->get(request);
+    connect(m_reply, &QNetworkReply::metaDataChanged, this, &AuUpdateChannel::responseHeaders);
+    connect(m_reply, &QNetworkReply::readyRead, this, &AuUpdateChannel::dataAvailable);
+    connect(m_reply, &QNetworkReply::finished, this, &AuUpdateChannel::replyFinished);
+    m_request_clock.start();
+    m_idle_timer.start();
+}
+
+void AuUpdateChannel::responseHeaders()
+{
+    auto status = m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    m_event_stream = (status == 200)
+        && m_reply->header(QNetworkRequest::ContentTypeHeader).toString().startsWith("text/event-stream");
+    if (m_event_stream)
+    {
+        qInfo().noquote() << QString("Subscribed to manifest changes at %1").arg(m_endpoint.toString());
+    }
+}
+
+void AuUpdateChannel::dataAvailable()
+{
+    m_idle_timer.start();
+    if (m_event_stream)
+    {
+        m_buffer.append(m_reply->readAll());
+        parseEvents();
+    }
+}
+
+void AuUpdateChannel::replyFinished()
+{
+    auto reply = m_reply;
+    m_reply = nullptr;
+    m_idle_timer.stop();
+    reply->deleteLater();
+
+    auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if ((reply->error() != QNetworkReply::NoError) || ((status != 200) && (status != 304)))
+    {
+        auto delay = backoffDelay();
+        qWarning().noquote() << QString("Update channel %1 failed: %2, reconnecting in %3 s")
+            .arg(m_endpoint.toString(), reply->errorString()).arg(delay / 1000);
+        reconnect(delay);
+        return;
+    }
+
+    if (m_event_stream)
+    {
+        // the server closed the stream
+        m_failures = 0;
+        reconnect(m_retry_ms);
+        return;
+    }
+
+    if (status == 200)
+    {
+        auto etag = reply->rawHeader("ETag");
+        reportETag(etag.isEmpty() ? reply->readAll().trimmed() : etag);
+    }
+
+    if (m_request_clock.elapsed() < MIN_HOLD_MS)
+    {
+        // not held, polling at full speed would hammer the server
+        reconnect(backoffDelay());
+        return;
+    }
+    m_failures = 0;
+    reconnect(MIN_POLL_INTERVAL_MS);
+}
+
+void AuUpdateChannel::parseEvents()
+{
+    int line_end = 0;
+    while ((line_end = m_buffer.indexOf('\n')) >= 0)
+    {
+        auto line = m_buffer.left(line_end);
+        m_buffer.remove(0, line_end + 1);
+        if (line.endsWith('\r'))
+        {
+            line.chop(1);
+        }
+
+        if (line.isEmpty())
+        {
+            dispatchEvent();
+            continue;
+        }
+        if (line.startsWith(':'))
+        {
+            // keepalive comment
+            continue;
+        }
+
+        auto colon = line.indexOf(':');
+        auto field = (colon < 0) ? line : line.left(colon);
+        auto value = (colon < 0) ? QByteArray() : line.mid(colon + 1);
+        if (value.startsWith(' '))
+        {
+            value.remove(0, 1);
+        }
+
+        if (field == "event")
+        {
+            m_event_name = value;
+        }
+        else if (field == "data")
+        {
+            if (!m_event_data.isEmpty())
+            {
+                m_event_data.append('\n');
+            }
+            m_event_data.append(value);
+        }
+        else if (field == "id")
+        {
+            m_last_event_id = value;
+        }
+        else if (field == "retry")
+        {
+            bool ok = false;
+            auto retry_ms = value.toInt(&ok);
+            if (ok && (retry_ms > 0))
+            {
+                m_retry_ms = qMin(retry_ms, MAX_RECONNECT_MS);
+            }
+        }
+    }
+}
+
+void AuUpdateChannel::dispatchEvent()
+{
+    if (m_event_name.isEmpty() || (m_event_name == "manifest"))
+    {
+        reportETag(m_event_data.trimmed());
+    }
+    m_event_name.clear();
+    m_event_data.clear();
+}
+
+void AuUpdateChannel::reportETag(const QByteArray& etag)
+{
+    if (etag.isEmpty() || (etag == m_etag))
+    {
+        return;
+    }
+    m_etag = etag;
+    m_pending_etag = etag;
+
+    if (!m_notify_timer.isActive())
+    {
+        m_notify_timer.start(QRandomGenerator::global()->bounded(NOTIFY_JITTER_MS));
+    }
+}
+
+void AuUpdateChannel::reconnect(int delay)
+{
+    if (!m_endpoint.isEmpty())
+    {
+        m_reconnect_timer.start(delay);
+    }
+}
+
+int AuUpdateChannel::backoffDelay()
+{
+    // the jitter keeps a site from reconnecting at once
+    // the server chooses the base, 64 bit keep the shift from overflowing
+    const auto base = static_cast<qint64>(qMin(m_retry_ms, MAX_RECONNECT_MS));
+    auto delay = static_cast<int>(qMin<qint64>(MAX_RECONNECT_MS, base << qMin(m_failures, 16)));
+    delay -= static_cast<int>(QRandomGenerator::global()->bounded(delay / 2 + 1));
+    ++m_failures;
+    return delay;
+}
+
+void AuUpdateChannel::closeReply()
+{
+    m_idle_timer.stop();
+    if (m_reply)
+    {
+        disconnect(m_reply, nullptr, this, nullptr);
+        m_reply->abort();
+        m_reply->deleteLater();
+        m_reply = nullptr;
+    }
+}
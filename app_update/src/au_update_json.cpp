@@ -16,83 +16,587 @@
  */
 
 #include "au_update_json.h"
-#include <algorithm>
-#include <QJsonDocument>
-#include <QFile>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 
 using namespace au_doc;
 
-AuUpdateJson::AuUpdateJson(const QByteArray& byte_array)
-    : m_byte_array(byte_array)
-    , m_update_doc()
-    , m_update_map()
+namespace
 {
-}
+    /**
+     * Deeper nesting is no manifest, the limit protects the stack
+     */
+    constexpr int MAX_DEPTH = 64;
 
-bool AuUpdateJson::update()
-{
-    QJsonParseError err;
-    m_update_doc = QJsonDocument::fromJson(m_byte_array, &err);
+    /**
+     * Single pass parser from the manifest text straight into AuDoc.
+     *
+     * No DOM is built: known fields are decoded into their destination,
+     * everything else is skipped. Strings without escapes are found with
+     * memchr(), which uses the SIMD code of the C library, and copied in
+     * one piece. Scalars of other types are taken as their JSON text, like
+     * QVariant::toString() did before.
+     */
+    class ManifestParser
+    {
+    public:
+        ManifestParser(const char* data, size_t size)
+            : m_pos(data)
+            , m_end(data + size)
+            , m_begin(data)
+            , m_error()
+            , m_skipped()
+        {
+        }
 
-    auto debug = m_update_doc.toJson();
+        bool parse(AuDoc& doc)
+        {
+            // tolerate a UTF-8 byte order mark
+            if ((m_end - m_pos >= 3) && (std::memcmp(m_pos, "\xEF\xBB\xBF", 3) == 0))
+            {
+                m_pos += 3;
+            }
 
-    m_update_map = qvariant_cast<QVariantMap>(m_update_doc.toVariant());
+            std::string app_name;
+            if (!parseObject([this, &doc, &app_name](std::string& key) {
+                    app_name.swap(key);
+                    AuApp app;
+                    if (!parseApp(app))
+                    {
+                        return false;
+                    }
+                    doc.m_apps[app_name] = std::move(app);
+                    return true;
+                }))
+            {
+                return false;
+            }
 
-    return true;
-}
+            skipWhitespace();
+            if (m_pos != m_end)
+            {
+                return fail("Unexpected data after the manifest");
+            }
+            return true;
+        }
 
+        std::string getError() const
+        {
+            return m_error;
+        }
 
-QVariantMap AuUpdateJson::getVariantMap() const
-{
-    return m_update_map;
-}
+    private:
+        bool parseApp(AuApp& app)
+        {
+            if (!isObject())
+            {
+                // no versions, as before
+                return skipValue(0);
+            }
 
-au_doc::AuDoc AuUpdateJson::getDocument() const
-{
-    au_doc::AuDoc doc;
+            std::string version_key;
+            return parseObject([this, &app, &version_key](std::string& key) {
+                version_key.swap(key);
+                AuAppVersion app_version;
+                if (!parseAppVersion(app_version))
+                {
+                    return false;
+                }
+                app.m_app_versions[version_key] = std::move(app_version);
+                return true;
+            });
+        }
 
-    for (auto app_it = m_update_map.begin(); app_it != m_update_map.end(); ++app_it)
-    {
-        AuApp au_app;
+        bool parseAppVersion(AuAppVersion& app_version)
+        {
+            if (!isObject())
+            {
+                return skipValue(0);
+            }
+
+            return parseObject([this, &app_version](std::string& key) {
+                if (key == "beta")              return parseText(app_version.beta);
+                if (key == "version")           return parseText(app_version.version);
+                if (key == "release_note_url")  return parseText(app_version.release_note_url);
+                if (key == "release_date")      return parseText(app_version.release_date);
+                if (key == "license")           return parseText(app_version.license);
+                if (key == "url")               return parseText(app_version.url);
+                if (key == "md5")               return parseText(app_version.md5);
+                if (key == "sha1")              return parseText(app_version.sha1);
+                if (key == "sha256")            return parseText(app_version.sha256);
+                if (key == "blake3")            return parseText(app_version.blake3);
+                if (key == "notify")            return parseText(app_version.notify);
+                if (key == "chunk_index")       return parseText(app_version.chunk_index);
+                if (key == "chunk_hashes")      return parseChunkHashes(app_version.chunk_hashes);
+                if (key == "bundle")            return parseTextList(app_version.bundle);
+                if (key == "changes")           return parseTextList(app_version.changes);
+                if (key == "deltas")            return parseDeltas(app_version.deltas);
+                return skipValue(0);
+            });
+        }
+
+        bool parseDeltas(std::vector<AuDelta>& deltas)
+        {
+            deltas.clear();
+            if (!isArray())
+            {
+                return skipValue(0);
+            }
+
+            return parseArray([this, &deltas]() {
+                AuDelta delta;
+                if (!isObject())
+                {
+                    // an empty delta, as before
+                    if (!skipValue(0))
+                    {
+                        return false;
+                    }
+                }
+                else if (!parseObject([this, &delta](std::string& key) {
+                        if (key == "from_version")  return parseText(delta.from_version);
+                        if (key == "from_sha1")     return parseText(delta.from_sha1);
+                        if (key == "url")           return parseText(delta.url);
+                        if (key == "format")        return parseText(delta.format);
+                        if (key == "sha1")          return parseText(delta.sha1);
+                        return skipValue(0);
+                    }))
+                {
+                    return false;
+                }
+                deltas.push_back(std::move(delta));
+                return true;
+            });
+        }
+
+        bool parseChunkHashes(AuChunkHashes& chunk_hashes)
+        {
+            chunk_hashes = AuChunkHashes();
+            if (!isObject())
+            {
+                return skipValue(0);
+            }
+
+            return parseObject([this, &chunk_hashes](std::string& key) {
+                if (key == "url")   return parseText(chunk_hashes.url);
+                if (key == "root")  return parseText(chunk_hashes.root);
+                if (key == "chunk_size")
+                {
+                    std::string chunk_size;
+                    if (!parseText(chunk_size))
+                    {
+                        return false;
+                    }
+                    chunk_hashes.chunk_size = std::strtoll(chunk_size.c_str(), nullptr, 10);
+                    return true;
+                }
+                return skipValue(0);
+            });
+        }
+
+        /**
+         * An array of strings, a single string counts as a list of one
+         */
+        bool parseTextList(std::vector<std::string>& list)
+        {
+            list.clear();
+            if (!isArray())
+            {
+                std::string text;
+                if (!parseText(text))
+                {
+                    return false;
+                }
+                if (!text.empty())
+                {
+                    list.push_back(std::move(text));
+                }
+                return true;
+            }
+
+            return parseArray([this, &list]() {
+                std::string text;
+                if (!parseText(text))
+                {
+                    return false;
+                }
+                list.push_back(std::move(text));
+                return true;
+            });
+        }
+
+        /**
+         * A string, a number or a literal as text, objects and arrays are empty
+         */
+        bool parseText(std::string& text)
+        {
+            text.clear();
+            skipWhitespace();
+            if (m_pos == m_end)
+            {
+                return fail("Unexpected end of the manifest");
+            }
+
+            switch (*m_pos)
+            {
+            case '"':
+                return parseString(text);
+            case '{':
+            case '[':
+                return skipValue(0);
+            case 'n':
+                return parseLiteral("null");
+            case 't':
+                text = "true";
+                return parseLiteral("true");
+            case 'f':
+                text = "false";
+                return parseLiteral("false");
+            default:
+                break;
+            }
+
+            auto number_end = scanNumber();
+            if (number_end == m_pos)
+            {
+                return fail("Unexpected character");
+            }
+            text.assign(m_pos, number_end);
+            m_pos = number_end;
+            return true;
+        }
+
+        template <typename MemberHandler>
+        bool parseObject(MemberHandler handle_member)
+        {
+            if (!expect('{'))
+            {
+                return false;
+            }
+            skipWhitespace();
+            if (consume('}'))
+            {
+                return true;
+            }
+
+            std::string key;
+            while (true)
+            {
+                skipWhitespace();
+                if ((m_pos == m_end) || (*m_pos != '"'))
+                {
+                    return fail("Expected a member name");
+                }
+                if (!parseString(key) || !expect(':') || !handle_member(key))
+                {
+                    return false;
+                }
 
-        QVariantMap ver_map = qvariant_cast<QVariantMap>(app_it.value());
+                skipWhitespace();
+                if (consume(','))
+                {
+                    continue;
+                }
+                return expect('}');
+            }
+        }
 
-        for (auto ver_it = ver_map.begin(); ver_it != ver_map.end(); ++ver_it)
+        template <typename ElementHandler>
+        bool parseArray(ElementHandler handle_element)
         {
-            AuAppVersion au_ver;
-            QVariantMap ver_val = qvariant_cast<QVariantMap>(ver_it.value());
-            au_ver.beta = ver_val["beta"].toString().toStdString();
-            au_ver.version = ver_val["version"].toString().toStdString();
-            au_ver.release_note_url = ver_val["release_note_url"].toString().toStdString();
-            au_ver.release_date = ver_val["release_date"].toString().toStdString();
-            au_ver.license = ver_val["license"].toString().toStdString();
-            au_ver.url = ver_val["url"].toString().toStdString();
-            au_ver.md5 = ver_val["md5"].toString().toStdString();
-            au_ver.sha1 = ver_val["sha1"].toString().toStdString();
-            au_ver.notify = ver_val["notify"].toString().toStdString();
+            if (!expect('['))
+            {
+                return false;
+            }
+            skipWhitespace();
+            if (consume(']'))
+            {
+                return true;
+            }
 
-            auto bundle = ver_val["bundle"].toStringList();
-            au_ver.bundle.resize(bundle.size());
-            std::transform(bundle.begin(), bundle.end(), au_ver.bundle.begin(),
-                [](QString entry) {
-                    return entry.toStdString();
+            while (true)
+            {
+                if (!handle_element())
+                {
+                    return false;
                 }
-                );
 
-            auto changes = ver_val["changes"].toStringList();
-            au_ver.changes.resize(changes.size());
-            std::transform(changes.begin(), changes.end(), au_ver.changes.begin(),
-                [](QString entry) {
-                return entry.toStdString();
+                skipWhitespace();
+                if (consume(','))
+                {
+                    continue;
+                }
+                return expect(']');
             }
-            );
+        }
 
+        bool parseString(std::string& text)
+        {
+            text.clear();
+            ++m_pos;
+
+            while (true)
+            {
+                auto quote = static_cast<const char*>(std::memchr(m_pos, '"', static_cast<size_t>(m_end - m_pos)));
+                if (!quote)
+                {
+                    return fail("Unterminated string");
+                }
+                auto backslash = static_cast<const char*>(std::memchr(m_pos, '\\', static_cast<size_t>(quote - m_pos)));
+                if (!backslash)
+                {
+                    // the common case, no escapes up to the closing quote
+                    text.append(m_pos, quote);
+                    m_pos = quote + 1;
+                    return true;
+                }
 
-            au_app.m_app_versions.insert({ ver_it.key().toStdString(), au_ver});
+                text.append(m_pos, backslash);
+                m_pos = backslash;
+                if (!parseEscape(text))
+                {
+                    return false;
+                }
+            }
         }
 
-        doc.m_apps.insert({ app_it.key().toStdString(), au_app });
+        bool parseEscape(std::string& text)
+        {
+            if (m_end - m_pos < 2)
+            {
+                return fail("Unterminated string");
+            }
+
+            auto escape = m_pos[1];
+            m_pos += 2;
+            switch (escape)
+            {
+            case '"':  text.push_back('"');  return true;
+            case '\\': text.push_back('\\'); return true;
+            case '/':  text.push_back('/');  return true;
+            case 'b':  text.push_back('\b'); return true;
+            case 'f':  text.push_back('\f'); return true;
+            case 'n':  text.push_back('\n'); return true;
+            case 'r':  text.push_back('\r'); return true;
+            case 't':  text.push_back('\t'); return true;
+            case 'u':  break;
+            default:   return fail("Invalid escape sequence");
+            }
+
+            uint32_t code_point = 0;
+            if (!parseHex4(code_point))
+            {
+                return false;
+            }
+            if ((code_point >= 0xD800) && (code_point <= 0xDBFF))
+            {
+                // high surrogate, the low one has to follow
+                uint32_t low = 0;
+                if ((m_end - m_pos < 2) || (m_pos[0] != '\\') || (m_pos[1] != 'u'))
+                {
+                    return fail("Unpaired surrogate");
+                }
+                m_pos += 2;
+                if (!parseHex4(low) || (low < 0xDC00) || (low > 0xDFFF))
+                {
+                    return fail("Unpaired surrogate");
+                }
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+            }
+            else if ((code_point >= 0xDC00) && (code_point <= 0xDFFF))
+            {
+                return fail("Unpaired surrogate");
+            }
+
+            appendUtf8(text, code_point);
+            return true;
+        }
+
+        bool parseHex4(uint32_t& value)
+        {
+            if (m_end - m_pos < 4)
+            {
+                return fail("Invalid unicode escape");
+            }
+            value = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                auto c = m_pos[i];
+                value <<= 4;
+                if ((c >= '0') && (c <= '9'))      value |= static_cast<uint32_t>(c - '0');
+                else if ((c >= 'a') && (c <= 'f')) value |= static_cast<uint32_t>(c - 'a' + 10);
+                else if ((c >= 'A') && (c <= 'F')) value |= static_cast<uint32_t>(c - 'A' + 10);
+                else return fail("Invalid unicode escape");
+            }
+            m_pos += 4;
+            return true;
+        }
+
+        static void appendUtf8(std::string& text, uint32_t code_point)
+        {
+            if (code_point < 0x80)
+            {
+                text.push_back(static_cast<char>(code_point));
+            }
+            else if (code_point < 0x800)
+            {
+                text.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+                text.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+            else if (code_point < 0x10000)
+            {
+                text.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+                text.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                text.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+            else
+            {
+                text.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+                text.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+                text.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                text.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+        }
+
+        bool parseLiteral(const char* literal)
+        {
+            auto length = std::strlen(literal);
+            if ((static_cast<size_t>(m_end - m_pos) < length) || (std::memcmp(m_pos, literal, length) != 0))
+            {
+                return fail("Invalid literal");
+            }
+            m_pos += length;
+            return true;
+        }
+
+        const char* scanNumber() const
+        {
+            auto pos = m_pos;
+            while ((pos != m_end) && (((*pos >= '0') && (*pos <= '9'))
+                || (*pos == '-') || (*pos == '+') || (*pos == '.') || (*pos == 'e') || (*pos == 'E')))
+            {
+                ++pos;
+            }
+            return pos;
+        }
+
+        /**
+         * Unknown fields are validated but not decoded
+         */
+        bool skipValue(int depth)
+        {
+            if (depth > MAX_DEPTH)
+            {
+                return fail("Nesting too deep");
+            }
+
+            skipWhitespace();
+            if (m_pos == m_end)
+            {
+                return fail("Unexpected end of the manifest");
+            }
+
+            switch (*m_pos)
+            {
+            case '{':
+                return parseObject([this, depth](std::string&) { return skipValue(depth + 1); });
+            case '[':
+                return parseArray([this, depth]() { return skipValue(depth + 1); });
+            case '"':
+                return parseString(m_skipped);
+            default:
+                return parseText(m_skipped);
+            }
+        }
+
+        bool isObject()
+        {
+            skipWhitespace();
+            return (m_pos != m_end) && (*m_pos == '{');
+        }
+
+        bool isArray()
+        {
+            skipWhitespace();
+            return (m_pos != m_end) && (*m_pos == '[');
+        }
+
+        void skipWhitespace()
+        {
+            while ((m_pos != m_end) && ((*m_pos == ' ') || (*m_pos == '\n') || (*m_pos == '\r') || (*m_pos == '\t')))
+            {
+                ++m_pos;
+            }
+        }
+
+        bool consume(char c)
+        {
+            if ((m_pos != m_end) && (*m_pos == c))
+            {
+                ++m_pos;
+                return true;
+            }
+            return false;
+        }
+
+        bool expect(char c)
+        {
+            skipWhitespace();
+            if (!consume(c))
+            {
+                return fail(std::string("Expected '") + c + "'");
+            }
+            return true;
+        }
+
+        bool fail(const std::string& error)
+        {
+            if (m_error.empty())
+            {
+                m_error = error + " at offset " + std::to_string(m_pos - m_begin);
+            }
+            return false;
+        }
+
+    private:
+        const char* m_pos;
+        const char* m_end;
+        const char* m_begin;
+        std::string m_error;
+        std::string m_skipped;
+    };
+}
+
+
+AuUpdateJson::AuUpdateJson(const QByteArray& byte_array)
+    : m_byte_array(byte_array)
+    , m_doc()
+    , m_error()
+{
+}
+
+bool AuUpdateJson::update()
+{
+    m_doc = AuDoc();
+    m_error.clear();
+
+    ManifestParser parser(m_byte_array.constData(), static_cast<size_t>(m_byte_array.size()));
+    if (!parser.parse(m_doc))
+    {
+        m_error = QString::fromStdString(parser.getError());
+        m_doc = AuDoc();
+        return false;
     }
+    return true;
+}
 
-    return doc;
+QString AuUpdateJson::getError() const
+{
+    return m_error;
+}
+
+const au_doc::AuDoc& AuUpdateJson::getDocument() const
+{
+    return m_doc;
 }
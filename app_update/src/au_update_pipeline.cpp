@@ -0,0 +1,308 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_update_pipeline.h"
+#include <QDebug>
+#include <QFileInfo>
+
+AuUpdatePipeline::AuUpdatePipeline(QObject* parent)
+    : QObject(parent)
+    , m_packages()
+    , m_installer(nullptr)
+    , m_installing(-1)
+{
+}
+
+AuUpdatePipeline::~AuUpdatePipeline()
+{
+    if (m_installer)
+    {
+        // never interrupt the package manager, let the installation complete
+        disconnect(m_installer, nullptr, this, nullptr);
+        m_installer->waitForFinished(-1);
+        delete m_installer;
+    }
+}
+
+bool AuUpdatePipeline::start(const QList<Package>& packages)
+{
+    if (isRunning())
+    {
+        return false;
+    }
+
+    m_packages = packages;
+    for (auto& package : m_packages)
+    {
+        package.stage = Stage::PENDING;
+        package.file_name.clear();
+        package.error.clear();
+    }
+
+    // the scheduler limits how many of them transfer at the same time
+    for (auto& package : m_packages)
+    {
+        setStage(package, Stage::DOWNLOADING);
+        Q_EMIT downloadRequested(package.url, package.name);
+    }
+
+    checkFinished();
+    return true;
+}
+
+bool AuUpdatePipeline::isRunning() const
+{
+    for (const auto& package : m_packages)
+    {
+        if (!isFinal(package.stage))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+const AuUpdatePipeline::Package* AuUpdatePipeline::getPackage(const QUrl& url) const
+{
+    for (const auto& package : m_packages)
+    {
+        if (package.url == url)
+        {
+            return &package;
+        }
+    }
+    return nullptr;
+}
+
+QString AuUpdatePipeline::stageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::PENDING:
+        return "pending";
+    case Stage::DOWNLOADING:
+        return "downloading";
+    case Stage::VERIFYING:
+        return "verifying";
+    case Stage::WAITING:
+        return "waiting";
+    case Stage::INSTALLING:
+        return "installing";
+    case Stage::DOWNLOADED:
+        return "downloaded";
+    case Stage::DONE:
+        return "done";
+    case Stage::FAILED:
+        return "failed";
+    }
+    return {};
+}
+
+void AuUpdatePipeline::downloadProgress(const QUrl& url, qint64 curr, qint64 max)
+{
+    auto package = findPackage(url);
+    if (package && (package->stage == Stage::DOWNLOADING) && (max > 0) && (curr >= max))
+    {
+        // all bytes are there, the hash worker catches up with the last chunks
+        setStage(*package, Stage::VERIFYING);
+    }
+}
+
+void AuUpdatePipeline::downloadVerified(const QUrl& url, const QString& file_name)
+{
+    auto package = findPackage(url);
+    if (!package || isFinal(package->stage))
+    {
+        return;
+    }
+
+    package->file_name = file_name;
+    setStage(*package, Stage::WAITING);
+    installNext();
+    checkFinished();
+}
+
+void AuUpdatePipeline::downloadFailed(const QUrl& url, const QString& error)
+{
+    auto package = findPackage(url);
+    if (!package || isFinal(package->stage))
+    {
+        return;
+    }
+
+    setStage(*package, Stage::FAILED, error);
+    // later packages must not wait for this one
+    installNext();
+    checkFinished();
+}
+
+AuUpdatePipeline::Package* AuUpdatePipeline::findPackage(const QUrl& url)
+{
+    for (auto& package : m_packages)
+    {
+        if (package.url == url)
+        {
+            return &package;
+        }
+    }
+    return nullptr;
+}
+
+void AuUpdatePipeline::setStage(Package& package, Stage stage, const QString& error)
+{
+    package.stage = stage;
+    package.error = error;
+    if (!error.isEmpty())
+    {
+        qWarning().noquote() << QString("Update %1 %2: %3").arg(package.name, stageName(stage), error);
+    }
+    Q_EMIT packageChanged(package.url);
+}
+
+bool AuUpdatePipeline::isFinal(Stage stage)
+{
+    return (stage == Stage::DOWNLOADED) || (stage == Stage::DONE) || (stage == Stage::FAILED);
+}
+
+void AuUpdatePipeline::installNext()
+{
+    if (m_installer)
+    {
+        // one installation at a time
+        return;
+    }
+
+    // install in package order, e.g. drivers before applications
+    for (int index = 0; index < m_packages.size(); ++index)
+    {
+        auto& package = m_packages[index];
+        if (isFinal(package.stage))
+        {
+            continue;
+        }
+        if (package.stage != Stage::WAITING)
+        {
+            // an earlier package is still downloading
+            return;
+        }
+
+        QString program;
+        QStringList arguments;
+        if (!installCommand(package.file_name, program, arguments))
+        {
+            setStage(package, Stage::DOWNLOADED, QString("%1 has to be installed manually").arg(package.file_name));
+            continue;
+        }
+
+        m_installing = index;
+        setStage(package, Stage::INSTALLING);
+
+        m_installer = new QProcess(this);
+        m_installer->setProcessChannelMode(QProcess::MergedChannels);
+        connect(m_installer, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &AuUpdatePipeline::installFinished);
+        connect(m_installer, &QProcess::errorOccurred, this, &AuUpdatePipeline::installError);
+        m_installer->start(program, arguments);
+        return;
+    }
+}
+
+bool AuUpdatePipeline::installCommand(const QString& file_name, QString& program, QStringList& arguments) const
+{
+#ifdef Q_OS_UNIX
+    if (QFileInfo(file_name).suffix() == "deb")
+    {
+        // dpkg needs root, pkexec asks for the password
+        program = "pkexec";
+        arguments = QStringList{ "dpkg", "-i", file_name };
+        return true;
+    }
+#endif
+    Q_UNUSED(file_name);
+    Q_UNUSED(program);
+    Q_UNUSED(arguments);
+    return false;
+}
+
+void AuUpdatePipeline::installFinished(int exit_code, QProcess::ExitStatus exit_status)
+{
+    auto output = QString::fromLocal8Bit(m_installer->readAll()).trimmed();
+    m_installer->deleteLater();
+    m_installer = nullptr;
+
+    auto& package = m_packages[m_installing];
+    m_installing = -1;
+
+    if ((exit_status != QProcess::NormalExit) || (exit_code != 0))
+    {
+        setStage(package, Stage::FAILED, QString("Installation failed (%1): %2").arg(exit_code).arg(output));
+    }
+    else
+    {
+        setStage(package, Stage::DONE);
+    }
+
+    installNext();
+    checkFinished();
+}
+
+void AuUpdatePipeline::installError(QProcess::ProcessError error)
+{
+    if (error != QProcess::FailedToStart)
+    {
+        // finished() follows
+        return;
+    }
+
+    auto error_string = m_installer->errorString();
+    m_installer->deleteLater();
+    m_installer = nullptr;
+
+    auto& package = m_packages[m_installing];
+    m_installing = -1;
+    setStage(package, Stage::FAILED, QString("Could not start the installation: %1").arg(error_string));
+
+    installNext();
+    checkFinished();
+}
+
+void AuUpdatePipeline::checkFinished()
+{
+    if (m_packages.isEmpty() || isRunning())
+    {
+        return;
+    }
+
+    int done = 0;
+    int manual = 0;
+    int failed = 0;
+    for (const auto& package : m_packages)
+    {
+        if (package.stage == Stage::FAILED)
+        {
+            ++failed;
+        }
+        else if (package.stage == Stage::DOWNLOADED)
+        {
+            ++manual;
+        }
+        else
+        {
+            ++done;
+        }
+    }
+    Q_EMIT finished(done, manual, failed);
+}
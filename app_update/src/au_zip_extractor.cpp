@@ -0,0 +1,570 @@
+/*
+ * This file is part of the AppUpdate (https://github.com/DEWETRON/AppUpdate)
+ * Copyright (c) DEWETRON GmbH 2020.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "au_zip_extractor.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QtEndian>
+
+#ifdef AU_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace
+{
+    constexpr quint32 LOCAL_HEADER_SIGNATURE = 0x04034b50;
+    constexpr quint32 DATA_DESCRIPTOR_SIGNATURE = 0x08074b50;
+    constexpr quint32 CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+    constexpr quint32 END_OF_CENTRAL_DIR_SIGNATURE = 0x06054b50;
+    constexpr qint64 LOCAL_HEADER_SIZE = 30;
+
+    constexpr quint16 FLAG_ENCRYPTED = 0x0001;
+    constexpr quint16 FLAG_DATA_DESCRIPTOR = 0x0008;
+    constexpr quint16 FLAG_UTF8 = 0x0800;
+
+    constexpr quint16 METHOD_STORED = 0;
+    constexpr quint16 METHOD_DEFLATED = 8;
+
+    constexpr quint16 ZIP64_EXTRA_ID = 0x0001;
+    constexpr quint32 ZIP64_MARKER = 0xffffffff;
+
+    constexpr qint64 READ_CHUNK_SIZE = 1024 * 1024;
+    constexpr int OUTPUT_CHUNK_SIZE = 256 * 1024;
+
+    quint16 readU16(const char* data)
+    {
+        return qFromLittleEndian<quint16>(data);
+    }
+
+    quint32 readU32(const char* data)
+    {
+        return qFromLittleEndian<quint32>(data);
+    }
+
+    quint64 readU64(const char* data)
+    {
+        return qFromLittleEndian<quint64>(data);
+    }
+}
+
+struct AuZipExtractor::Inflater
+{
+#ifdef AU_HAVE_ZLIB
+    z_stream zstream = {};
+    bool zstream_init = false;
+#endif
+    QByteArray output;
+
+    bool init()
+    {
+#ifdef AU_HAVE_ZLIB
+        release();
+        // entries are headerless deflate streams
+        zstream_init = (inflateInit2(&zstream, -15) == Z_OK);
+        output.resize(OUTPUT_CHUNK_SIZE);
+        return zstream_init;
+#else
+        return false;
+#endif
+    }
+
+    void release()
+    {
+#ifdef AU_HAVE_ZLIB
+        if (zstream_init)
+        {
+            inflateEnd(&zstream);
+            zstream = {};
+            zstream_init = false;
+        }
+#endif
+    }
+
+    static quint32 crc32(quint32 crc, const char* data, qint64 length)
+    {
+#ifdef AU_HAVE_ZLIB
+        while (length > 0)
+        {
+            auto block = static_cast<uInt>(qMin<qint64>(length, 1 << 30));
+            crc = static_cast<quint32>(::crc32(crc, reinterpret_cast<const Bytef*>(data), block));
+            data += block;
+            length -= block;
+        }
+#else
+        Q_UNUSED(data);
+        Q_UNUSED(length);
+#endif
+        return crc;
+    }
+};
+
+AuZipExtractor::AuZipExtractor(const QString& staging_dir)
+    : QObject(nullptr)
+    , m_staging_dir(staging_dir)
+    , m_state(State::HEADER)
+    , m_buffer()
+    , m_pos(0)
+    , m_entry()
+    , m_file()
+    , m_crc(0)
+    , m_consumed(0)
+    , m_written(0)
+    , m_entry_count(0)
+    , m_error()
+    , m_inflater(new Inflater)
+{
+    // leftovers of an interrupted run
+    reset();
+}
+
+AuZipExtractor::~AuZipExtractor()
+{
+    close();
+}
+
+bool AuZipExtractor::isSupported()
+{
+#ifdef AU_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool AuZipExtractor::publish(const QString& staging_dir, const QString& target_dir)
+{
+    QDir dir;
+    const QString old_dir = target_dir + ".old";
+    if (QFileInfo::exists(target_dir))
+    {
+        QDir(old_dir).removeRecursively();
+        if (!dir.rename(target_dir, old_dir))
+        {
+            return false;
+        }
+    }
+
+    if (!dir.rename(staging_dir, target_dir))
+    {
+        dir.rename(old_dir, target_dir);
+        return false;
+    }
+    QDir(old_dir).removeRecursively();
+    return true;
+}
+
+void AuZipExtractor::addFile(const QString& file_name, qint64 offset, qint64 length)
+{
+    QFile file(file_name);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(offset))
+    {
+        fail(QString("Could not read %1").arg(file_name));
+        return;
+    }
+
+    while ((length > 0) && (m_state != State::DONE) && (m_state != State::NO_ARCHIVE) && (m_state != State::FAILED))
+    {
+        auto chunk = file.read(qMin(length, READ_CHUNK_SIZE));
+        if (chunk.isEmpty())
+        {
+            fail(QString("Could not read %1").arg(file_name));
+            return;
+        }
+        addData(chunk);
+        length -= chunk.size();
+    }
+}
+
+void AuZipExtractor::addData(const QByteArray& chunk)
+{
+    if ((m_state == State::DONE) || (m_state == State::NO_ARCHIVE) || (m_state == State::FAILED))
+    {
+        // the central directory only repeats the local headers
+        return;
+    }
+    m_buffer.append(chunk);
+    consume();
+}
+
+void AuZipExtractor::finish()
+{
+    if ((m_state != State::DONE) && (m_state != State::NO_ARCHIVE) && (m_state != State::FAILED))
+    {
+        fail(m_entry_count > 0 ? QString("Zip archive is truncated") : QString());
+    }
+    Q_EMIT extractFinished(m_state == State::DONE, m_error);
+}
+
+void AuZipExtractor::reset()
+{
+    close();
+    QDir(m_staging_dir).removeRecursively();
+    m_state = State::HEADER;
+    m_buffer.clear();
+    m_pos = 0;
+    m_entry_count = 0;
+    m_error.clear();
+}
+
+void AuZipExtractor::consume()
+{
+    bool progress = true;
+    while (progress)
+    {
+        switch (m_state)
+        {
+        case State::HEADER:
+            progress = readHeader();
+            break;
+        case State::DATA:
+            progress = (m_entry.method == METHOD_STORED) ? readStored() : readDeflated();
+            break;
+        case State::DESCRIPTOR:
+            progress = readDescriptor();
+            break;
+        case State::DONE:
+        case State::NO_ARCHIVE:
+        case State::FAILED:
+            progress = false;
+            break;
+        }
+    }
+
+    m_buffer.remove(0, static_cast<int>(m_pos));
+    m_pos = 0;
+}
+
+bool AuZipExtractor::readHeader()
+{
+    if (available() < 4)
+    {
+        return false;
+    }
+
+    const auto signature = readU32(data());
+    if ((m_entry_count > 0) && ((signature == CENTRAL_HEADER_SIGNATURE) || (signature == END_OF_CENTRAL_DIR_SIGNATURE)))
+    {
+        m_state = State::DONE;
+        return false;
+    }
+    if (signature != LOCAL_HEADER_SIGNATURE)
+    {
+        if (m_entry_count == 0)
+        {
+            // an installer which is no archive, nothing to do
+            m_state = State::NO_ARCHIVE;
+        }
+        else
+        {
+            fail("Zip archive is corrupt");
+        }
+        return false;
+    }
+
+    if (available() < LOCAL_HEADER_SIZE)
+    {
+        return false;
+    }
+    const auto header = data();
+    const auto name_size = readU16(header + 26);
+    const auto extra_size = readU16(header + 28);
+    if (available() < LOCAL_HEADER_SIZE + name_size + extra_size)
+    {
+        return false;
+    }
+
+    Entry entry;
+    entry.flags = readU16(header + 6);
+    entry.method = readU16(header + 8);
+    entry.crc = readU32(header + 14);
+    entry.compressed_size = readU32(header + 18);
+    entry.size = readU32(header + 22);
+    entry.zip64 = false;
+
+    const QByteArray raw_name(header + LOCAL_HEADER_SIZE, name_size);
+    entry.name = (entry.flags & FLAG_UTF8) ? QString::fromUtf8(raw_name) : QString::fromLocal8Bit(raw_name);
+
+    // ZIP64 sizes follow in the extra field, in this order, if the header has the marker
+    const auto extra = header + LOCAL_HEADER_SIZE + name_size;
+    for (int pos = 0; pos + 4 <= extra_size;)
+    {
+        const auto id = readU16(extra + pos);
+        const auto size = readU16(extra + pos + 2);
+        if (pos + 4 + size > extra_size)
+        {
+            break;
+        }
+        if (id == ZIP64_EXTRA_ID)
+        {
+            entry.zip64 = true;
+            int field_pos = pos + 4;
+            if ((entry.size == ZIP64_MARKER) && (field_pos + 8 <= pos + 4 + size))
+            {
+                entry.size = readU64(extra + field_pos);
+                field_pos += 8;
+            }
+            if ((entry.compressed_size == ZIP64_MARKER) && (field_pos + 8 <= pos + 4 + size))
+            {
+                entry.compressed_size = readU64(extra + field_pos);
+            }
+        }
+        pos += 4 + size;
+    }
+
+    m_pos += LOCAL_HEADER_SIZE + name_size + extra_size;
+    return beginEntry(entry);
+}
+
+bool AuZipExtractor::beginEntry(const Entry& entry)
+{
+    if (entry.flags & FLAG_ENCRYPTED)
+    {
+        fail(QString("%1 is encrypted").arg(entry.name));
+        return false;
+    }
+    if ((entry.method != METHOD_STORED) && (entry.method != METHOD_DEFLATED))
+    {
+        fail(QString("%1 uses unsupported compression %2").arg(entry.name).arg(entry.method));
+        return false;
+    }
+    if ((entry.method == METHOD_STORED) && (entry.flags & FLAG_DATA_DESCRIPTOR))
+    {
+        // the end of the data is unknown
+        fail(QString("%1 is stored without size").arg(entry.name));
+        return false;
+    }
+
+    const auto relative_path = sanitizeName(entry.name);
+    if (relative_path.isEmpty())
+    {
+        fail(QString("Unsafe entry name %1").arg(entry.name));
+        return false;
+    }
+
+    const auto path = m_staging_dir + "/" + relative_path;
+    if (entry.name.endsWith("/"))
+    {
+        QDir().mkpath(path);
+    }
+    else
+    {
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        m_file.setFileName(path);
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            fail(QString("Could not create %1").arg(path));
+            return false;
+        }
+    }
+
+    if ((entry.method == METHOD_DEFLATED) && !m_inflater->init())
+    {
+        fail(QString("Could not decompress %1").arg(entry.name));
+        return false;
+    }
+
+    m_entry = entry;
+    m_crc = 0;
+    m_consumed = 0;
+    m_written = 0;
+    ++m_entry_count;
+    m_state = State::DATA;
+    return true;
+}
+
+bool AuZipExtractor::readStored()
+{
+    const auto length = qMin<qint64>(available(), static_cast<qint64>(m_entry.compressed_size - m_consumed));
+    if (length > 0)
+    {
+        write(data(), length);
+        m_pos += length;
+        m_consumed += length;
+    }
+    if ((m_state != State::DATA) || (m_consumed < m_entry.compressed_size))
+    {
+        return false;
+    }
+    return endData();
+}
+
+bool AuZipExtractor::readDeflated()
+{
+#ifdef AU_HAVE_ZLIB
+    // without data descriptor the compressed size is known, otherwise the stream end tells
+    auto input_size = available();
+    if (!(m_entry.flags & FLAG_DATA_DESCRIPTOR))
+    {
+        if (m_consumed >= m_entry.compressed_size)
+        {
+            fail(QString("%1 is corrupt").arg(m_entry.name));
+            return false;
+        }
+        input_size = qMin<qint64>(input_size, static_cast<qint64>(m_entry.compressed_size - m_consumed));
+    }
+    if (input_size <= 0)
+    {
+        return false;
+    }
+
+    auto& zstream = m_inflater->zstream;
+    auto& output = m_inflater->output;
+    zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data()));
+    zstream.avail_in = static_cast<uInt>(qMin<qint64>(input_size, 1 << 30));
+    const auto input_used = static_cast<qint64>(zstream.avail_in);
+
+    int ret = Z_OK;
+    do
+    {
+        zstream.next_out = reinterpret_cast<Bytef*>(output.data());
+        zstream.avail_out = OUTPUT_CHUNK_SIZE;
+        ret = inflate(&zstream, Z_NO_FLUSH);
+        write(output.constData(), OUTPUT_CHUNK_SIZE - static_cast<qint64>(zstream.avail_out));
+    } while ((ret == Z_OK) && (zstream.avail_out == 0) && (m_state == State::DATA));
+
+    const auto used = input_used - static_cast<qint64>(zstream.avail_in);
+    m_pos += used;
+    m_consumed += used;
+
+    if (m_state != State::DATA)
+    {
+        return false;
+    }
+    if (ret == Z_STREAM_END)
+    {
+        m_inflater->release();
+        return endData();
+    }
+    if ((ret != Z_OK) && (ret != Z_BUF_ERROR))
+    {
+        fail(QString("%1 is corrupt").arg(m_entry.name));
+    }
+    // more input needed
+    return false;
+#else
+    fail(QString("Could not decompress %1").arg(m_entry.name));
+    return false;
+#endif
+}
+
+bool AuZipExtractor::endData()
+{
+    if (m_file.isOpen())
+    {
+        m_file.close();
+    }
+    if (m_entry.flags & FLAG_DATA_DESCRIPTOR)
+    {
+        m_state = State::DESCRIPTOR;
+        return true;
+    }
+    return finishEntry();
+}
+
+bool AuZipExtractor::readDescriptor()
+{
+    // the signature is optional, ZIP64 entries have 8 byte sizes
+    const qint64 size_length = m_entry.zip64 ? 8 : 4;
+    if (available() < 4)
+    {
+        return false;
+    }
+    const qint64 offset = (readU32(data()) == DATA_DESCRIPTOR_SIGNATURE) ? 4 : 0;
+    if (available() < offset + 4 + 2 * size_length)
+    {
+        return false;
+    }
+
+    const auto descriptor = data() + offset;
+    m_entry.crc = readU32(descriptor);
+    m_entry.compressed_size = m_entry.zip64 ? readU64(descriptor + 4) : readU32(descriptor + 4);
+    m_entry.size = m_entry.zip64 ? readU64(descriptor + 4 + size_length) : readU32(descriptor + 4 + size_length);
+    m_pos += offset + 4 + 2 * size_length;
+    return finishEntry();
+}
+
+bool AuZipExtractor::finishEntry()
+{
+    if ((m_crc != m_entry.crc) || (m_written != m_entry.size) || (m_consumed != m_entry.compressed_size))
+    {
+        fail(QString("CRC check of %1 failed").arg(m_entry.name));
+        return false;
+    }
+    m_state = State::HEADER;
+    return true;
+}
+
+void AuZipExtractor::write(const char* data, qint64 length)
+{
+    if (length <= 0)
+    {
+        return;
+    }
+    m_crc = Inflater::crc32(m_crc, data, length);
+    m_written += length;
+
+    if (m_file.isOpen() && (m_file.write(data, length) != length))
+    {
+        fail(QString("Could not write %1").arg(m_file.fileName()));
+    }
+}
+
+void AuZipExtractor::fail(const QString& error)
+{
+    // the verified archive stays, the partial tree is of no use
+    close();
+    QDir(m_staging_dir).removeRecursively();
+    m_state = error.isEmpty() ? State::NO_ARCHIVE : State::FAILED;
+    m_error = error;
+}
+
+void AuZipExtractor::close()
+{
+    if (m_file.isOpen())
+    {
+        m_file.close();
+    }
+    m_inflater->release();
+}
+
+qint64 AuZipExtractor::available() const
+{
+    return m_buffer.size() - m_pos;
+}
+
+const char* AuZipExtractor::data() const
+{
+    return m_buffer.constData() + m_pos;
+}
+
+QString AuZipExtractor::sanitizeName(const QString& name)
+{
+    // entries may only end up below the staging directory
+    QStringList parts;
+    for (const auto& part : QString(name).replace("\\", "/").split('/'))
+    {
+        if ((part == "..") || part.contains(':'))
+        {
+            return {};
+        }
+        if (!part.isEmpty() && (part != "."))
+        {
+            parts.append(part);
+        }
+    }
+    return parts.join('/');
+}